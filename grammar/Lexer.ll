@@ -1,18 +1,16 @@
 %option noyywrap nounput nounistd
 %option yylineno
+%option reentrant bison-bridge bison-locations
+%option extra-type="mdw::formula::Parser*"
 
 %{
 
-extern int formulalex();
-
 #include <iostream>
 #include <stdio.h>
 #include <mdw/formula/Parser.hpp>
 #include <sstream>
 #include <boost/lexical_cast.hpp>
 
-#define YY_DECL int formulalex(mdw::formula::Parser& ioParser)
-
 %}
 
 GREATER_THAN         ">"
@@ -48,6 +46,7 @@ TRUE                 "true"|"TRUE"|"YES"|"yes"|"True"|"Yes"
 FALSE                "false"|"FALSE"|"NO"|"no"|"False"|"No"
 IN                   "IN"|"in"|"In"
 OBJECT_NAME          \$([A-Za-z][A-Za-z0-9_]*)
+SUB_RULE_NAME        @([A-Za-z][A-Za-z0-9_]*)
 IDENTIFIER           ([A-Za-z_][A-Za-z0-9_]*)
 STRING               \"(\\.|[^"])*\"|\'(\\.|[^'])*\'
 FLOAT                ([0-9]*\.[0-9]+|[0-9]+\.)
@@ -56,6 +55,11 @@ INTEGER              (0|[1-9][0-9]*)
 
 %%
 
+%{
+  // The scanner state lives in the Parser (see Parser::parse), so that several can run at once
+  mdw::formula::Parser& ioParser = *yyextra;
+%}
+
 {GREATER_THAN}                                  { return kGreaterThan; }
 
 {GREATER_OR_EQUAL}                              { return kGreaterOrEqual; }
@@ -121,36 +125,46 @@ INTEGER              (0|[1-9][0-9]*)
 {FALSE}                                         { return kFalse;}
 
 {FLOAT} {
-  formulalval.floatValue = atof(formulatext);
+  yylval->floatValue = atof(yytext);
   return kFloat;
 }
 
 {INTEGER} {
-  formulalval.intValue = atoi(formulatext);
+  yylval->intValue = atoi(yytext);
   return kInteger;
 }
 
 {STRING} {
-  formulalval.currentString = &ioParser.createString(formulatext + 1, formulaleng - 2);
+  yylval->currentString = &ioParser.createString(yytext + 1, yyleng - 2);
   return kString;
 }
 
 {OBJECT_NAME} {
-  if (formulaleng > 101) {
+  if (yyleng > 101) {
     throw mdw::UnknownException("Variable name is longer than 100 characters - not supported");
   }
   // Skip the initial $ sign
-  memcpy(formulalval.identifier, formulatext + 1, formulaleng - 1);
-  formulalval.identifier[formulaleng - 1] = 0;
+  memcpy(yylval->identifier, yytext + 1, yyleng - 1);
+  yylval->identifier[yyleng - 1] = 0;
   return kFact;
 }
 
+{SUB_RULE_NAME} {
+  if (yyleng > 101) {
+    throw mdw::UnknownException("Sub-rule name is longer than 100 characters - not supported");
+  }
+  // Skip the initial @ sign
+  memcpy(yylval->identifier, yytext + 1, yyleng - 1);
+  yylval->identifier[yyleng - 1] = 0;
+  return kSubRule;
+}
+
 {IDENTIFIER} {
-  if (formulaleng > 100) {
+  if (yyleng > 100) {
     throw mdw::UnknownException("Identifier is longer than 100 characters - not supported");
   }
-  memcpy(formulalval.identifier, formulatext, formulaleng);
-  formulalval.identifier[formulaleng] = 0;
+  memcpy(yylval->identifier, yytext, yyleng);
+  yylval->identifier[yyleng] = 0;
   return kIdentifier;
 }
 
@@ -9,14 +9,23 @@
 #include <mdw/UnknownException.hpp>
 #include <boost/regex.hpp>
 
-extern int formulalex(mdw::formula::Parser& ioParser);
 extern int formulaparse(mdw::formula::Parser& ioParser);
-extern FILE *formulain;
-
-void formulaerror(mdw::formula::Parser&, const char *s);
 
 %}
 
+%code {
+  // Reentrant scanner generated by flex, its state is held by the Parser
+  extern int formulalex(YYSTYPE *ioValue, YYLTYPE *ioLocation, void *ioScanner);
+
+  static int formulalex(YYSTYPE *ioValue, YYLTYPE *ioLocation, mdw::formula::Parser& ioParser)
+  {
+    return formulalex(ioValue, ioLocation, ioParser.getScanner());
+  }
+
+  void formulaerror(YYLTYPE *iLocation, mdw::formula::Parser& ioParser, const char *s);
+}
+
+%define api.pure full
 %locations
 
 %token kGreaterThan
@@ -54,6 +63,7 @@ void formulaerror(mdw::formula::Parser&, const char *s);
 %token kFalse;
 
 %token <identifier> kFact;
+%token <identifier> kSubRule;
 %token <identifier> kIdentifier;
 
 %token <floatValue> kFloat
@@ -223,6 +233,7 @@ unary   : kNot unary {
 
 terminal:  constant {$$ = $1;}
         |  kFact { $$ = &ioParser.createFact($1); }
+        |  kSubRule { $$ = &ioParser.createSubRule($1); }
         |  terminal kDot kIdentifier { $$ = &ioParser.createAttribute(*$1, $3); }
         |  included {$$ = $1;}
         |  terminal kLeftSquare expr kRightSquare {
@@ -258,7 +269,7 @@ included: kLeftParenthesis expr kRightParenthesis {
         };
 %%
 
-void formulaerror (mdw::formula::Parser& ioParser, char const *s) {
+void formulaerror (YYLTYPE *iLocation, mdw::formula::Parser& ioParser, char const *s) {
   throw mdw::UnknownException("Invalid syntax in the formula: \"" + ioParser.getFormula() + "\"");
  }
 
@@ -183,8 +183,9 @@ namespace mdw { namespace formula {
         return aNewExpr;
       }
 
-    //! Constructor that lets the user decide the initial block size
-    ArenaAllocator(size_t iSize = 512);
+    //! Constructor that lets the user decide the initial block size,
+    //! and the size blocks grow up to (8 KB by default)
+    ArenaAllocator(size_t iSize = 512, size_t iMaxSize = 8192);
 
     // Destructor
     ~ArenaAllocator();
@@ -192,6 +193,7 @@ namespace mdw { namespace formula {
     // Returns a memory block of 'iSize' bytes
     void *allocate(size_t iSize)
     {
+      _usedBytes += iSize;
       if (_current + iSize >= _current && _current + iSize <= _top)
       {
         uint8_t *aResult = _current;
@@ -208,6 +210,18 @@ namespace mdw { namespace formula {
     // Releases all allocated objects
     void clean();
 
+    // Memory taken from malloc, including the unused end of the blocks
+    size_t getAllocatedBytes() const
+    {
+      return _allocatedBytes;
+    }
+
+    // Memory requested by the callers, without alignment nor slack
+    size_t getUsedBytes() const
+    {
+      return _usedBytes;
+    }
+
   protected:
     //! Inner class that remembers the allocated blocks and can be linked
     class BlockLink
@@ -237,11 +251,17 @@ namespace mdw { namespace formula {
     uint8_t *_top;
 
     //! Current block size
-    size_t _bkSize, _initialBkSize;
+    size_t _bkSize, _initialBkSize, _maxBkSize;
 
     //! Pointer to the blocks of memory
     BlockLink *_blocks;
 
+    //! Sum of the blocks sizes
+    size_t _allocatedBytes;
+
+    //! Sum of the requested sizes
+    size_t _usedBytes;
+
     uint8_t *getNewBlock(size_t iSize);
 
     bool saveBlock(BlockLink *, uint8_t *);
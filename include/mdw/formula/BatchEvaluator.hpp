@@ -0,0 +1,258 @@
+#pragma once
+
+#include <mdw/formula/ArenaAllocator.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <mdw/formula/ValueKey.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/type_traits/remove_const.hpp>
+#include <boost/type_traits/remove_reference.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Observer collecting the fact paths ($Fact.Attribute.Attribute...) whose values
+   * are used by the parsed formulas: the rules only depend on these values.
+   * Paths that are only used to reach a deeper attribute are not kept, nor are paths
+   * on local variables. Sub-rules hide their dependencies, so they make the set opaque.
+   */
+  class DependencyCollector: public Parser::NoopObserver {
+  public:
+    explicit DependencyCollector(ArenaAllocator& ioAllocator);
+
+    // To be called with the top expression of each parsed formula
+    void addFormula(const Expression& iTop);
+
+    // The dependencies are unknown (sub-rules...)
+    bool isOpaque() const
+    {
+      return _opaque;
+    }
+
+    // Used paths, without duplicates (by their display)
+    std::vector<const Expression*> getDependencies() const;
+
+    virtual Expression& newFact(Expression& ioResult, const std::string& iName);
+
+    virtual Expression& newSubRule(Expression& ioResult, const std::string& iName);
+
+    virtual Expression& newUnary(Expression& ioResult,
+                                 Expression& ioRight,
+                                 const std::string& iSymbol);
+
+    virtual Expression& newBinary(Expression& ioResult,
+                                  Expression& ioLeft,
+                                  Expression& ioRight,
+                                  const std::string& iSymbol);
+
+    virtual Expression& newChoice(Expression& ioResult,
+                                  TypedExpression<bool>& ioCondition,
+                                  Expression& ioLeft,
+                                  Expression& ioRight);
+
+    virtual Expression& newArrow(Expression& ioResult,
+                                 Expression& ioContainer,
+                                 Expression& ioCondition,
+                                 const std::string& iLocalName);
+
+  private:
+    struct Path {
+      Path():
+        _used(false)
+      {}
+
+      std::string _root;
+      bool _used;
+    };
+    typedef boost::unordered_map<const Expression*, Path> Paths;
+
+    void markUsed(const Expression& iExpression);
+
+    Paths _paths;
+    std::vector<const Expression*> _order;
+    bool _opaque;
+  };
+
+  /*
+   * Non-template part of the BatchEvaluator: rules parsing and key computation.
+   */
+  class BatchEvaluatorBase: private boost::noncopyable {
+  public:
+    explicit BatchEvaluatorBase(const Grammar& iGrammar);
+
+    // Identical records can only be grouped if all the dependencies are basic values
+    bool isDeduplicable() const
+    {
+      return _deduplicable;
+    }
+
+    const std::vector<const Expression*>& getKeys() const
+    {
+      return _keys;
+    }
+
+    // Fills oKey with the values of the dependencies for the facts bound in the context.
+    // Returns false if the record cannot be grouped (NaN or missing value).
+    bool computeKey(IContext& ioContext, ValueKey& oKey) const;
+
+  protected:
+    Expression& parseRule(const std::string& iFormula);
+
+  private:
+    ArenaAllocator _allocator;
+    const Grammar& _grammar;
+    DependencyCollector _collector;
+    std::vector<const Expression*> _keys;
+    bool _deduplicable;
+  };
+
+  /*
+   * BatchEvaluator evaluates a rule set on a stream of records.
+   * Records binding the same values for all the dependencies of the rule set
+   * (e.g. same route, cabin and date bucket) are grouped: the rule set is evaluated
+   * once per group, and the results are shared by all the records of the group.
+   *
+   * Rules are added first, then records are evaluated through Sessions.
+   * A Session keeps a bounded number of groups, so that memory stays bounded
+   * whatever the size of the stream. Sessions are independent: several threads may
+   * each use their own Session on the same BatchEvaluator, as long as the rules
+   * do not share mutable caches (Factorizer caches, local variables of arrows).
+   */
+  template <class T> class BatchEvaluator: public BatchEvaluatorBase {
+  public:
+    typedef typename TypeTraits<T>::ReturnType ReturnType;
+    typedef typename boost::remove_const<
+      typename boost::remove_reference<ReturnType>::type>::type ValueType;
+
+    struct Outcome {
+      Outcome():
+        _value(), _isNaN(true)
+      {}
+
+      ValueType _value;
+      bool _isNaN;
+    };
+    typedef std::vector<Outcome> Outcomes;
+
+    explicit BatchEvaluator(const Grammar& iGrammar):
+      BatchEvaluatorBase(iGrammar)
+    {}
+
+    void addRule(const std::string& iFormula)
+    {
+      _rules.push_back(&parseRule(iFormula).template get<T>());
+    }
+
+    size_t getRulesCount() const
+    {
+      return _rules.size();
+    }
+
+    // Evaluates all the rules, without any grouping
+    void evaluateAll(IContext& ioContext, Outcomes& oOutcomes) const
+    {
+      oOutcomes.resize(_rules.size());
+      for (size_t i = 0; i < _rules.size(); ++i)
+      {
+        Outcome& anOutcome = oOutcomes[i];
+        ioContext.ignoreNaN();
+        try {
+          anOutcome._value = _rules[i]->evaluate(ioContext);
+          anOutcome._isNaN = ioContext.isNaN();
+        } catch (const ValueException&) {
+          anOutcome._value = ValueType();
+          anOutcome._isNaN = true;
+        }
+      }
+      ioContext.ignoreNaN();
+    }
+
+    class Session: private boost::noncopyable {
+    public:
+      explicit Session(const BatchEvaluator& iEvaluator, size_t iMaxGroups = 65536):
+        _evaluator(iEvaluator), _maxGroups(iMaxGroups ? iMaxGroups : 1),
+        _records(0), _evaluations(0), _flushes(0)
+      {}
+
+      // BinderT is called as iBinder(IContext&, const RecordT&) to set the facts.
+      // The result is valid until the next call.
+      template <class RecordT, class BinderT>
+        const Outcomes& evaluate(const RecordT& iRecord, BinderT iBinder)
+      {
+        _context.clean();
+        iBinder(_context, iRecord);
+        ++_records;
+        if (_evaluator.isDeduplicable() && _evaluator.computeKey(_context, _key))
+        {
+          typename Groups::iterator anIt = _groups.find(_key);
+          if (anIt != _groups.end())
+          {
+            return anIt->second;
+          }
+          if (_groups.size() >= _maxGroups)
+          {
+            _groups.clear();
+            ++_flushes;
+          }
+          Outcomes& anOutcomes = _groups[_key];
+          ++_evaluations;
+          _evaluator.evaluateAll(_context, anOutcomes);
+          return anOutcomes;
+        }
+        ++_evaluations;
+        _evaluator.evaluateAll(_context, _ungrouped);
+        return _ungrouped;
+      }
+
+      // OutputT is called as iOutput(const RecordT&, const Outcomes&) for each record, in order
+      template <class InputIteratorT, class BinderT, class OutputT>
+        void run(InputIteratorT iBegin, InputIteratorT iEnd, BinderT iBinder, OutputT iOutput)
+      {
+        for (InputIteratorT anIt = iBegin; anIt != iEnd; ++anIt)
+        {
+          iOutput(*anIt, evaluate(*anIt, iBinder));
+        }
+      }
+
+      size_t getRecordsCount() const
+      {
+        return _records;
+      }
+
+      // Number of times the rule set was actually evaluated
+      size_t getEvaluationsCount() const
+      {
+        return _evaluations;
+      }
+
+      // Number of times the groups were dropped to stay within bounds
+      size_t getFlushesCount() const
+      {
+        return _flushes;
+      }
+
+    private:
+      typedef boost::unordered_map<ValueKey, Outcomes> Groups;
+
+      const BatchEvaluator& _evaluator;
+      const size_t _maxGroups;
+      IContext _context;
+      ValueKey _key;
+      Groups _groups;
+      Outcomes _ungrouped;
+      size_t _records;
+      size_t _evaluations;
+      size_t _flushes;
+    };
+
+  private:
+    std::vector<const TypedExpression<T>*> _rules;
+  };
+
+}}
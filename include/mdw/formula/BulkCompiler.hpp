@@ -0,0 +1,46 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Compiles a large set of rules on several threads.
+   * The rules are split in contiguous shards, each parsed and factorized by its own thread
+   * (with its own Parser, Factorizer and allocator). The per-thread DAGs are then merged,
+   * node by node, into the shared Factorizer, which applies its own optimizations.
+   * Only the lexing, parsing and per-shard factorization run in parallel: the merge
+   * instantiates each distinct node of each shard again, on the calling thread. It takes
+   * about as long as parsing the rules on one thread (measured on 2,000 to 20,000 rules of
+   * a dozen nodes each, most of them distinct), so compile() is at most about twice as
+   * fast as a single Parser, whatever the number of threads.
+   */
+  class BulkCompiler: private boost::noncopyable {
+  public:
+    // The Factorizer must observe the grammar. 0 thread means one per core.
+    BulkCompiler(const Grammar& iGrammar, Factorizer& ioFactorizer, size_t iThreads = 0);
+
+    // One expression per formula, in the same order, allocated by the Factorizer and added
+    // as rules (see Factorizer::addRule). Throws the first error, with the rule index.
+    void compile(const std::vector<std::string>& iFormulas, std::vector<Expression*>& oRules);
+
+    // One formula per line, empty lines and lines starting with # are skipped
+    void compileFile(const std::string& iFileName, std::vector<Expression*>& oRules);
+
+    size_t getThreadsCount() const
+    {
+      return _threads;
+    }
+
+  private:
+    const Grammar& _grammar;
+    Factorizer& _factorizer;
+    size_t _threads;
+  };
+
+}}
@@ -99,6 +99,25 @@ namespace mdw { namespace formula {
       return _right;
     }
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    // In the order of the parsed expression
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _revert ? static_cast<const Expression&>(_right) : _left;
+        case 1:
+          return _revert ? static_cast<const Expression&>(_left) : _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
     bool evaluate(IContext& ioContext) const;
   };
 
@@ -128,6 +147,24 @@ namespace mdw { namespace formula {
       return _right;
     }
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _left;
+        case 1:
+          return _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
     bool evaluate(IContext& ioContext) const;
   };
 }}
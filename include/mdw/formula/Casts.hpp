@@ -36,6 +36,16 @@ namespace mdw { namespace formula {
     {
       return _symbol + "(" + _expression.toString() + ")";
     }
+
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _expression;
+    }
   };
 
   template <class InputT, class OutputT>
@@ -62,6 +72,16 @@ namespace mdw { namespace formula {
     {
       return _symbol + "(" + _expression.toString() + ")";
     }
+
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _expression;
+    }
   };
 
   // Avoid stupid C++ conversions where 0.99999995 is cast to 0 as an integer
@@ -88,6 +108,16 @@ namespace mdw { namespace formula {
       {
         return "(int)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <class T> class ExpressionCast<T, std::string, void>:
@@ -113,6 +143,16 @@ namespace mdw { namespace formula {
       {
         return "(string)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <> class ExpressionCast<std::string, int, void>:
@@ -137,6 +177,16 @@ namespace mdw { namespace formula {
       {
         return "(int)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <> class ExpressionCast<std::string, double, void>:
@@ -161,6 +211,16 @@ namespace mdw { namespace formula {
       {
         return "(double)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <class From, class To>
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <mdw/formula/ArenaAllocator.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/cache/CacheStatistics.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <utility>
+
+namespace mdw { namespace formula {
+
+  class Parser;
+
+  /*
+   * Gives back the expression already built for the same formula text and grammar,
+   * instead of lexing, parsing and instantiating it again.
+   * The text is normalized first: blanks which cannot change the tokens are ignored.
+   * Cached expressions are shared: they must not be modified, and all the Parsers used with
+   * one cache should have the same observers and allocator lifetime.
+   */
+  class CompileCache: public CacheIntrospection, private boost::noncopyable {
+  public:
+    // Used to parse when no Parser is given. Must outlive the cache.
+    explicit CompileCache(ArenaAllocator& ioAllocator);
+
+    Expression& compile(const Grammar& iGrammar, const std::string& iFormula);
+
+    Expression& compile(Parser& ioParser, const std::string& iFormula);
+
+    size_t size() const
+    {
+      return _expressions.size();
+    }
+
+    // Only forgets the expressions: the memory belongs to the allocators
+    void clear();
+
+    static std::string Normalize(const std::string& iFormula);
+
+    virtual CacheStatistics getCacheStatistics() const;
+    virtual void resetCacheStatistics() const;
+    virtual std::string getCacheDescription() const;
+
+  private:
+    typedef std::pair<size_t, std::string> Key; // Grammar unique id and normalized formula
+    typedef boost::unordered_map<Key, Expression*> Expressions;
+
+    ArenaAllocator& _allocator;
+    Expressions _expressions;
+    size_t _bytes;
+    mutable CacheStatistics _statistics;
+  };
+
+}}
@@ -9,15 +9,18 @@
 namespace mdw { namespace formula {
 
   class ArenaAllocator;
+  class CompileCache;
 
   class Container: private boost::noncopyable
   {
-    ArenaAllocator& _allocator;
+    ArenaAllocator *_allocator; // NULL when the expression belongs to a CompileCache
     const Grammar& _knownTypes;
     Expression& _topExpression;
 
   public:
     Container(const std::string& iFormula, const Grammar& ioGrammar);
+    // Shares the expression with the other users of the cache
+    Container(const std::string& iFormula, const Grammar& ioGrammar, CompileCache& ioCache);
     ~Container();
 
     const Expression& getExpression() const;
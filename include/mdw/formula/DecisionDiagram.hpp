@@ -0,0 +1,141 @@
+#pragma once
+
+#include <boost/functional/hash.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Reduced ordered decision diagram of boolean rules over atoms with three values
+   * (false, true and unknown, combined as in RuleSet). Each rule is built as a function of the
+   * atoms, then merged in a single diagram whose leaves are the sets of rules true.
+   * Finding the rules true walks one path from the root to a leaf, testing each atom
+   * at most once and only when the result depends on it, in the order given at
+   * construction.
+   * The diagram may grow exponentially with the number of atoms: once its nodes and
+   * leaf entries exceed the maximum size, isFull() is set and it must be dropped.
+   */
+  class DecisionDiagram: private boost::noncopyable {
+  public:
+    enum Value {
+      kFalse,
+      kTrue,
+      kUnknown
+    };
+
+    // Functions of the atoms, the three values being the constant ones
+    typedef uint32_t Function;
+
+    // Atoms are tested in the order of iOrder, which must hold each of them once
+    DecisionDiagram(const std::vector<uint32_t>& iOrder, size_t iMaxSize);
+
+    Function atom(uint32_t iAtom);
+    Function negate(Function iFunction);
+    // Unknown when either operand is
+    Function conjunction(Function iLeft, Function iRight);
+    // The right operand when the left one is not true
+    Function disjunction(Function iLeft, Function iRight);
+
+    // Adds the rule to the leaves where the function is true.
+    // Rules must be added in increasing order.
+    void addRule(Function iFunction, uint32_t iRule);
+
+    // Forgets the functions and what only serves to add rules, once they are all added
+    void shrink();
+
+    bool isFull() const
+    {
+      return _full;
+    }
+
+    // Of the diagram of the rules, leaves included
+    size_t getNodesCount() const
+    {
+      return _nodes.size();
+    }
+
+    size_t getLeavesCount() const
+    {
+      return _leaves.size();
+    }
+
+    // Rules true, in increasing order. ioAtoms(atom) gives the Value of an atom.
+    template <class Atoms>
+    const std::vector<uint32_t>& find(Atoms& ioAtoms) const
+    {
+      uint32_t aNode = _root;
+      while (_nodes[aNode]._atom != kLeaf)
+      {
+        const Node& aTest = _nodes[aNode];
+        aNode = aTest._children[ioAtoms(aTest._atom)];
+      }
+      return _leaves[_nodes[aNode]._children[0]];
+    }
+
+  private:
+    static const uint32_t kLeaf = uint32_t(-1);
+
+    // Children by value of the atom. Leaves have the value of a function, or their
+    // index in _leaves, as first child.
+    struct Node {
+      bool operator==(const Node& iOther) const
+      {
+        return (_atom == iOther._atom) && (_children[0] == iOther._children[0]) &&
+          (_children[1] == iOther._children[1]) && (_children[2] == iOther._children[2]);
+      }
+
+      friend size_t hash_value(const Node& iNode)
+      {
+        size_t aHash = iNode._atom;
+        boost::hash_combine(aHash, iNode._children[0]);
+        boost::hash_combine(aHash, iNode._children[1]);
+        boost::hash_combine(aHash, iNode._children[2]);
+        return aHash;
+      }
+
+      uint32_t _atom;
+      uint32_t _children[3];
+    };
+
+    typedef std::vector<Node> Nodes;
+    typedef boost::unordered_map<Node, uint32_t> UniqueNodes;
+    typedef std::pair<uint32_t, uint32_t> Operands;
+    typedef boost::unordered_map<Operands, uint32_t> Results;
+    typedef boost::unordered_map<std::vector<uint32_t>, uint32_t> LeafIds;
+
+    uint32_t getLevel(const Nodes& iNodes, uint32_t iNode) const;
+    // The child of the node for the value of the atom, the node itself if it does
+    // not test this atom
+    static uint32_t GetChild(const Nodes& iNodes, uint32_t iNode, uint32_t iAtom,
+                             size_t iValue);
+    uint32_t makeNode(Nodes& ioNodes, UniqueNodes& ioUnique, uint32_t iAtom,
+                      const uint32_t *iChildren);
+    Function combine(Function iLeft, Function iRight, bool iConjunction,
+                     Results& ioResults);
+    uint32_t merge(uint32_t iNode, Function iFunction, uint32_t iRule);
+    uint32_t makeLeaf(const std::vector<uint32_t>& iRules);
+    void grow(size_t iSize);
+
+    std::vector<uint32_t> _levels; // By atom
+    size_t _maxSize;
+    size_t _size;
+    bool _full;
+    Nodes _functions;
+    UniqueNodes _uniqueFunctions;
+    Results _negations; // The second operand is unused
+    Results _conjunctions;
+    Results _disjunctions;
+    Nodes _nodes;
+    UniqueNodes _uniqueNodes;
+    Results _merged; // Of the current rule
+    std::vector<std::vector<uint32_t> > _leaves;
+    LeafIds _leafIds;
+    uint32_t _root;
+  };
+
+}}
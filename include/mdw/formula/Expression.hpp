@@ -36,6 +36,12 @@ namespace mdw { namespace formula {
 
     template <class T> TypedExpression<T>& get()
     {
+      // TypedExpression<T> is the only heir of BaseTypedExpression<T>
+      if (getStaticTypeId() == StaticTypeId<T>::Get())
+      {
+        return static_cast<TypedExpression<T>& >(*this);
+      }
+      // Heirs of another TypedExpression, like TypedExpression<char>
       try {
         return dynamic_cast<TypedExpression<T>& >(*this);
       } catch(...) {
@@ -47,6 +53,12 @@ namespace mdw { namespace formula {
 
     template <class T> const TypedExpression<T>& get() const
     {
+      // TypedExpression<T> is the only heir of BaseTypedExpression<T>
+      if (getStaticTypeId() == StaticTypeId<T>::Get())
+      {
+        return static_cast<const TypedExpression<T>& >(*this);
+      }
+      // Heirs of another TypedExpression, like TypedExpression<char>
       try {
         return dynamic_cast<const TypedExpression<T>& >(*this);
       } catch(...) {
@@ -72,14 +84,26 @@ namespace mdw { namespace formula {
       return _realType;
     }
 
+    // StaticTypeId of the C++ type returned by the expression
+    virtual size_t getStaticTypeId() const = 0;
+
     virtual std::string toString() const = 0;
     virtual std::string getTypeAsString() const = 0;
     virtual bool byValue() const = 0;
 
     // Unitary complexity (does not include subexpressions)
     // 1 corresponds to a basic operation (getter, integral operation...)
+    // Only used as a fallback when no calibrated CostModel is available.
     virtual size_t complexity() const;
 
+    // Direct operands, in the order given to the instantiator (none for constants, facts
+    // and sub-rules). getChild() throws when the index is out of range.
+    virtual size_t getChildrenCount() const;
+    virtual const Expression& getChild(size_t iIndex) const;
+
+    // Evaluates the expression and drops the result (used to measure costs)
+    virtual void evaluateUntyped(IContext& ioContext) const = 0;
+
     virtual Expression& createChoice(ArenaAllocator& ioAllocator,
                                      const Grammar& iGrammar,
                                      const TypedExpression<bool>& iCondition,
@@ -108,12 +132,21 @@ namespace mdw { namespace formula {
       return TypeTraits<T>::kTypeAsString;
     }
 
+    size_t getStaticTypeId() const {
+      return StaticTypeId<T>::Get();
+    }
+
     bool byValue() const {
       return __TypeTraits<typename TypeTraits<T>::ReturnType>::_IsBase;
     }
 
     virtual ReturnType evaluate(IContext& ioContext) const = 0;
 
+    void evaluateUntyped(IContext& ioContext) const
+    {
+      evaluate(ioContext);
+    }
+
     Expression& createChoice(ArenaAllocator& ioAllocator,
                              const Grammar& iGrammar,
                              const TypedExpression<bool>& iCondition,
@@ -446,6 +479,26 @@ namespace mdw { namespace formula {
         + _first.toString() + ") : (" + _second.toString() + ")";
     }
 
+    size_t getChildrenCount() const
+    {
+      return 3;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _condition;
+        case 1:
+          return _first;
+        case 2:
+          return _second;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
   private:
     const TypedExpression<bool>& _condition;
     const TypedExpression<OutputType>& _first;
@@ -35,6 +35,16 @@ namespace mdw { namespace formula {
         return _object.toString() + "." + _name;
       }
 
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _object;
+      }
+
     private:
       const TypedExpression<RealFactT>& _object;
       FunctorT _functor;
@@ -131,6 +141,16 @@ namespace mdw { namespace formula {
         return _object.toString() + "." + _name;
       }
 
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _object;
+      }
+
     private:
       const TypedExpression<RealFactT>& _object;
       FunctorT _functor;
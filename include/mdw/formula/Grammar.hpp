@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <string>
 #include <map>
 #include <vector>
@@ -6,6 +7,8 @@
 #include <mdw/formula/ArenaAllocator.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <stdint.h>
 
 namespace mdw { namespace formula {
 
@@ -108,14 +111,69 @@ namespace mdw { namespace formula {
       ArrowInstantiator *_arrowInstantiator;
     };
 
+    typedef std::map<OperatorId, Operator> Operators;
+    typedef std::map<std::string, Expression*> SubRules;
+
+    // What an operator is looked up for
+    enum Usage {
+      kAsUnary,
+      kAsBinary,
+      kAsArrow,
+      kAsFact,
+      kUsages
+    };
+
+    // An operator and the grammar of the chain it was found in
+    struct Resolution {
+      Resolution():
+        _grammar(NULL), _operator(NULL)
+      {}
+
+      const Grammar *_grammar;
+      const Operators::value_type *_operator;
+    };
+
+    // Entry of the dispatch table of a frozen grammar, for all the usages
+    struct FrozenOperator {
+      ExpressionType _arg1Type;
+      ExpressionType _arg2Type;
+      uint32_t _symbol;
+      Resolution _resolutions[kUsages];
+    };
+
     std::map<std::string, ExpressionType> _types;
-    std::map<OperatorId, Operator> _operators;
+    std::vector<ExpressionType> _staticTypes; // Indexed by StaticTypeId, filled by registerType
+    Operators _operators;
     std::vector<Factorizer*> _factorizers;
+    SubRules _subRules;
     ExpressionType _maxId;
     const Grammar *_chainedGrammar;
+    size_t _uniqueId;
+
+    // Only set by freeze()
+    bool _frozen;
+    boost::unordered_map<std::string, uint32_t> _symbols;
+    std::vector<FrozenOperator> _frozenOperators;
+    std::vector<int32_t> _dispatch; // Perfect hash of the _frozenOperators, -1 if empty
+    uint64_t _dispatchSeed;
+    SubRules _frozenSubRules;
+
+    static std::atomic<size_t> LatestUniqueId;
 
     ExpressionType findType(const char * iTypeName) const;
 
+    static bool IsUsableAs(const Operator& iOperator, Usage iUsage);
+    static size_t Hash(ExpressionType iLeftType, ExpressionType iRightType, uint32_t iSymbol,
+                       uint64_t iSeed);
+
+    // Looks in this grammar, then in the chained ones
+    Resolution findOperator(ExpressionType iLeftType, ExpressionType iRightType,
+                            const std::string& iSymbol, Usage iUsage) const;
+    void checkNotFrozen() const;
+
+    Expression& parseSubRule(ArenaAllocator& ioAllocator, const std::string& iFormula) const;
+    void addSubRule(const std::string& iName, Expression& ioSubRule);
+
   public:
     Grammar();
 
@@ -125,6 +183,23 @@ namespace mdw { namespace formula {
 
     void addObserver(Factorizer& ioFactorizer);
 
+    /// Flattens the chained grammars and builds a perfect hash of all the operators
+    /// (interning their symbols), so that instantiating them does not walk maps or chains.
+    /// Nothing can be registered afterwards: the grammar is read-only, and can be used by
+    /// Parsers of different threads. The chained grammars must not change anymore either.
+    void freeze();
+
+    bool isFrozen() const
+    {
+      return _frozen;
+    }
+
+    // Never reused by another Grammar, even after this one is destroyed
+    size_t getUniqueId() const
+    {
+      return _uniqueId;
+    }
+
     template <class T> ExpressionType registerType();
 
     template <class T> ExpressionType findType() const;
@@ -162,6 +237,14 @@ namespace mdw { namespace formula {
 
     bool hasFact(const std::string& iName) const;
 
+    /// Sub-rules are referenced as @name and evaluated at most once per IContext.
+    /// The formula may use previously registered sub-rules.
+    template <class T> Expression& registerSubRule(ArenaAllocator& ioAllocator,
+                                                  const std::string& iName,
+                                                  const std::string& iFormula);
+
+    bool hasSubRule(const std::string& iName) const;
+
     void registerAttributeResolver(ExpressionType iInputType,
                                    ExpressionType iOutputType,
                                    const std::string& iSymbol,
@@ -184,6 +267,8 @@ namespace mdw { namespace formula {
     Expression& instantiateFactResolver(ArenaAllocator& ioAllocator,
                                         const std::string& iObject) const;
 
+    Expression& instantiateSubRule(const std::string& iName) const;
+
     Expression& instantiateAttributeResolver(ArenaAllocator& ioAllocator,
                                              const Expression& iFact,
                                              const std::string& iAttribute) const;
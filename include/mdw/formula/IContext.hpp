@@ -3,7 +3,9 @@
 #include <mdw/formula/ArenaAllocator.hpp>
 #include <mdw/formula/Any.hpp>
 #include <boost/noncopyable.hpp>
+#include <atomic>
 #include <map>
+#include <vector>
 
 namespace mdw { namespace formula {
 
@@ -11,6 +13,27 @@ namespace mdw { namespace formula {
 
   class IContext: private boost::noncopyable
   {
+  public:
+    // Value memoized for the lifetime of a context (see SubRule).
+    // A slot is only valid if it was filled with the current unique id.
+    struct Slot {
+      Slot():
+        _contextId(-1), _isNaN(false)
+      {
+        _value._int = 0;
+      }
+
+      int _contextId;
+      bool _isNaN;
+      union {
+        bool _bool;
+        int64_t _int;
+        double _double;
+        const void *_pointer;
+      } _value;
+    };
+
+  private:
     ArenaAllocator& _allocator;
     ResultCache *_cache;
     int _uniqueId;
@@ -19,10 +42,11 @@ namespace mdw { namespace formula {
 
     // Cannot use boost::any because it does copies
     std::map<std::string, AnyFact*> _knownFacts;
+    std::vector<Slot> _slots;
 
-    // Yeah yeah, we'll have issues if we go multithread...
-    // Just do an std::atomic increment that day because we'll be in C++11 by that time!
-    static int LatestUniqueId;
+    // Contexts may be created by several threads (see BulkCompiler)
+    static std::atomic<int> LatestUniqueId;
+    static std::atomic<size_t> LatestSlot;
 
   public:
     explicit IContext(ArenaAllocator& ioAllocator);
@@ -56,6 +80,18 @@ namespace mdw { namespace formula {
       return _uniqueId;
     }
 
+    // Reserves a slot index, valid for all contexts
+    static size_t AllocateSlot();
+
+    Slot& getSlot(size_t iIndex)
+    {
+      if (iIndex >= _slots.size())
+      {
+        _slots.resize(iIndex + 1);
+      }
+      return _slots[iIndex];
+    }
+
     template <class T> T& get()
     {
       T *aRealContext = dynamic_cast<T*>(this);
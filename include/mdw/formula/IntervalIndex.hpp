@@ -0,0 +1,80 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Static centered interval tree: finds the intervals containing a value in
+   * O(log n + k). Intervals are all added, then build() is called before find().
+   */
+  class IntervalIndex {
+  public:
+    IntervalIndex():
+      _root(kNone)
+    {}
+
+    struct Interval {
+      Interval():
+        _low(-std::numeric_limits<double>::infinity()),
+        _high(std::numeric_limits<double>::infinity()),
+        _lowClosed(false), _highClosed(false), _id(0)
+      {}
+
+      bool contains(double iValue) const
+      {
+        return ((_low < iValue) || (_lowClosed && (_low == iValue))) &&
+          ((iValue < _high) || (_highClosed && (_high == iValue)));
+      }
+
+      // Narrows the interval to its intersection with the given bound
+      void restrictLow(double iLow, bool iClosed);
+      void restrictHigh(double iHigh, bool iClosed);
+
+      double _low;
+      double _high;
+      bool _lowClosed;
+      bool _highClosed;
+      uint32_t _id;
+    };
+
+    void add(const Interval& iInterval)
+    {
+      _intervals.push_back(iInterval);
+    }
+
+    void build();
+
+    // Appends the ids of the intervals containing the value, in no particular order
+    void find(double iValue, std::vector<uint32_t>& oIds) const;
+
+    size_t size() const
+    {
+      return _intervals.size();
+    }
+
+  private:
+    static const size_t kNone = size_t(-1);
+
+    // The intervals around the center are in [_begin, _end[ of _byLow and _byHigh
+    struct Node {
+      double _center;
+      size_t _begin;
+      size_t _end;
+      size_t _left;
+      size_t _right;
+    };
+
+    size_t build(std::vector<uint32_t>& ioIntervals);
+
+    std::vector<Interval> _intervals;
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _byLow; // Increasing lower bounds in each node
+    std::vector<uint32_t> _byHigh; // Decreasing upper bounds in each node
+    size_t _root;
+  };
+
+}}
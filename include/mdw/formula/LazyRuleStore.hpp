@@ -0,0 +1,92 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/RuleStore.hpp>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mdw { namespace formula {
+
+  class Observer;
+
+  /*
+   * Keeps the formulas as text, and compiles each of them in a RuleStore the first time
+   * it is needed, so that rules never evaluated are never parsed.
+   * A background thread may compile the rules ahead of time, by decreasing priority.
+   * get() may be called from several threads; the rules must all be added before.
+   */
+  class LazyRuleStore: private boost::noncopyable {
+  public:
+    typedef RuleStore::Rule Rule;
+
+    explicit LazyRuleStore(const Grammar& iGrammar, size_t iBlockSize = RuleStore::kBlockSize);
+    // Stops the background compilation
+    ~LazyRuleStore();
+
+    // The observer is called under _storeMutex, while compiling. It must be added before
+    // any get() or startBackground().
+    void addObserver(Observer& ioObserver)
+    {
+      _store.addObserver(ioObserver);
+    }
+
+    Rule add(const std::string& iFormula, int iPriority = 0);
+
+    // Compiles the rule if needed. A formula which does not compile throws at each call.
+    const Expression& get(Rule iRule);
+
+    bool isCompiled(Rule iRule) const
+    {
+      return _rules[iRule]._expression.load(std::memory_order_acquire) != NULL;
+    }
+
+    size_t size() const
+    {
+      return _rules.size();
+    }
+
+    size_t getCompiledCount() const
+    {
+      return _compiled.load();
+    }
+
+    // Compiles the rules not compiled yet in a thread, highest priorities first
+    void startBackground();
+    // Waits for the rule being compiled, if any
+    void stopBackground();
+
+    bool isBackgroundDone() const
+    {
+      return _backgroundDone.load();
+    }
+
+  private:
+    struct Entry {
+      Entry(const std::string& iFormula, int iPriority):
+        _formula(iFormula), _priority(iPriority), _expression(NULL)
+      {}
+
+      std::string _formula;
+      int _priority;
+      std::once_flag _once;
+      std::atomic<const Expression*> _expression;
+    };
+
+    void compile(Entry& ioEntry);
+    void runBackground();
+
+    RuleStore _store;
+    std::mutex _storeMutex; // Neither the arena nor the parser are thread-safe
+    std::deque<Entry> _rules; // Entries are never moved
+    std::atomic<size_t> _compiled;
+    std::thread _background;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _backgroundDone;
+  };
+
+}}
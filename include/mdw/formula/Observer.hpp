@@ -22,6 +22,9 @@ namespace mdw { namespace formula {
 
     virtual Expression& newConstant(Expression& ioResult) =0;
     virtual Expression& newFact(Expression& ioResult, const std::string& iName) =0;
+    // Not pure, so that the observers written before sub-rules still build:
+    // forwards to the next observer, if any
+    virtual Expression& newSubRule(Expression& ioResult, const std::string& iName);
     virtual Expression& newUnary(Expression& ioResult,
                                  Expression& ioRight,
                                  const std::string& iSymbol) =0;
@@ -44,6 +44,16 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _right;
+    }
+
   private:
     const TypedExpression<InputT>& _right;
     const OpT& _operator;
@@ -81,6 +91,16 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _right;
+    }
+
   private:
     const TypedExpression<InputT>& _right;
     OperatorT _operator;
@@ -121,6 +141,24 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _left;
+        case 1:
+          return _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
   private:
     const TypedExpression<InputT>& _left;
     const TypedExpression<InputT>& _right;
@@ -161,6 +199,24 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _left;
+        case 1:
+          return _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
     const TypedExpression<InputT>& getLeft() const
     {
       return _left;
@@ -212,6 +268,24 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _left;
+        case 1:
+          return _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
   private:
     const TypedExpression<InputT>& _left;
     const TypedExpression<Input2T>& _right;
@@ -253,6 +327,24 @@ namespace mdw { namespace formula {
       return _symbol;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _left;
+        case 1:
+          return _right;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
   private:
     const TypedExpression<InputT>& _left;
     const TypedExpression<Input2T>& _right;
@@ -88,8 +88,17 @@ namespace mdw { namespace formula {
 
     Expression& createAttribute(Expression& iInput, const char *iName);
 
+    Expression& createSubRule(const char *iName);
+
     const std::string& getFormula() const;
 
+    // State of the flex scanner during parse(): each Parser has its own,
+    // so that different Parsers can be used at the same time by different threads.
+    void *getScanner() const
+    {
+      return _scanner;
+    }
+
     // This needs to manage local variables in the Parser itself,
     // and createFact should look up such variables to instantiate default fact getters!
     Expression& createArrowOperator(Expression& iLeft, Expression& iRight, const char *iName);
@@ -107,11 +116,21 @@ namespace mdw { namespace formula {
         Observer(ioAllocator)
       {}
 
+      virtual Expression& newConstant(Expression& ioResult)
+      {
+        return ioResult;
+      }
+
       virtual Expression& newFact(Expression& ioResult, const std::string& iName)
       {
         return ioResult;
       }
 
+      virtual Expression& newSubRule(Expression& ioResult, const std::string& iName)
+      {
+        return ioResult;
+      }
+
       virtual Expression& newUnary(Expression& ioResult,
                                    Expression& ioRight,
                                    const std::string& iSymbol)
@@ -153,6 +172,8 @@ namespace mdw { namespace formula {
     AdditionalFacts *_additionalFacts;
     Observer *_observer;
     bool _ownedFacts;
+    void *_scanner;
+    std::vector<std::string> _locals; // Declared and not popped yet, the innermost last
   };
 
 }}
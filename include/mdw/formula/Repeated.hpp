@@ -202,6 +202,24 @@ namespace mdw { namespace formula {
         return "(" + _object.toString() + ") in (" + _container.toString() + ")";
       }
 
+      size_t getChildrenCount() const
+      {
+        return 2;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        switch (iIndex)
+        {
+          case 0:
+            return _object;
+          case 1:
+            return _container;
+          default:
+            return Expression::getChild(iIndex);
+        }
+      }
+
       bool evaluate(IContext& ioContext) const
       {
         typename TypedExpression<U>::ReturnType aCont = _container.evaluate(ioContext);
@@ -230,6 +248,24 @@ namespace mdw { namespace formula {
           + _condition.toString() + "))";
       }
 
+      size_t getChildrenCount() const
+      {
+        return 2;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        switch (iIndex)
+        {
+          case 0:
+            return _container;
+          case 1:
+            return _condition;
+          default:
+            return Expression::getChild(iIndex);
+        }
+      }
+
       size_t complexity() const
       {
         return 20;
@@ -262,6 +298,16 @@ namespace mdw { namespace formula {
         return "(" + _container.toString() + ").count";
       }
 
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _container;
+      }
+
       size_t complexity() const
       {
         return Sizer<U>::_Complexity;
@@ -287,6 +333,16 @@ namespace mdw { namespace formula {
         return "(" + _container.toString() + ").empty";
       }
 
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _container;
+      }
+
       TypedExpression<bool>::ReturnType evaluate(IContext& ioContext) const
       {
         Empty<U> aEmpty;
@@ -461,6 +517,24 @@ namespace mdw { namespace formula {
       return kSquares;
     } 
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _container;
+        case 1:
+          return _index;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
   private:
     const TypedExpression<ContT>& _container;
     const TypedExpression<IdxT>& _index;
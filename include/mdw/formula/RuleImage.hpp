@@ -0,0 +1,45 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Binary image of a factorized rule set, to be mapped read-only by many processes
+   * instead of parsing the rules again in each of them.
+   * The image only holds offsets and indexes: the DAG nodes in topological order,
+   * the constants values, and the fact, sub-rule and operator names which select the
+   * instantiators registered in the Grammar. It is written in native byte order.
+   */
+  class RuleImage: private boost::noncopyable {
+  public:
+    // The rules must have been parsed with the Factorizer observing the Parser
+    static void Save(const Factorizer& iFactorizer, const std::vector<Expression*>& iRules,
+                     std::ostream& oStream);
+    static void Save(const Factorizer& iFactorizer, const std::vector<Expression*>& iRules,
+                     const std::string& iFileName);
+
+    // Maps the file: nothing is copied until load()
+    explicit RuleImage(const std::string& iFileName);
+    ~RuleImage();
+
+    size_t getNodesCount() const;
+    size_t getRulesCount() const;
+
+    // Replays the nodes through the Parser (and so its observers), as DagReplayer does.
+    // One expression per saved rule, in the same order. They are not added to any
+    // Factorizer (see Factorizer::addRule).
+    void load(Parser& ioParser, std::vector<Expression*>& oRules) const;
+
+  private:
+    const char *_data;
+    size_t _size;
+  };
+
+}}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <mdw/formula/DecisionDiagram.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/IntervalIndex.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/RuleStore.hpp>
+#include <mdw/formula/ValueKey.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Finds which of many boolean rules match a context.
+   * The rules are factorized together and split into distinct atoms (the boolean
+   * nodes which are not &&, || or !) and terms (the operands of their top-level &&).
+   * A match evaluates each atom once, computes each term from the atoms, and removes
+   * the rules of the terms not true from a bitmap of all the rules, one word for 64 rules.
+   * An atom throwing a ValueException or flagging NaN is unknown. As with the standard
+   * operators, ! and && are unknown when one of their operands is, and || is its right
+   * operand when the left one is not true: a rule only matches when true.
+   *
+   * Terms such as $x.carrier == 'XX' are guards: a rule with guards is indexed by one of
+   * them (the one whose path is shared by most rules), in a hash map from the value of
+   * the path to the rules. A match evaluates each indexed path once and only keeps the
+   * rules found in the maps, and the rules without guards. Atoms are evaluated lazily,
+   * so that the terms of the rules left out are never evaluated.
+   * Rules without guards are indexed the same way by their ranges, such as
+   * $pax.age >= 2 && $pax.age < 12, in an IntervalIndex per numeric path.
+   *
+   * With a diagram limit, compile() rather builds a DecisionDiagram of all the rules,
+   * testing first the cheap atoms used by many rules: a match then walks a single path.
+   * When the diagram would exceed the limit, the bitmaps and indexes are used.
+   *
+   * As a decision list, matchFirst() only looks for the rule with the highest priority:
+   * the candidates left by the indexes are kept in a bitmap ordered by priority, so that
+   * the bands of 64 rules without candidates are skipped at once, and the candidates are
+   * evaluated in order until one is true, sharing the atoms and terms already evaluated.
+   */
+  class RuleSet: private boost::noncopyable {
+  public:
+    typedef RuleStore::Rule Rule;
+
+    explicit RuleSet(const Grammar& iGrammar);
+    ~RuleSet();
+
+    // Rules must be boolean. compile() must be called again after adding rules.
+    // The priority only matters to matchFirst().
+    Rule add(const std::string& iFormula, int iPriority = 0);
+
+    // Builds the bitmaps of the rules of each term, or the diagram
+    void compile();
+
+    // Maximum number of nodes and leaf entries of the diagram.
+    // 0, the default, never builds one.
+    void setDiagramLimit(size_t iMaxSize)
+    {
+      _diagramLimit = iMaxSize;
+    }
+
+    bool hasDiagram() const
+    {
+      return _diagram != NULL;
+    }
+
+    size_t getDiagramNodesCount() const
+    {
+      return _diagram ? _diagram->getNodesCount() : 0;
+    }
+
+    // Writes the matching rules, in increasing order, up to iCapacity of them,
+    // and returns their total number. Not thread-safe: the factorized nodes hold caches.
+    size_t match(IContext& ioContext, Rule *oMatches, size_t iCapacity) const;
+
+    // The matching rule with the highest priority, the first added one among equal
+    // priorities. Returns false if no rule matches.
+    bool matchFirst(IContext& ioContext, Rule& oRule) const;
+
+    size_t size() const
+    {
+      return _rules.size();
+    }
+
+    size_t getAtomsCount() const
+    {
+      return _atoms.size();
+    }
+
+    size_t getTermsCount() const
+    {
+      return _terms.size();
+    }
+
+    // Distinct paths indexed by compile(), by equality and by range
+    size_t getIndexesCount() const
+    {
+      return _indexes.size();
+    }
+
+    size_t getRangeIndexesCount() const
+    {
+      return _rangeIndexes.size();
+    }
+
+    size_t getIndexedRulesCount() const
+    {
+      return _indexedRules;
+    }
+
+  private:
+    enum Operation {
+      kAtom,
+      kNot,
+      kAnd,
+      kOr
+    };
+
+    struct Instruction {
+      Operation _operation;
+      uint32_t _atom; // For kAtom
+    };
+
+    // A 64 rules word of the bitmap of the rules, where the term is used
+    struct Block {
+      uint32_t _word;
+      uint64_t _rules;
+    };
+
+    struct Term {
+      size_t _programBegin;
+      size_t _programEnd;
+      // Node of the path compared to _guardValue, kNoGuard if not a guard
+      size_t _guardPath;
+      ValueKey _guardValue;
+      // Node of the numeric path compared to _rangeBound, kNoGuard if not a range
+      size_t _rangePath;
+      double _rangeBound;
+      bool _rangeLow; // Lower or upper bound
+      bool _rangeClosed;
+      // Dense terms have the whole bitmap in _denseRules, the others their blocks
+      bool _dense;
+      size_t _rulesBegin;
+      size_t _rulesEnd;
+    };
+
+    // Rules by value of their guard path
+    struct Index {
+      const Expression *_path;
+      boost::unordered_map<ValueKey, std::vector<Rule> > _candidates;
+    };
+
+    struct RangeIndex {
+      const Expression *_path;
+      IntervalIndex _intervals; // Identified by their rule
+    };
+
+    typedef boost::unordered_map<size_t, uint32_t> Indexes; // By node id
+    typedef boost::unordered_map<size_t, size_t> PathCounts; // Rules by path node
+
+    static const size_t kNoGuard = size_t(-1);
+
+    // Evaluates the atoms tested by the diagram
+    class AtomValues;
+
+    void addConjuncts(size_t iNode, std::vector<uint32_t>& oTerms);
+    uint32_t getTerm(size_t iNode);
+    void emit(size_t iNode);
+    void setGuard(Term& ioTerm, size_t iNode);
+    void setRange(Term& ioTerm, size_t iNode);
+    void countPaths(size_t Term::*iPath, PathCounts& oCounts) const;
+    // The path of the terms used by most rules, kNoGuard if none
+    size_t choosePath(const std::vector<uint32_t>& iTerms, size_t Term::*iPath,
+                      const PathCounts& iCounts) const;
+    bool isLogical(const Factorizer::NodeKey& iKey, size_t iNode, const char *iKind) const;
+    void compileDiagram();
+    // Of the whole sub-tree, shared nodes being counted as many times as used
+    double getCost(size_t iNode) const;
+    // Sets the bits of the rules (or of their ranks) found by the indexes
+    void findCandidates(IContext& ioContext, bool iByRank,
+                        std::vector<uint64_t>& ioRules) const;
+    bool isLive(const Term& iTerm, const std::vector<uint64_t>& iMatches) const;
+    unsigned char evaluateAtom(uint32_t iAtom, IContext& ioContext) const;
+    unsigned char evaluate(const Term& iTerm, IContext& ioContext,
+                           std::vector<unsigned char>& ioAtoms,
+                           std::vector<unsigned char>& ioStack) const;
+
+    const Grammar& _grammar;
+    Factorizer _dag;
+    Parser _parser;
+    std::vector<std::vector<uint32_t> > _rules; // Terms of each rule
+    std::vector<int> _priorities; // By rule
+    std::vector<Rule> _byPriority; // Rules by rank, the highest priority first
+    std::vector<uint32_t> _ranks; // By rule
+    std::vector<const TypedExpression<bool>*> _atoms;
+    Indexes _atomIndexes;
+    std::vector<Term> _terms;
+    Indexes _termIndexes;
+    std::vector<Instruction> _program; // Postfix code of all the terms
+    std::vector<uint64_t> _denseRules;
+    std::vector<Block> _sparseRules;
+    std::vector<Index> _indexes;
+    std::vector<RangeIndex> _rangeIndexes;
+    std::vector<uint64_t> _unindexed; // Bitmap of the rules without guards
+    std::vector<uint64_t> _unindexedRanks; // Same, by rank
+    size_t _indexedRules;
+    size_t _diagramLimit;
+    DecisionDiagram *_diagram; // NULL unless built by compile()
+    bool _compiled;
+  };
+
+}}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <mdw/formula/RuleStore.hpp>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Publishes compiled rule sets to evaluating threads without blocking them.
+   * A reader pins the current version with a hazard slot (no lock, no shared counter
+   * to bounce between cores), a writer swaps the version atomically and deletes the
+   * former ones (with their arenas) once no reader has them pinned anymore.
+   * Reclamation happens in the writer thread, never in the readers.
+   */
+  class RuleSetHolder: private boost::noncopyable {
+    struct Version {
+      Version(RuleStore *ioRules, uint64_t iNumber):
+        _rules(ioRules), _number(iNumber)
+      {}
+
+      RuleStore *_rules; // Owned
+      uint64_t _number;
+    };
+
+    // On a cache line of its own, so that readers do not share one
+    struct alignas(64) Slot {
+      Slot():
+        _taken(false), _hazard(NULL)
+      {}
+
+      std::atomic<bool> _taken;
+      std::atomic<Version*> _hazard;
+    };
+
+    // Slots are never freed before the holder: readers scan them without a lock.
+    // The allocator of std::vector ignores the alignment of Slot before C++17.
+    struct Slots: private boost::noncopyable {
+      Slots(size_t iCount, Slots *iNext);
+      ~Slots();
+
+      char *_buffer;
+      Slot *_slots; // In _buffer, aligned
+      size_t _count;
+      Slots *_next;
+    };
+
+  public:
+    static const size_t kMaxReaders = 128;
+
+    // iMaxReaders slots are allocated upfront. When more readers pin rules at the same
+    // time, as many slots are added, and kept until the destruction of the holder.
+    explicit RuleSetHolder(size_t iMaxReaders = kMaxReaders);
+    // No reader must be left
+    ~RuleSetHolder();
+
+    // Takes the ownership of the rules, returns their version number (from 1).
+    // Several writers may publish at the same time.
+    uint64_t publish(RuleStore *ioRules);
+
+    // Deletes the former versions not pinned anymore, returns their number
+    size_t reclaim();
+
+    size_t getRetiredCount() const;
+
+    uint64_t getVersion() const
+    {
+      Version *aVersion = _current.load();
+      return aVersion ? aVersion->_number : 0;
+    }
+
+    // Keeps the version current at construction alive, as long as it lives
+    class Pin: private boost::noncopyable {
+    public:
+      // Throws if nothing was published yet
+      explicit Pin(RuleSetHolder& ioHolder);
+      ~Pin();
+
+      const RuleStore& getRules() const
+      {
+        return *_version->_rules;
+      }
+
+      uint64_t getVersion() const
+      {
+        return _version->_number;
+      }
+
+    private:
+      Slot& _slot;
+      Version *_version;
+    };
+
+  private:
+    Slot& acquireSlot();
+    bool isPinned(const Version *iVersion) const;
+
+    std::atomic<Slots*> _slots; // The last added first
+    std::atomic<Version*> _current;
+    mutable std::mutex _writerMutex; // Guards _retired and _lastNumber
+    std::vector<Version*> _retired;
+    uint64_t _lastNumber;
+  };
+
+}}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <mdw/formula/ArenaAllocator.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  class Observer;
+
+  /*
+   * Compiles many formulas into one arena, instead of one per Container:
+   * less slack, and rules parsed together are stored together.
+   * Rules are only released with the store.
+   */
+  class RuleStore: private boost::noncopyable {
+  public:
+    typedef uint32_t Rule; // Index of the rule in the store
+
+    static const size_t kBlockSize = 64 * 1024;
+
+    explicit RuleStore(const Grammar& iGrammar, size_t iBlockSize = kBlockSize);
+
+    // E.g. a Factorizer allocating in getAllocator(), to share nodes between rules
+    void addObserver(Observer& ioObserver)
+    {
+      _parser.addObserver(ioObserver);
+    }
+
+    // The memory of a formula which does not compile is lost until the store is destroyed
+    Rule add(const std::string& iFormula);
+
+    const Expression& get(Rule iRule) const
+    {
+      return *_rules[iRule]._expression;
+    }
+
+    size_t size() const
+    {
+      return _rules.size();
+    }
+
+    // Arena memory requested while compiling the rule
+    size_t getBytes(Rule iRule) const
+    {
+      return _rules[iRule]._bytes;
+    }
+
+    // Arena memory requested by all the rules
+    size_t getUsedBytes() const
+    {
+      return _allocator.getUsedBytes();
+    }
+
+    // Arena memory including the slack at the end of the blocks
+    size_t getAllocatedBytes() const
+    {
+      return _allocator.getAllocatedBytes();
+    }
+
+    ArenaAllocator& getAllocator()
+    {
+      return _allocator;
+    }
+
+    const Grammar& getGrammar() const
+    {
+      return _grammar;
+    }
+
+  private:
+    struct Entry {
+      const Expression *_expression;
+      size_t _bytes;
+    };
+
+    const Grammar& _grammar;
+    ArenaAllocator _allocator;
+    Parser _parser;
+    std::vector<Entry> _rules;
+  };
+
+}}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/RuleStore.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Finds the K best scores of many numeric rules.
+   * Each rule has an upper bound, inferred from its constants through +, -, * and ?:
+   * (unbounded otherwise), and possibly tightened by the caller. compile() orders the
+   * rules by decreasing bound: once K scores are known, top() stops at the first rule
+   * whose bound cannot beat the K-th best one.
+   * An int or double rule throwing a ValueException or flagging NaN has no score.
+   */
+  class ScoreSet: private boost::noncopyable {
+  public:
+    typedef RuleStore::Rule Rule;
+
+    struct Score {
+      Rule _rule;
+      double _score;
+    };
+
+    explicit ScoreSet(const Grammar& iGrammar);
+
+    // Rules must be numeric, and never score more than iMaxScore.
+    // compile() must be called again after adding rules.
+    Rule add(const std::string& iFormula,
+             double iMaxScore = std::numeric_limits<double>::infinity());
+
+    void compile();
+
+    // Writes the best scores, up to iK of them, in decreasing order (the first added rule
+    // first among equal scores), and returns their number. oScores is used as the heap:
+    // nothing is allocated. oEvaluated, if given, is set to the number of rules evaluated.
+    // Not thread-safe: the factorized nodes hold caches.
+    size_t top(IContext& ioContext, Score *oScores, size_t iK,
+               size_t *oEvaluated = NULL) const;
+
+    size_t size() const
+    {
+      return _rules.size();
+    }
+
+    double getUpperBound(Rule iRule) const
+    {
+      return _upperBounds[iRule];
+    }
+
+  private:
+    struct Bounds {
+      double _low;
+      double _high;
+    };
+
+    typedef boost::unordered_map<size_t, Bounds> KnownBounds; // By node id
+
+    const Bounds& getBounds(size_t iNode);
+
+    Factorizer _dag;
+    Parser _parser;
+    std::vector<const Expression*> _rules;
+    std::vector<double> _upperBounds; // By rule
+    std::vector<Rule> _order; // By decreasing upper bound
+    KnownBounds _bounds;
+    bool _compiled;
+  };
+
+}}
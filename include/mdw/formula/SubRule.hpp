@@ -0,0 +1,128 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/Traits.hpp>
+#include <string>
+
+namespace mdw { namespace formula {
+
+  // Conversion between cached values and context slots
+  template <class CachedT> struct SlotValue
+  {
+    static void Set(IContext::Slot& oSlot, CachedT iValue)
+    {
+      oSlot._value._pointer = iValue;
+    }
+
+    static CachedT Get(const IContext::Slot& iSlot)
+    {
+      return static_cast<CachedT>(iSlot._value._pointer);
+    }
+  };
+
+  template <> struct SlotValue<bool>
+  {
+    static void Set(IContext::Slot& oSlot, bool iValue)
+    {
+      oSlot._value._bool = iValue;
+    }
+
+    static bool Get(const IContext::Slot& iSlot)
+    {
+      return iSlot._value._bool;
+    }
+  };
+
+  template <> struct SlotValue<int64_t>
+  {
+    static void Set(IContext::Slot& oSlot, int64_t iValue)
+    {
+      oSlot._value._int = iValue;
+    }
+
+    static int64_t Get(const IContext::Slot& iSlot)
+    {
+      return iSlot._value._int;
+    }
+  };
+
+  template <> struct SlotValue<double>
+  {
+    static void Set(IContext::Slot& oSlot, double iValue)
+    {
+      oSlot._value._double = iValue;
+    }
+
+    static double Get(const IContext::Slot& iSlot)
+    {
+      return iSlot._value._double;
+    }
+  };
+
+  /*
+   * Named rule registered in the Grammar and referenced as @name in formulas.
+   * There is only one instance per name, shared by all the formulas using it,
+   * and it is evaluated at most once per IContext: the result is kept in a slot
+   * of the context until the context is cleaned.
+   */
+  template <class T> class SubRule: public TypedExpression<T>
+  {
+    typedef typename TypeTraits<T>::ReturnType ReturnType;
+    typedef typename __TypeTraits<ReturnType>::cached_type CachedType;
+
+  public:
+    SubRule(ExpressionType iType,
+            const std::string& iName,
+            const TypedExpression<T>& iRule,
+            size_t iSlot):
+      TypedExpression<T>(iType), _name(iName), _rule(iRule), _slot(iSlot)
+    {}
+
+    ReturnType evaluate(IContext& ioContext) const
+    {
+      if (ioContext.isNaN())
+      {
+        // Cannot tell whether the result is valid or not: no memoization
+        return _rule.evaluate(ioContext);
+      }
+      IContext::Slot& aSlot = ioContext.getSlot(_slot);
+      if (aSlot._contextId == ioContext.getUniqueId())
+      {
+        if (aSlot._isNaN)
+        {
+          ioContext.setNaN();
+        }
+        return __TypeTraits<ReturnType>::FromCached(SlotValue<CachedType>::Get(aSlot));
+      }
+      ReturnType aResult = _rule.evaluate(ioContext);
+      // The slot may have moved if the rule uses other sub-rules
+      IContext::Slot& aNewSlot = ioContext.getSlot(_slot);
+      SlotValue<CachedType>::Set(aNewSlot, __TypeTraits<ReturnType>::ToCached(aResult));
+      aNewSlot._isNaN = ioContext.isNaN();
+      aNewSlot._contextId = ioContext.getUniqueId();
+      return aResult;
+    }
+
+    std::string toString() const
+    {
+      return "@" + _name;
+    }
+
+    const std::string& getName() const
+    {
+      return _name;
+    }
+
+    const TypedExpression<T>& getRule() const
+    {
+      return _rule;
+    }
+
+  private:
+    const std::string _name;
+    const TypedExpression<T>& _rule;
+    const size_t _slot;
+  };
+
+}}
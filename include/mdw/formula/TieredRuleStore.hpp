@@ -0,0 +1,106 @@
+#pragma once
+
+#include <mdw/formula/ArenaAllocator.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/RuleStore.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  struct TierStatistics {
+    TierStatistics():
+      _hot(0), _cold(0), _accesses(0), _promotions(0), _demotions(0), _hotBytes(0),
+      _coldBytes(0)
+    {}
+
+    // Ratio of the accesses which had to compile the rule
+    double getPromotionRatio() const
+    {
+      return _accesses ? (double)_promotions / (double)_accesses : 0.;
+    }
+
+    size_t _hot;
+    size_t _cold;
+    size_t _accesses;
+    size_t _promotions;
+    size_t _demotions;
+    size_t _hotBytes; // Arenas of the compiled rules
+    size_t _coldBytes; // Formulas of all the rules
+  };
+
+  /*
+   * Keeps rarely used rules as text only: a rule is compiled (hot) on access, in an
+   * arena of its own, and forgotten again (cold) by demoteIdle() when it was not
+   * accessed for the idle period, giving its arena back.
+   * Not thread-safe: an expression is only valid until its rule is demoted.
+   */
+  class TieredRuleStore: private boost::noncopyable {
+  public:
+    typedef RuleStore::Rule Rule;
+    typedef std::chrono::steady_clock Clock;
+
+    explicit TieredRuleStore(const Grammar& iGrammar,
+                             Clock::duration iIdlePeriod = std::chrono::hours(1));
+    ~TieredRuleStore();
+
+    void setIdlePeriod(Clock::duration iIdlePeriod)
+    {
+      _idlePeriod = iIdlePeriod;
+    }
+
+    // The rule is cold until its first access
+    Rule add(const std::string& iFormula);
+
+    // Compiles the rule if it is cold. A formula which does not compile throws at each call.
+    const Expression& get(Rule iRule, Clock::time_point iNow = Clock::now());
+
+    bool isHot(Rule iRule) const
+    {
+      return _rules[iRule]._hot != NULL;
+    }
+
+    // Demotes the hot rules not accessed since iNow - idle period, returns their number
+    size_t demoteIdle(Clock::time_point iNow = Clock::now());
+
+    size_t size() const
+    {
+      return _rules.size();
+    }
+
+    // Tier sizes are computed, counters are cumulated since the creation of the store
+    TierStatistics getStatistics() const;
+
+  private:
+    struct HotRule {
+      HotRule():
+        _expression(NULL)
+      {}
+
+      ArenaAllocator _allocator;
+      const Expression *_expression;
+    };
+
+    struct Entry {
+      explicit Entry(const std::string& iFormula):
+        _formula(iFormula), _hot(NULL)
+      {}
+
+      std::string _formula;
+      HotRule *_hot; // NULL when cold
+      Clock::time_point _lastAccess;
+    };
+
+    const Grammar& _grammar;
+    Clock::duration _idlePeriod;
+    std::vector<Entry> _rules;
+    size_t _hotCount;
+    size_t _accesses;
+    size_t _promotions;
+    size_t _demotions;
+  };
+
+}}
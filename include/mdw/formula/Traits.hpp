@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <string>
 #include <typeinfo>
 #include <boost/type_traits/is_integral.hpp>
@@ -20,6 +21,26 @@ namespace mdw { namespace formula {
   static const ExpressionType kExprFact = 7;
   static const ExpressionType kExprMaxType = 20;
 
+  // Small integer given to a C++ type the first time it is asked for, in this process:
+  // cheaper than comparing type names or using RTTI. Never kExprVoid.
+  class StaticTypeIds {
+  public:
+    static size_t Next()
+    {
+      static std::atomic<size_t> Latest(0);
+      return ++Latest;
+    }
+  };
+
+  template <class T> struct StaticTypeId
+  {
+    static size_t Get()
+    {
+      static const size_t kId = StaticTypeIds::Next();
+      return kId;
+    }
+  };
+
   // Traits for object types
   template <class T, class ConditionT = void> struct TypeTraits
   {
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  // Called on each node of a DAG (see VisitDag)
+  class ExpressionVisitor {
+  public:
+    virtual ~ExpressionVisitor() {}
+
+    virtual void visit(const Expression& iExpression) = 0;
+  };
+
+  // Visits each node reachable from the roots once, children first (see
+  // Expression::getChildrenCount). Shared nodes are not visited again.
+  void VisitDag(const Expression& iRoot, ExpressionVisitor& ioVisitor);
+  void VisitDag(const std::vector<Expression*>& iRoots, ExpressionVisitor& ioVisitor);
+
+}}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <mdw/formula/Traits.hpp>
+#include <string>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  class Expression;
+  class IContext;
+
+  /*
+   * ValueKey is a hashable tuple of basic values (bool, int, double, string).
+   * Values are appended in a binary form tagged by their type, so that two keys
+   * are equal if and only if they hold the same values in the same order.
+   * It is meant to be reused: clear() keeps the memory already allocated.
+   */
+  class ValueKey {
+  public:
+    ValueKey():
+      _hash(0)
+    {}
+
+    void clear()
+    {
+      _bytes.clear();
+      _hash = 0;
+    }
+
+    void append(bool iValue);
+    void append(int64_t iValue);
+    void append(double iValue);
+    void append(const std::string& iValue);
+
+    // Evaluates the expression and appends its result.
+    // Returns false if the type is not supported, or if the result is NaN
+    // (the context is then left NaN), or if the evaluation threw a ValueException.
+    bool appendValue(const Expression& iExpression, IContext& ioContext);
+
+    // Tells whether expressions of this type can be appended
+    static bool IsSupported(ExpressionType iType);
+
+    size_t hash() const
+    {
+      return _hash;
+    }
+
+    size_t size() const
+    {
+      return _bytes.size();
+    }
+
+    bool operator==(const ValueKey& iOther) const
+    {
+      return (_hash == iOther._hash) && (_bytes == iOther._bytes);
+    }
+
+    bool operator!=(const ValueKey& iOther) const
+    {
+      return !(*this == iOther);
+    }
+
+  private:
+    void appendBytes(char iTag, const void *iData, size_t iSize);
+
+    std::string _bytes;
+    size_t _hash;
+  };
+
+  inline size_t hash_value(const ValueKey& iKey)
+  {
+    return iKey.hash();
+  }
+
+}}
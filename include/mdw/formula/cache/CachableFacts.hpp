@@ -6,6 +6,7 @@
 #include <mdw/formula/IContext.hpp>
 #include <mdw/formula/Any.hpp>
 #include <mdw/formula/ValueException.hpp>
+#include <mdw/formula/cache/CacheStatistics.hpp>
 #include <boost/unordered_map.hpp>
 
 namespace mdw { namespace formula {
@@ -16,7 +17,7 @@ namespace mdw { namespace formula {
     typedef typename __TypeTraits<FactT>::actual_type OutputType;
     typedef typename TypeTraits<OutputType>::ReturnType ReturnType;
 
-    class DefaultResolver: public TypedExpression<OutputType>
+    class DefaultResolver: public TypedExpression<OutputType>, public CacheIntrospection
     {
     public:
       DefaultResolver(const Grammar& iGrammar, const std::string& iName):
@@ -26,18 +27,26 @@ namespace mdw { namespace formula {
 
       ReturnType evaluate(IContext& ioContext) const
       {
+        ++_statistics._lookups;
         if (ioContext.getUniqueId() != _latestContextId)
         {
+          if (_factContainer || _constFactContainer)
+          {
+            ++_statistics._invalidations;
+          }
           _factContainer = NULL;
           _constFactContainer = NULL;
           _latestContextId = ioContext.getUniqueId();
         }
         if (_factContainer)
         {
+          ++_statistics._hits;
           return _factContainer->get();
         } else if (_constFactContainer) {
+          ++_statistics._hits;
           return  _constFactContainer->get();
         } else {
+          ++_statistics._misses;
           const TypedFact<OutputType> *aCont =
             ioContext.getFactContainer<OutputType>(_name);
           if (aCont)
@@ -68,8 +77,27 @@ namespace mdw { namespace formula {
         return "$" + _name;
       }
 
+      CacheStatistics getCacheStatistics() const
+      {
+        CacheStatistics aResult = _statistics;
+        aResult._entries = (_factContainer || _constFactContainer) ? 1 : 0;
+        aResult._bytes = aResult._entries * sizeof(void*);
+        return aResult;
+      }
+
+      void resetCacheStatistics() const
+      {
+        _statistics.reset();
+      }
+
+      std::string getCacheDescription() const
+      {
+        return "container of " + toString();
+      }
+
     private:
       const std::string& _name;
+      mutable CacheStatistics _statistics;
       mutable int _latestContextId;
       mutable const TypedFact<OutputType> *_factContainer;
       mutable const TypedFact<const OutputType> *_constFactContainer;
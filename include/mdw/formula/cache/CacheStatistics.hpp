@@ -0,0 +1,81 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Counters of a cache. Counting is a plain increment in the evaluation path;
+   * entries and bytes are only computed when the statistics are requested.
+   */
+  struct CacheStatistics {
+    CacheStatistics():
+      _lookups(0), _hits(0), _misses(0), _invalidations(0), _entries(0), _bytes(0)
+    {}
+
+    void reset()
+    {
+      *this = CacheStatistics();
+    }
+
+    CacheStatistics& operator+=(const CacheStatistics& iOther);
+
+    double getHitRatio() const
+    {
+      return _lookups ? (double)_hits / (double)_lookups : 0.;
+    }
+
+    size_t _lookups;
+    size_t _hits;
+    size_t _misses;
+    size_t _invalidations; // Number of times the whole cache was dropped
+    size_t _entries;
+    size_t _bytes; // Estimate of the memory used by the entries
+  };
+
+  // Implemented by all the expressions holding a cache
+  class CacheIntrospection {
+  public:
+    virtual ~CacheIntrospection() {}
+
+    virtual CacheStatistics getCacheStatistics() const = 0;
+    virtual void resetCacheStatistics() const = 0;
+    virtual std::string getCacheDescription() const = 0;
+  };
+
+  /*
+   * List of caches (typically the ones inserted by a Factorizer) to aggregate
+   * and dump their statistics.
+   */
+  class CacheRegistry {
+  public:
+    void add(const CacheIntrospection& iCache);
+    void remove(const CacheIntrospection& iCache);
+    void clear();
+
+    size_t size() const
+    {
+      return _caches.size();
+    }
+
+    const CacheIntrospection& get(size_t iIndex) const
+    {
+      return *_caches[iIndex];
+    }
+
+    CacheStatistics getTotal() const;
+    void resetStatistics() const;
+
+    // One line per cache, then the total
+    void printText(std::ostream& oStream) const;
+    void printJson(std::ostream& oStream) const;
+
+  private:
+    std::vector<const CacheIntrospection*> _caches;
+  };
+
+  std::ostream& operator<<(std::ostream& oStream, const CacheStatistics& iStatistics);
+
+}}
@@ -5,6 +5,7 @@
 #include <mdw/formula/Expression.hpp>
 #include <mdw/formula/IContext.hpp>
 #include <mdw/formula/cache/KnownType.hpp>
+#include <mdw/formula/cache/CacheStatistics.hpp>
 #include <mdw/Tracer.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -14,7 +15,7 @@ namespace mdw { namespace formula {
   template <class OutputType> class UnaryCachedByAddress
   {
   public:
-    class Expression: public TypedExpression<OutputType>
+    class Expression: public TypedExpression<OutputType>, public CacheIntrospection
     {
       typedef typename TypeTraits<OutputType>::ReturnType ReturnType;
       typedef typename __TypeTraits<ReturnType>::cached_type CachedType;
@@ -34,6 +35,10 @@ namespace mdw { namespace formula {
           if (_latestContextId != ioContext.getUniqueId())
           {
             FORMULA_DEBUG("Need to clean up cache due to new IContext");
+            if (!_cache.empty())
+            {
+              ++_statistics._invalidations;
+            }
             _cache.clear();
             _latestContextId = ioContext.getUniqueId();
           }
@@ -51,9 +56,11 @@ namespace mdw { namespace formula {
             FORMULA_DEBUG("Exception while computing fact: " << _fact.getExpression().toString());
             return _child.evaluate(ioContext);
           }
+          ++_statistics._lookups;
           typename Cache::iterator anIt = _cache.find(aFact);
           if (anIt != _cache.end())
           {
+            ++_statistics._hits;
             if (anIt->second.first)
             {
               ioContext.setNaN();
@@ -61,6 +68,7 @@ namespace mdw { namespace formula {
             //FORMULA_DEBUG("Used cached value for " << _child.toString());
             return __TypeTraits<ReturnType>::FromCached(anIt->second.second);
           } else {
+            ++_statistics._misses;
             ReturnType aResult = _child.evaluate(ioContext);
             //FORMULA_DEBUG("New cached value for " << _child.toString());
             _cache.insert(std::make_pair(aFact, std::make_pair(ioContext.isNaN(),
@@ -96,6 +104,45 @@ namespace mdw { namespace formula {
         return _child;
       }
 
+      // The cached child, then the fact used as key
+      size_t getChildrenCount() const
+      {
+        return 2;
+      }
+
+      const formula::Expression& getChild(size_t iIndex) const
+      {
+        switch (iIndex)
+        {
+          case 0:
+            return _child;
+          case 1:
+            return _fact.getExpression();
+          default:
+            return formula::Expression::getChild(iIndex);
+        }
+      }
+
+      CacheStatistics getCacheStatistics() const
+      {
+        CacheStatistics aResult = _statistics;
+        aResult._entries = _cache.size();
+        // Nodes of the hash map hold the value and a link, buckets hold a pointer
+        aResult._bytes = _cache.size() * (sizeof(typename Cache::value_type) + sizeof(void*)) +
+          _cache.bucket_count() * sizeof(void*);
+        return aResult;
+      }
+
+      void resetCacheStatistics() const
+      {
+        _statistics.reset();
+      }
+
+      std::string getCacheDescription() const
+      {
+        return _child.toString() + " by " + _fact.getExpression().toString();
+      }
+
     private:
       const TypedExpression<OutputType>& _child;
       const FactByAddress& _fact;
@@ -103,6 +150,7 @@ namespace mdw { namespace formula {
 
       mutable Cache _cache;
       mutable int _latestContextId;
+      mutable CacheStatistics _statistics;
     };
   };
 
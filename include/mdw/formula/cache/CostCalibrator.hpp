@@ -0,0 +1,71 @@
+#pragma once
+
+#include <mdw/formula/ArenaAllocator.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/cache/CostModel.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  class Expression;
+  class IContext;
+
+  /*
+   * Observer measuring the actual evaluation time of every node built by a Parser,
+   * using a sample context holding representative facts.
+   * The cost of the children (measured before their parents, since the parser
+   * builds expressions bottom-up) is subtracted to get the cost of the node alone.
+   */
+  class CostCalibrator: public Parser::NoopObserver {
+  public:
+    CostCalibrator(ArenaAllocator& ioAllocator,
+                   IContext& ioSampleContext,
+                   CostModel& ioModel,
+                   size_t iIterations = 1000);
+
+    // Parses and measures all the samples, then calibrates the fixed costs
+    void calibrate(const Grammar& iGrammar, const std::vector<std::string>& iSamples);
+
+    // Measures the basic operation and the cache lookup overhead
+    void calibrateFixedCosts();
+
+    virtual Expression& newConstant(Expression& ioResult);
+
+    virtual Expression& newFact(Expression& ioResult, const std::string& iName);
+
+    virtual Expression& newUnary(Expression& ioResult,
+                                 Expression& ioRight,
+                                 const std::string& iSymbol);
+
+    virtual Expression& newBinary(Expression& ioResult,
+                                  Expression& ioLeft,
+                                  Expression& ioRight,
+                                  const std::string& iSymbol);
+
+    virtual Expression& newChoice(Expression& ioResult,
+                                  TypedExpression<bool>& ioCondition,
+                                  Expression& ioLeft,
+                                  Expression& ioRight);
+
+    virtual Expression& newArrow(Expression& ioResult,
+                                 Expression& ioContainer,
+                                 Expression& ioCondition,
+                                 const std::string& iLocalName);
+
+  private:
+    // Total time (node + children) of one evaluation, negative if it cannot be evaluated
+    double measure(const Expression& iExpression);
+    void record(const Expression& iExpression, double iChildrenNanos);
+    double getTotal(const Expression& iExpression) const;
+
+    typedef boost::unordered_map<const Expression*, double> Totals;
+
+    IContext& _context;
+    CostModel& _model;
+    size_t _iterations;
+    Totals _totals;
+  };
+
+}}
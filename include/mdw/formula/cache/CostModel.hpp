@@ -0,0 +1,92 @@
+#pragma once
+
+#include <boost/unordered_map.hpp>
+#include <iostream>
+#include <string>
+
+namespace mdw { namespace formula {
+
+  class Expression;
+
+  /*
+   * CostModel gives the cost of evaluating a node, without its subexpressions.
+   * Costs are keyed by the C++ type of the node, so that a calibrated model
+   * only makes sense for the binary that produced it.
+   *
+   * An uncalibrated model falls back on Expression::complexity() and keeps the
+   * historical caching threshold, so that it behaves exactly as the constants did.
+   * Once calibrated (see CostCalibrator), all costs are in nanoseconds.
+   */
+  class CostModel {
+  public:
+    struct NodeCost {
+      NodeCost():
+        _nanos(0), _samples(0)
+      {}
+
+      double _nanos;
+      size_t _samples;
+    };
+
+    typedef boost::unordered_map<std::string, NodeCost> Costs;
+
+    CostModel();
+
+    static std::string GetKind(const Expression& iExpression);
+
+    // Cost of the node alone, in the unit of the model
+    double getCost(const Expression& iExpression) const;
+
+    bool hasCost(const std::string& iKind) const;
+
+    // Averages the new measure with the previous ones for the same kind
+    void addMeasure(const std::string& iKind, double iNanos, size_t iSamples = 1);
+
+    void setCost(const std::string& iKind, double iNanos);
+
+    // Cost of a basic operation, used to scale complexity() of unknown nodes
+    double getUnitCost() const
+    {
+      return _unitCost;
+    }
+
+    void setUnitCost(double iNanos)
+    {
+      _unitCost = iNanos;
+    }
+
+    // Overhead of looking up a cached result: caching below this cost is a loss
+    double getCacheLookupCost() const
+    {
+      return _cacheLookupCost;
+    }
+
+    void setCacheLookupCost(double iNanos)
+    {
+      _cacheLookupCost = iNanos;
+    }
+
+    bool isCalibrated() const
+    {
+      return _calibrated;
+    }
+
+    const Costs& getCosts() const
+    {
+      return _costs;
+    }
+
+    void save(std::ostream& oStream) const;
+    void load(std::istream& iStream);
+
+    void save(const std::string& iFileName) const;
+    void load(const std::string& iFileName);
+
+  private:
+    Costs _costs;
+    double _unitCost;
+    double _cacheLookupCost;
+    bool _calibrated;
+  };
+
+}}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace mdw { namespace formula {
+
+  class RewritePass;
+
+  /*
+   * Instantiates again the factorized nodes of a rule through another Parser (and so
+   * its observers), from the parsed expressions: the optimizations of the source are
+   * not copied. Each node is replayed once, except below local variables.
+   * A RewritePass may replace the nodes, but the arrows themselves, on the way.
+   */
+  class DagReplayer: private boost::noncopyable {
+  public:
+    // Nodes to replay, by id, as keyed by a Factorizer (see Factorizer::getNodeKey)
+    class Source {
+    public:
+      virtual ~Source() {}
+
+      virtual const Factorizer::NodeKey& getNodeKey(size_t iId) const = 0;
+      // Of a constant node, its value being copied in the allocator of ioTarget
+      virtual Expression& createConstant(size_t iId, Parser& ioTarget) const = 0;
+    };
+
+    DagReplayer(const Factorizer& iSource, Parser& ioTarget, RewritePass *ioPass = NULL);
+    // The source must outlive the DagReplayer, and give children lower ids than their
+    // parents
+    DagReplayer(const Source& iSource, Parser& ioTarget);
+    ~DagReplayer();
+
+    // The rule must come from the Factorizer given at construction
+    Expression& replay(const Expression& iRule);
+    Expression& replay(size_t iId);
+
+  private:
+    Expression& replay(size_t iId, size_t iLocals);
+    Expression& instantiate(size_t iId, const Factorizer::NodeKey& iKey,
+                            const std::vector<Expression*>& iChildren);
+
+    typedef boost::unordered_map<size_t, Expression*> Memo;
+
+    const Factorizer *_dag; // NULL when replaying another source
+    Source *_ownSource; // Adapts _dag
+    const Source& _source;
+    Parser& _target;
+    RewritePass *_pass; // May be NULL
+    Memo _memo;
+  };
+
+}}
@@ -3,8 +3,13 @@
 #include <mdw/formula/ArenaAllocator.hpp>
 #include <mdw/formula/Observer.hpp>
 #include <mdw/formula/Traits.hpp>
-#include <set>
+#include <mdw/formula/cache/CostModel.hpp>
+#include <mdw/formula/cache/CacheStatistics.hpp>
+#include <mdw/formula/cache/OptimizationProfile.hpp>
+#include <mdw/formula/cache/StructuralHash.hpp>
 #include <list>
+#include <vector>
+#include <boost/dynamic_bitset.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/noncopyable.hpp>
 
@@ -16,19 +21,35 @@ namespace mdw { namespace formula {
   class Grammar;
 
   class Factorizer: public Observer, private boost::noncopyable {
+  public:
+    // Kind of node and ids of the children: hashing it does not depend on the depth of the
+    // sub-tree, unlike toString(). Kinds are "c <type> <value>", "f <fact>", "r <sub-rule>",
+    // "u <symbol>", "b <symbol>", "?" and "-> <local>".
+    typedef std::vector<size_t> Children;
+    typedef std::pair<std::string, Children> NodeKey;
+
+  private:
+    // Indexed by the ids given by getFactId()
+    typedef boost::dynamic_bitset<> FactSet;
+
     class KnownExpression {
     public:
-      explicit KnownExpression(Expression& ioExpression, Factorizer& ioParent);
+      KnownExpression(Expression& ioExpression, size_t iId, const CostModel& iCostModel);
 
-      void addDependency(const Expression& iExpression);
+      void addDependency(KnownExpression& ioChild);
 
       Expression& _expression;
-      Factorizer& _parent;
+      size_t _id; // Index in _known
+      const NodeKey *_key; // Owned by _structures
+      StructuralHash _hash; // Of the parsed sub-tree, whatever the optimizations
       ExpressionType _type;
-      size_t _totalComplexity;
-      std::set<std::string> _usedFacts;
-      std::string _toString;
+      double _totalCost; // Cost of the whole sub-tree, according to the CostModel
+      FactSet _usedFacts;
       Expression *_optimized; // Never NULL, but may change during life-time
+      const CacheIntrospection *_cache; // NULL unless cached
+      OptimizationProfile::NodeProfile *_counters; // NULL unless profiled
+      size_t _references; // Parents and rules using this node
+      std::vector<const Expression*> _aliases; // All the keys of this node in _expressions
     };
 
   public:
@@ -38,12 +59,106 @@ namespace mdw { namespace formula {
 
     template <class T> void registerType(const Grammar& iGrammar);
 
+    // Registers the standard types and sets the grammar, as Grammar::addObserver does,
+    // without registering the Factorizer in the grammar
+    void observe(const Grammar& iGrammar);
+
     void reset();
 
+    // A rule keeps its factorized nodes alive until it is retired and collectGarbage() is
+    // called. The same rule may be added several times, and must be retired as many times.
+    void addRule(const Expression& iRule);
+    void retireRule(const Expression& iRule);
+
+    // Forgets the nodes which are not used by any rule anymore (including the ones parsed
+    // but never added), and returns their number. The other nodes are left untouched.
+    // Their memory is only given back by reset().
+    size_t collectGarbage();
+
+    // Copies the nodes used by the rules, and only them, in the empty Factorizer ioTarget
+    // (which must observe a grammar), and replaces the rules by their copies.
+    // The source, with its discarded and replaced nodes, can then be destroyed.
+    // With iStrip, the bookkeeping of the target is dropped afterwards (see strip()).
+    void compact(Factorizer& ioTarget, std::vector<Expression*>& ioRules,
+                 bool iStrip = false) const;
+
+    // Forgets the structure of the nodes (keys, names, aliases) but keeps them alive:
+    // nothing parsed later is shared with them, and they cannot be added or retired.
+    void strip();
+
+    // Structure of the factorized DAG, to replay it elsewhere (see DagReplayer).
+    // Children always have lower ids than their parents.
+    size_t getNodeId(const Expression& iExpression) const;
+    const NodeKey& getNodeKey(size_t iId) const;
+    // As given by the Parser, before any optimization
+    const Expression& getParsedExpression(size_t iId) const;
+
+    // Number of nodes not collected
+    size_t getNodesCount() const
+    {
+      return _nodesCount;
+    }
+
+    // The model must outlive the Factorizer. NULL restores the default model.
+    void setCostModel(const CostModel *iModel);
+
+    const CostModel& getCostModel() const
+    {
+      return *_costModel;
+    }
+
+    // Needed to reorder operands, set by Grammar::addObserver
+    void setGrammar(const Grammar& iGrammar)
+    {
+      _grammar = &iGrammar;
+    }
+
+    // Counts evaluations and selectivity of the conditions parsed from now on
+    void setProfiling(bool iProfiling)
+    {
+      _profiling = iProfiling;
+    }
+
+    // Applies the learned caching decisions to the expressions parsed from now on.
+    // The profile must outlive the parsing. NULL restores the cost-based decisions.
+    void setProfile(const OptimizationProfile *iProfile)
+    {
+      _profile = iProfile;
+    }
+
+    // Also evaluate first the operand of || most likely to be true (for its cost).
+    // Off by default: only the left operand absorbs NaN and ValueException (PTR#12761056).
+    void setReordering(bool iReordering)
+    {
+      _reordering = iReordering;
+    }
+
+    // Normalizes commutative operands order, comparison direction, chains of && (and of
+    // integer + and *) and double negations, so that equivalent expressions are shared.
+    // On by default, only applies to the standard types.
+    void setCanonicalization(bool iCanonicalizing)
+    {
+      _canonicalizing = iCanonicalizing;
+    }
+
+    // Adds the counters of the profiled and cached expressions to the profile
+    void exportProfile(OptimizationProfile& ioProfile) const;
+
+    // Structural hash of a factorized expression, 0 if unknown
+    uint64_t getStructuralHash(const Expression& iExpression) const;
+
+    // All the caches used by the factorized expressions
+    const CacheRegistry& getCaches() const
+    {
+      return _caches;
+    }
+
     virtual Expression& newConstant(Expression& ioResult);
 
     virtual Expression& newFact(Expression& ioResult, const std::string& iName);
 
+    virtual Expression& newSubRule(Expression& ioResult, const std::string& iName);
+
     virtual Expression& newUnary(Expression& ioResult,
                                  Expression& ioRight,
                                  const std::string& iSymbol);
@@ -64,26 +179,57 @@ namespace mdw { namespace formula {
                                  const std::string& iLocalName);
 
   private:
-    KnownExpression *getByDisplay(const std::string& iDisplay);
+    KnownExpression *getByStructure(const NodeKey& iKey);
     KnownExpression *getKnown(const Expression& iExpression);
-    KnownExpression& createKnown(Expression& ioExpression, const std::string& iDisplay);
+    KnownExpression& getChild(const Expression& iExpression);
+    KnownExpression& createKnown(Expression& ioExpression, const NodeKey& iKey);
+    void addAlias(KnownExpression& ioKnown, Expression& ioAlias);
+    void release(KnownExpression& ioKnown);
+    size_t getFactId(const std::string& iName);
     Expression& optimize(KnownExpression& ioKnown);
+    bool shouldCache(const KnownExpression& iKnown) const;
+    Expression& reorder(KnownExpression& ioKnown, Expression& ioLeft, Expression& ioRight,
+                        const std::string& iSymbol);
+    void profile(KnownExpression& ioKnown);
+    Expression *canonicalize(KnownExpression& ioLeft, KnownExpression& ioRight,
+                             const std::string& iSymbol);
+    void flatten(KnownExpression& ioKnown, const std::string& iKind,
+                 std::vector<KnownExpression*>& oOperands);
+    Expression& combine(Expression& ioLeft, Expression& ioRight, const std::string& iSymbol);
+    // Canonical order of operands
+    static bool IsBefore(const KnownExpression *iLeft, const KnownExpression *iRight);
+    void registerCache(const Expression& iExpression);
 
     // Ok, a multi_index might be better suited, but hey, the API is too horrible :-D
     // ...and we can afford to copy some pointers.
     // By the way, none of these pointers are ever NULL, but maps don't support references
     typedef boost::unordered_map<const Expression*, KnownExpression*> KnownExpressions;
-    typedef boost::unordered_map<std::string, Expression*> ByDisplay;
+    typedef boost::unordered_map<NodeKey, KnownExpression*> ByStructure;
 
-    typedef boost::unordered_map<std::string, FactByAddress*> Facts;
+    typedef boost::unordered_map<std::string, size_t> FactIds;
+    // Indexed by fact id, NULL when the fact cannot be cached
+    typedef std::vector<FactByAddress*> Facts;
     // Registered types (fact types + return types)
     typedef boost::unordered_map<ExpressionType, KnownType*> Types;
 
     ArenaAllocator _allocator;
+    CostModel _defaultCostModel;
+    const CostModel *_costModel;
+    const Grammar *_grammar;
+    const OptimizationProfile *_profile;
+    bool _profiling;
+    bool _reordering;
+    bool _canonicalizing;
+    OptimizationProfile _liveProfile; // Counters of the profiled expressions
+    std::vector<KnownExpression*> _known; // NULL once collected
+    std::vector<KnownExpression*> _unreferenced; // Candidates for collectGarbage()
+    size_t _nodesCount;
     KnownExpressions _expressions;
-    ByDisplay _displays;
+    ByStructure _structures;
+    FactIds _factIds;
     Facts _facts;
     Types _types;
+    CacheRegistry _caches;
   };
 
 }}
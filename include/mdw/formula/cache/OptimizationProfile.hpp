@@ -0,0 +1,80 @@
+#pragma once
+
+#include <boost/unordered_map.hpp>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Counters gathered in production on the factorized expressions, keyed by the
+   * structural hash of each subexpression (see StructuralHash).
+   * It is written by Factorizer::exportProfile() and given back to a Factorizer
+   * at compile time, so that caching and ordering decisions survive restarts.
+   */
+  class OptimizationProfile {
+  public:
+    struct NodeProfile {
+      NodeProfile():
+        _evaluations(0), _trues(0), _cacheLookups(0), _cacheHits(0), _cost(0)
+      {}
+
+      // Ratio of evaluations returning true (conditions only)
+      double getSelectivity() const
+      {
+        return _evaluations ? (double)_trues / (double)_evaluations : 0.;
+      }
+
+      double getHitRatio() const
+      {
+        return _cacheLookups ? (double)_cacheHits / (double)_cacheLookups : 0.;
+      }
+
+      // Counters are summed, the cost is the latest known one
+      void add(const NodeProfile& iOther);
+
+      size_t _evaluations;
+      size_t _trues;
+      size_t _cacheLookups;
+      size_t _cacheHits;
+      double _cost; // Cost of the whole subexpression (see CostModel)
+    };
+
+    typedef boost::unordered_map<uint64_t, NodeProfile> Nodes;
+
+    const NodeProfile *find(uint64_t iHash) const
+    {
+      Nodes::const_iterator anIt = _nodes.find(iHash);
+      return (anIt == _nodes.end()) ? NULL : &anIt->second;
+    }
+
+    // Creates the entry if needed. References stay valid when other entries are added.
+    NodeProfile& get(uint64_t iHash)
+    {
+      return _nodes[iHash];
+    }
+
+    const Nodes& getNodes() const
+    {
+      return _nodes;
+    }
+
+    void clear()
+    {
+      _nodes.clear();
+    }
+
+    void merge(const OptimizationProfile& iOther);
+
+    void save(std::ostream& oStream) const;
+    void load(std::istream& iStream);
+
+    void save(const std::string& iFileName) const;
+    void load(const std::string& iFileName);
+
+  private:
+    Nodes _nodes;
+  };
+
+}}
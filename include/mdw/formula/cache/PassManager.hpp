@@ -0,0 +1,58 @@
+#pragma once
+
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  class Grammar;
+  class Parser;
+
+  /*
+   * A whole-program optimization, applied on the factorized DAG once all the rules are
+   * parsed (the observers only see each node once, when it is parsed).
+   */
+  class RewritePass {
+  public:
+    virtual ~RewritePass() {}
+
+    virtual std::string getName() const = 0;
+
+    // Called bottom-up on each node but the arrows (see DagReplayer), with its children
+    // already replayed and rewritten, iKey giving the original structure in iDag.
+    // Returns the replacement, created through ioParser or one of the children,
+    // or NULL to keep the node.
+    virtual Expression *rewrite(const Factorizer& iDag,
+                                const Factorizer::NodeKey& iKey,
+                                const std::vector<Expression*>& iChildren,
+                                Parser& ioParser) = 0;
+  };
+
+  /*
+   * Runs ordered RewritePasses over the rules of a Factorizer until none of them changes
+   * anymore: as the nodes are shared, an unchanged rule is replayed to the same node.
+   * The rewritten rules are added to the Factorizer and the old ones retired.
+   * Replaying allocates nodes even when nothing changes: collectGarbage() and compact()
+   * the Factorizer once done to give the memory back.
+   */
+  class PassManager: private boost::noncopyable {
+  public:
+    // The Factorizer must observe the grammar
+    PassManager(Factorizer& ioDag, const Grammar& iGrammar);
+
+    // Passes must outlive the PassManager
+    void addPass(RewritePass& ioPass);
+
+    // The rules must have been added to the Factorizer, and are replaced by their
+    // rewritten version. Returns the number of iterations run.
+    size_t run(std::vector<Expression*>& ioRules, size_t iMaxIterations = 10);
+
+  private:
+    Factorizer& _dag;
+    const Grammar& _grammar;
+    std::vector<RewritePass*> _passes;
+  };
+
+}}
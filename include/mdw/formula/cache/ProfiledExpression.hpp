@@ -0,0 +1,62 @@
+#pragma once
+
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/cache/OptimizationProfile.hpp>
+
+namespace mdw { namespace formula {
+
+  /*
+   * Counts the evaluations of a condition and how often it is true,
+   * to learn its selectivity (see Factorizer::setProfiling).
+   */
+  class ProfiledCondition: public TypedExpression<bool>
+  {
+  public:
+    ProfiledCondition(const TypedExpression<bool>& iChild,
+                      OptimizationProfile::NodeProfile& ioCounters):
+      TypedExpression<bool>(iChild.getType()), _child(iChild), _counters(ioCounters)
+    {}
+
+    bool evaluate(IContext& ioContext) const
+    {
+      bool aResult = _child.evaluate(ioContext);
+      ++_counters._evaluations;
+      if (aResult && !ioContext.isNaN())
+      {
+        ++_counters._trues;
+      }
+      return aResult;
+    }
+
+    size_t complexity() const
+    {
+      return 1;
+    }
+
+    std::string toString() const
+    {
+      return _child.toString();
+    }
+
+    const TypedExpression<bool>& getChild() const
+    {
+      return _child;
+    }
+
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _child;
+    }
+
+  private:
+    const TypedExpression<bool>& _child;
+    OptimizationProfile::NodeProfile& _counters;
+  };
+
+}}
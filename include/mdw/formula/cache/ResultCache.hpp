@@ -166,6 +166,25 @@ namespace mdw { namespace formula {
       return _child.toString();
     }
 
+    // The cached child, then the fact used as key
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _child;
+        case 1:
+          return _fact;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
     typename TypeTraits<T>::ReturnType evaluate(IContext& ioContext) const
     {
       return ioContext.getResults().findUnary<T>(_child, _fact);
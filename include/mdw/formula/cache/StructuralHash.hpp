@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace mdw { namespace formula {
+
+  /*
+   * 64 bits FNV-1a hash of the structure of an expression: kind of node, symbol,
+   * and hashes of the children. It only depends on the text of the formula
+   * (not on addresses), so it is stable across processes and restarts.
+   */
+  class StructuralHash {
+  public:
+    StructuralHash():
+      _value(kOffsetBasis)
+    {}
+
+    StructuralHash& add(const std::string& iValue)
+    {
+      addBytes(iValue.data(), iValue.size());
+      // Separator, so that ("ab", "c") and ("a", "bc") differ
+      addByte(0);
+      return *this;
+    }
+
+    StructuralHash& add(uint64_t iValue)
+    {
+      for (size_t i = 0; i < sizeof(iValue); ++i)
+      {
+        addByte((uint8_t)(iValue >> (8 * i)));
+      }
+      return *this;
+    }
+
+    uint64_t get() const
+    {
+      return _value;
+    }
+
+  private:
+    static const uint64_t kOffsetBasis = 14695981039346656037ULL;
+    static const uint64_t kPrime = 1099511628211ULL;
+
+    void addByte(uint8_t iByte)
+    {
+      _value ^= iByte;
+      _value *= kPrime;
+    }
+
+    void addBytes(const char *iData, size_t iSize)
+    {
+      for (size_t i = 0; i < iSize; ++i)
+      {
+        addByte((uint8_t)iData[i]);
+      }
+    }
+
+    uint64_t _value;
+  };
+
+}}
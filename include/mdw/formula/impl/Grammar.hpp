@@ -2,29 +2,43 @@
 
 #include <mdw/formula/Traits.hpp>
 #include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/SubRule.hpp>
+#include <mdw/formula/IContext.hpp>
 #include <mdw/formula/cache/Factorizer.hpp>
 #include <mdw/UnknownException.hpp>
+#include <algorithm>
 
 namespace mdw { namespace formula {
 
   template <class T> ExpressionType Grammar::registerType()
   {
     ExpressionType aType = findType(TypeTraits<T>::kTypeAsString);
-    if (aType != kExprVoid)
+    if (aType == kExprVoid)
     {
-      return aType;
-    } else {
-      _types[TypeTraits<T>::kTypeAsString] = _maxId;
+      checkNotFrozen();
+      aType = _maxId++;
+      _types[TypeTraits<T>::kTypeAsString] = aType;
       BOOST_FOREACH(Factorizer *anObserver, _factorizers)
       {
         anObserver->registerType<T>(*this);
       }
-      return _maxId++;
     }
+    size_t aStaticId = StaticTypeId<T>::Get();
+    if ((aStaticId >= _staticTypes.size() || _staticTypes[aStaticId] != aType) && !_frozen)
+    {
+      _staticTypes.resize(std::max(_staticTypes.size(), aStaticId + 1), kExprVoid);
+      _staticTypes[aStaticId] = aType;
+    }
+    return aType;
   }
 
   template <class T> ExpressionType Grammar::findType() const
   {
+    size_t aStaticId = StaticTypeId<T>::Get();
+    if ((aStaticId < _staticTypes.size()) && (_staticTypes[aStaticId] != kExprVoid))
+    {
+      return _staticTypes[aStaticId];
+    }
     ExpressionType aType = findType(TypeTraits<T>::kTypeAsString);
     if (aType == kExprVoid)
     {
@@ -35,5 +49,17 @@ namespace mdw { namespace formula {
   }
 
 
-}}
+  template <class T> Expression& Grammar::registerSubRule(ArenaAllocator& ioAllocator,
+                                                         const std::string& iName,
+                                                         const std::string& iFormula)
+  {
+    const TypedExpression<T>& aRule = parseSubRule(ioAllocator, iFormula).template get<T>();
+    const std::string& aName = ioAllocator.create<std::string>(iName);
+    ExpressionType aType = aRule.getType();
+    size_t aSlot = IContext::AllocateSlot();
+    Expression& aSubRule = ioAllocator.create<SubRule<T> >(aType, aName, aRule, aSlot);
+    addSubRule(iName, aSubRule);
+    return aSubRule;
+  }
 
+}}
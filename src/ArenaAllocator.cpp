@@ -37,17 +37,21 @@ namespace mdw { namespace formula {
 
     \Parameters                                                          
 iSize: initial block size                                        
+iMaxSize: size up to which the blocks grow
 
 \return                                                             
 None                                                            
 
 */                                                                      
-  ArenaAllocator::ArenaAllocator(size_t iSize):                 
-    _bkSize(MIN(MAX(128, iSize), 8192)), _lastDestroyer(NULL)                                 
+  ArenaAllocator::ArenaAllocator(size_t iSize, size_t iMaxSize):
+    _bkSize(MIN(MAX(128, iSize), MAX(128, iMaxSize))), _maxBkSize(MAX(_bkSize, iMaxSize)),
+    _lastDestroyer(NULL)
   {                                                                       
     uint8_t *aFirstBlock = (uint8_t*)malloc(_bkSize);                 
 
     _initialBkSize = _bkSize;                                             
+    _allocatedBytes = _bkSize;
+    _usedBytes = 0;
     // Init '_blocks'                                                     
     _blocks = (BlockLink*)aFirstBlock;                                
     _blocks->init(NULL);                                                  
@@ -116,6 +120,8 @@ None
     _top = (uint8_t*)_blocks + _initialBkSize;                                     
     // Reset the block size                                               
     _bkSize = _initialBkSize;                                             
+    _allocatedBytes = _initialBkSize;
+    _usedBytes = 0;
   }                                                                       
 
   /*!                                                                     
@@ -182,14 +188,16 @@ AMD_True if iDefault was used
     {                                                                     
       // In case of a request for a huge block, we just malloc it directly
       aResult = (uint8_t*)malloc(iSize + sizeof(BlockLink));        
+      _allocatedBytes += iSize + sizeof(BlockLink);
       saveBlock((BlockLink*)(aResult + iSize), aResult);              
     }                                                                     
     else                                                                  
     {                                                                     
       uint8_t *aBlock;                                                  
       // We allocate a new block and intend to put other things into it   
-      _bkSize = MIN(_bkSize * 2, 8192);                                   
+      _bkSize = MIN(_bkSize * 2, _maxBkSize);                                   
       aBlock = (uint8_t*)malloc(_bkSize);                               
+      _allocatedBytes += _bkSize;
       aResult = aBlock;                                                   
       if (saveBlock((BlockLink*)aBlock, aBlock))                      
         aResult += sizeof(BlockLink);                                 
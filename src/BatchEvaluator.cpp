@@ -0,0 +1,161 @@
+#include <mdw/formula/BatchEvaluator.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <set>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    // Attributes are identifiers, operators and casts are not
+    bool IsAttribute(const std::string& iSymbol)
+    {
+      return !iSymbol.empty() && (isalpha(iSymbol[0]) || iSymbol[0] == '_');
+    }
+  }
+
+  DependencyCollector::DependencyCollector(ArenaAllocator& ioAllocator):
+    NoopObserver(ioAllocator), _opaque(false)
+  {}
+
+  void DependencyCollector::markUsed(const Expression& iExpression)
+  {
+    Paths::iterator anIt = _paths.find(&iExpression);
+    if (anIt != _paths.end())
+    {
+      anIt->second._used = true;
+    }
+  }
+
+  void DependencyCollector::addFormula(const Expression& iTop)
+  {
+    markUsed(iTop);
+  }
+
+  std::vector<const Expression*> DependencyCollector::getDependencies() const
+  {
+    std::vector<const Expression*> aResult;
+    std::set<std::string> aDisplays;
+    BOOST_FOREACH(const Expression *anExpr, _order)
+    {
+      Paths::const_iterator anIt = _paths.find(anExpr);
+      if ((anIt != _paths.end()) && anIt->second._used &&
+          aDisplays.insert(anExpr->toString()).second)
+      {
+        aResult.push_back(anExpr);
+      }
+    }
+    return aResult;
+  }
+
+  Expression& DependencyCollector::newFact(Expression& ioResult, const std::string& iName)
+  {
+    Path& aPath = _paths[&ioResult];
+    aPath._root = iName;
+    _order.push_back(&ioResult);
+    return ioResult;
+  }
+
+  Expression& DependencyCollector::newSubRule(Expression& ioResult, const std::string& iName)
+  {
+    FORMULA_DEBUG("Dependencies of sub-rule @" << iName << " are unknown");
+    _opaque = true;
+    return ioResult;
+  }
+
+  Expression& DependencyCollector::newUnary(Expression& ioResult,
+                                            Expression& ioRight,
+                                            const std::string& iSymbol)
+  {
+    Paths::iterator anIt = _paths.find(&ioRight);
+    if ((anIt != _paths.end()) && IsAttribute(iSymbol))
+    {
+      std::string aRoot = anIt->second._root;
+      _paths[&ioResult]._root = aRoot;
+      _order.push_back(&ioResult);
+    } else {
+      markUsed(ioRight);
+    }
+    return ioResult;
+  }
+
+  Expression& DependencyCollector::newBinary(Expression& ioResult,
+                                             Expression& ioLeft,
+                                             Expression& ioRight,
+                                             const std::string& iSymbol)
+  {
+    markUsed(ioLeft);
+    markUsed(ioRight);
+    return ioResult;
+  }
+
+  Expression& DependencyCollector::newChoice(Expression& ioResult,
+                                             TypedExpression<bool>& ioCondition,
+                                             Expression& ioLeft,
+                                             Expression& ioRight)
+  {
+    markUsed(ioCondition);
+    markUsed(ioLeft);
+    markUsed(ioRight);
+    return ioResult;
+  }
+
+  Expression& DependencyCollector::newArrow(Expression& ioResult,
+                                            Expression& ioContainer,
+                                            Expression& ioCondition,
+                                            const std::string& iLocalName)
+  {
+    markUsed(ioContainer);
+    markUsed(ioCondition);
+    // Local variables are bound by the arrow itself, not by the records
+    BOOST_FOREACH(Paths::value_type& aPath, _paths)
+    {
+      if (aPath.second._root == iLocalName)
+      {
+        aPath.second._used = false;
+        aPath.second._root.clear();
+      }
+    }
+    return ioResult;
+  }
+
+  BatchEvaluatorBase::BatchEvaluatorBase(const Grammar& iGrammar):
+    _grammar(iGrammar), _collector(_allocator), _deduplicable(true)
+  {}
+
+  Expression& BatchEvaluatorBase::parseRule(const std::string& iFormula)
+  {
+    // The parser keeps a pointer to the formula
+    const std::string& aFormula = _allocator.create<std::string>(iFormula);
+    Parser aParser(_allocator, _grammar);
+    aParser.addObserver(_collector);
+    Expression& aRule = aParser.parse(aFormula);
+    _collector.addFormula(aRule);
+
+    _keys = _collector.getDependencies();
+    _deduplicable = !_collector.isOpaque();
+    BOOST_FOREACH(const Expression *aKey, _keys)
+    {
+      if (!ValueKey::IsSupported(aKey->getType()))
+      {
+        FORMULA_DEBUG("Cannot group records on " << aKey->toString());
+        _deduplicable = false;
+      }
+    }
+    return aRule;
+  }
+
+  bool BatchEvaluatorBase::computeKey(IContext& ioContext, ValueKey& oKey) const
+  {
+    oKey.clear();
+    BOOST_FOREACH(const Expression *aKey, _keys)
+    {
+      if (!oKey.appendValue(*aKey, ioContext))
+      {
+        ioContext.ignoreNaN();
+        return false;
+      }
+    }
+    return true;
+  }
+
+}}
@@ -0,0 +1,173 @@
+#include <mdw/formula/BulkCompiler.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/cache/CostModel.hpp>
+#include <mdw/formula/cache/DagReplayer.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/lexical_cast.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    // Parses and factorizes one shard of the rules, in its own thread
+    class Worker: private boost::noncopyable {
+    public:
+      Worker(const Grammar& iGrammar, const std::vector<std::string>& iFormulas,
+             size_t iBegin, size_t iEnd):
+        _grammar(iGrammar), _formulas(iFormulas), _begin(iBegin), _end(iEnd)
+      {
+        _factorizer.observe(iGrammar);
+        // Only sharing is needed here: the shared Factorizer decides on the rest
+        _factorizer.setCanonicalization(false);
+        _noCache.setCacheLookupCost(std::numeric_limits<double>::max());
+        _factorizer.setCostModel(&_noCache);
+      }
+
+      void run()
+      {
+        Parser aParser(_factorizer.getAllocator(), _grammar);
+        aParser.addObserver(_factorizer);
+        size_t anIndex = _begin;
+        try
+        {
+          for (; anIndex < _end; ++anIndex)
+          {
+            _rules.push_back(&aParser.parse(_formulas[anIndex]));
+          }
+        }
+        catch (const mdw::UnknownException& anException)
+        {
+          _error = "Rule " + mdw::lexical_cast<std::string>(anIndex) + ": " +
+            anException.message();
+        }
+        catch (const std::exception& anException)
+        {
+          _error = "Rule " + mdw::lexical_cast<std::string>(anIndex) + ": " + anException.what();
+        }
+        catch (...)
+        {
+          _error = "Rule " + mdw::lexical_cast<std::string>(anIndex) + ": unknown error";
+        }
+      }
+
+      const Factorizer& getFactorizer() const
+      {
+        return _factorizer;
+      }
+
+      const std::vector<const Expression*>& getRules() const
+      {
+        return _rules;
+      }
+
+      const std::string& getError() const
+      {
+        return _error;
+      }
+
+    private:
+      const Grammar& _grammar;
+      const std::vector<std::string>& _formulas;
+      size_t _begin;
+      size_t _end;
+      CostModel _noCache;
+      Factorizer _factorizer;
+      std::vector<const Expression*> _rules;
+      std::string _error;
+    };
+
+    class Workers: private boost::noncopyable {
+    public:
+      ~Workers()
+      {
+        BOOST_FOREACH(Worker *aWorker, _workers)
+        {
+          delete aWorker;
+        }
+      }
+
+      std::vector<Worker*> _workers;
+    };
+  }
+
+  BulkCompiler::BulkCompiler(const Grammar& iGrammar, Factorizer& ioFactorizer, size_t iThreads):
+    _grammar(iGrammar), _factorizer(ioFactorizer), _threads(iThreads)
+  {
+    if (_threads == 0)
+    {
+      _threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+  }
+
+  void BulkCompiler::compile(const std::vector<std::string>& iFormulas,
+                             std::vector<Expression*>& oRules)
+  {
+    size_t aThreads = std::max(std::min(_threads, iFormulas.size()), (size_t)1);
+    size_t aShard = (iFormulas.size() + aThreads - 1) / aThreads;
+    Workers aWorkers;
+    for (size_t aBegin = 0; aBegin < iFormulas.size(); aBegin += aShard)
+    {
+      size_t anEnd = std::min(aBegin + aShard, iFormulas.size());
+      aWorkers._workers.push_back(new Worker(_grammar, iFormulas, aBegin, anEnd));
+    }
+
+    std::vector<std::thread> aThreadPool;
+    BOOST_FOREACH(Worker *aWorker, aWorkers._workers)
+    {
+      aThreadPool.push_back(std::thread(&Worker::run, aWorker));
+    }
+    BOOST_FOREACH(std::thread& aThread, aThreadPool)
+    {
+      aThread.join();
+    }
+    FORMULA_DEBUG("Parsed " << iFormulas.size() << " rules on " << aThreadPool.size()
+                  << " threads");
+
+    BOOST_FOREACH(const Worker *aWorker, aWorkers._workers)
+    {
+      if (!aWorker->getError().empty())
+      {
+        throw mdw::UnknownException(aWorker->getError());
+      }
+    }
+
+    Parser aParser(_factorizer.getAllocator(), _grammar);
+    aParser.addObserver(_factorizer);
+    oRules.reserve(oRules.size() + iFormulas.size());
+    BOOST_FOREACH(const Worker *aWorker, aWorkers._workers)
+    {
+      DagReplayer aMerger(aWorker->getFactorizer(), aParser);
+      BOOST_FOREACH(const Expression *aRule, aWorker->getRules())
+      {
+        Expression& aMerged = aMerger.replay(*aRule);
+        _factorizer.addRule(aMerged);
+        oRules.push_back(&aMerged);
+      }
+    }
+  }
+
+  void BulkCompiler::compileFile(const std::string& iFileName, std::vector<Expression*>& oRules)
+  {
+    std::ifstream aFile(iFileName.c_str());
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot read rules from " + iFileName);
+    }
+    std::vector<std::string> aFormulas;
+    std::string aLine;
+    while (std::getline(aFile, aLine))
+    {
+      size_t aStart = aLine.find_first_not_of(" \t\r");
+      if ((aStart != std::string::npos) && (aLine[aStart] != '#'))
+      {
+        aFormulas.push_back(aLine);
+      }
+    }
+    compile(aFormulas, oRules);
+  }
+
+}}
@@ -44,6 +44,16 @@ namespace mdw { namespace formula {
       {
         return "(int)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <> class ExpressionCast<const char *, double, void>:
@@ -75,6 +85,16 @@ namespace mdw { namespace formula {
       {
         return "(double)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   template <> class ExpressionCast<const char *, std::string, void>:
@@ -107,6 +127,16 @@ namespace mdw { namespace formula {
       {
         return "(string)(" + _expression.toString() + ")";
       }
+
+      size_t getChildrenCount() const
+      {
+        return 1;
+      }
+
+      const Expression& getChild(size_t iIndex) const
+      {
+        return iIndex ? Expression::getChild(iIndex) : _expression;
+      }
     };
 
   class StrLen: public TypedExpression<int>
@@ -138,6 +168,16 @@ namespace mdw { namespace formula {
     {
       return _expression.toString() + ".count";
     }
+
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _expression;
+    }
   };
 
   class CEmpty: public TypedExpression<bool>
@@ -162,6 +202,16 @@ namespace mdw { namespace formula {
     {
       return _expression.toString() + ".empty";
     }
+
+    size_t getChildrenCount() const
+    {
+      return 1;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      return iIndex ? Expression::getChild(iIndex) : _expression;
+    }
   };
 
   Expression& CString::CStringUnary::instantiate(ArenaAllocator& ioAllocator,
@@ -282,6 +332,24 @@ namespace mdw { namespace formula {
       return "(" + _cstring.toString() + "[" + _index.toString() + "])";
     }
 
+    size_t getChildrenCount() const
+    {
+      return 2;
+    }
+
+    const Expression& getChild(size_t iIndex) const
+    {
+      switch (iIndex)
+      {
+        case 0:
+          return _cstring;
+        case 1:
+          return _index;
+        default:
+          return Expression::getChild(iIndex);
+      }
+    }
+
     TypeTraits<char>::ReturnType evaluate(IContext& ioContext) const
     {
       TypeTraits<int>::ReturnType anIndex = _index.evaluate(ioContext);
@@ -0,0 +1,122 @@
+#include <mdw/formula/cache/CacheStatistics.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    void PrintJsonString(std::ostream& oStream, const std::string& iValue)
+    {
+      static const char kHex[] = "0123456789abcdef";
+      oStream << '"';
+      BOOST_FOREACH(char aChar, iValue)
+      {
+        if (aChar == '"' || aChar == '\\')
+        {
+          oStream << '\\' << aChar;
+        } else if ((unsigned char)aChar < 0x20) {
+          oStream << "\\u00" << kHex[(aChar >> 4) & 0xf] << kHex[aChar & 0xf];
+        } else {
+          oStream << aChar;
+        }
+      }
+      oStream << '"';
+    }
+
+    void PrintJsonCounters(std::ostream& oStream, const CacheStatistics& iStatistics)
+    {
+      oStream << "\"lookups\":" << iStatistics._lookups
+              << ",\"hits\":" << iStatistics._hits
+              << ",\"misses\":" << iStatistics._misses
+              << ",\"invalidations\":" << iStatistics._invalidations
+              << ",\"entries\":" << iStatistics._entries
+              << ",\"bytes\":" << iStatistics._bytes;
+    }
+  }
+
+  CacheStatistics& CacheStatistics::operator+=(const CacheStatistics& iOther)
+  {
+    _lookups += iOther._lookups;
+    _hits += iOther._hits;
+    _misses += iOther._misses;
+    _invalidations += iOther._invalidations;
+    _entries += iOther._entries;
+    _bytes += iOther._bytes;
+    return *this;
+  }
+
+  std::ostream& operator<<(std::ostream& oStream, const CacheStatistics& iStatistics)
+  {
+    oStream << "lookups=" << iStatistics._lookups
+            << " hits=" << iStatistics._hits
+            << " misses=" << iStatistics._misses
+            << " invalidations=" << iStatistics._invalidations
+            << " entries=" << iStatistics._entries
+            << " bytes=" << iStatistics._bytes
+            << " hitRatio=" << iStatistics.getHitRatio();
+    return oStream;
+  }
+
+  void CacheRegistry::add(const CacheIntrospection& iCache)
+  {
+    _caches.push_back(&iCache);
+  }
+
+  void CacheRegistry::remove(const CacheIntrospection& iCache)
+  {
+    _caches.erase(std::remove(_caches.begin(), _caches.end(), &iCache), _caches.end());
+  }
+
+  void CacheRegistry::clear()
+  {
+    _caches.clear();
+  }
+
+  CacheStatistics CacheRegistry::getTotal() const
+  {
+    CacheStatistics aTotal;
+    BOOST_FOREACH(const CacheIntrospection *aCache, _caches)
+    {
+      aTotal += aCache->getCacheStatistics();
+    }
+    return aTotal;
+  }
+
+  void CacheRegistry::resetStatistics() const
+  {
+    BOOST_FOREACH(const CacheIntrospection *aCache, _caches)
+    {
+      aCache->resetCacheStatistics();
+    }
+  }
+
+  void CacheRegistry::printText(std::ostream& oStream) const
+  {
+    BOOST_FOREACH(const CacheIntrospection *aCache, _caches)
+    {
+      oStream << aCache->getCacheDescription() << ": " << aCache->getCacheStatistics() << "\n";
+    }
+    oStream << "Total (" << _caches.size() << " caches): " << getTotal() << "\n";
+  }
+
+  void CacheRegistry::printJson(std::ostream& oStream) const
+  {
+    oStream << "{\"total\":{";
+    PrintJsonCounters(oStream, getTotal());
+    oStream << "},\"caches\":[";
+    for (size_t i = 0; i < _caches.size(); ++i)
+    {
+      if (i)
+      {
+        oStream << ",";
+      }
+      oStream << "{\"description\":";
+      PrintJsonString(oStream, _caches[i]->getCacheDescription());
+      oStream << ",";
+      PrintJsonCounters(oStream, _caches[i]->getCacheStatistics());
+      oStream << "}";
+    }
+    oStream << "]}";
+  }
+
+}}
@@ -0,0 +1,120 @@
+#include <mdw/formula/CompileCache.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/Tracer.hpp>
+#include <cctype>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    bool IsWord(char iChar)
+    {
+      return isalnum((unsigned char)iChar) || (iChar == '_') || (iChar == '.') ||
+        (iChar == '$') || (iChar == '@');
+    }
+
+    // Characters which may be part of a multi-character operator (>=, ->, :=...)
+    bool IsOperator(char iChar)
+    {
+      return !IsWord(iChar) && !isspace((unsigned char)iChar) && (iChar != '(') &&
+        (iChar != ')') && (iChar != '[') && (iChar != ']') && (iChar != ',') &&
+        (iChar != '"') && (iChar != '\'');
+    }
+  }
+
+  CompileCache::CompileCache(ArenaAllocator& ioAllocator):
+    _allocator(ioAllocator), _bytes(0)
+  {}
+
+  std::string CompileCache::Normalize(const std::string& iFormula)
+  {
+    std::string aResult;
+    aResult.reserve(iFormula.size());
+    size_t i = 0;
+    while (i < iFormula.size())
+    {
+      char aChar = iFormula[i];
+      if ((aChar == '"') || (aChar == '\''))
+      {
+        // Literals are kept as they are
+        size_t anEnd = i + 1;
+        while ((anEnd < iFormula.size()) && (iFormula[anEnd] != aChar))
+        {
+          anEnd += (iFormula[anEnd] == '\\') ? 2 : 1;
+        }
+        anEnd = std::min(anEnd + 1, iFormula.size());
+        aResult.append(iFormula, i, anEnd - i);
+        i = anEnd;
+      } else if (isspace((unsigned char)aChar)) {
+        while ((i < iFormula.size()) && isspace((unsigned char)iFormula[i]))
+        {
+          ++i;
+        }
+        // A blank only matters if it separates two tokens that would otherwise merge
+        if (!aResult.empty() && (i < iFormula.size()))
+        {
+          char aPrevious = aResult[aResult.size() - 1];
+          char aNext = iFormula[i];
+          if ((IsWord(aPrevious) && IsWord(aNext)) ||
+              (IsOperator(aPrevious) && IsOperator(aNext)))
+          {
+            aResult += ' ';
+          }
+        }
+      } else {
+        aResult += aChar;
+        ++i;
+      }
+    }
+    return aResult;
+  }
+
+  Expression& CompileCache::compile(const Grammar& iGrammar, const std::string& iFormula)
+  {
+    Parser aParser(_allocator, iGrammar);
+    return compile(aParser, iFormula);
+  }
+
+  Expression& CompileCache::compile(Parser& ioParser, const std::string& iFormula)
+  {
+    ++_statistics._lookups;
+    Key aKey(ioParser.getGrammar().getUniqueId(), Normalize(iFormula));
+    Expressions::const_iterator anIt = _expressions.find(aKey);
+    if (anIt != _expressions.end())
+    {
+      ++_statistics._hits;
+      return *anIt->second;
+    }
+    ++_statistics._misses;
+    Expression& anExpression = ioParser.parse(iFormula);
+    _bytes += aKey.second.size() + sizeof(Expressions::value_type);
+    _expressions[aKey] = &anExpression;
+    FORMULA_DEBUG("Compiled formula: " << aKey.second);
+    return anExpression;
+  }
+
+  void CompileCache::clear()
+  {
+    _statistics._invalidations += _expressions.size();
+    _expressions.clear();
+    _bytes = 0;
+  }
+
+  CacheStatistics CompileCache::getCacheStatistics() const
+  {
+    CacheStatistics aStatistics(_statistics);
+    aStatistics._entries = _expressions.size();
+    aStatistics._bytes = _bytes;
+    return aStatistics;
+  }
+
+  void CompileCache::resetCacheStatistics() const
+  {
+    _statistics.reset();
+  }
+
+  std::string CompileCache::getCacheDescription() const
+  {
+    return "compiled formulas";
+  }
+
+}}
@@ -1,4 +1,5 @@
 #include <mdw/formula/Container.hpp>
+#include <mdw/formula/CompileCache.hpp>
 #include <mdw/formula/Expression.hpp>
 #include <mdw/formula/Grammar.hpp>
 #include <mdw/formula/Parser.hpp>
@@ -7,15 +8,23 @@
 namespace mdw { namespace formula {
 
   Container::Container(const std::string& iFormula, const Grammar& iGrammar):
-    _allocator(*new ArenaAllocator()),
+    _allocator(new ArenaAllocator()),
     _knownTypes(iGrammar),
-    _topExpression(Parser(_allocator, iGrammar, iFormula).getTopExpression())
+    _topExpression(Parser(*_allocator, iGrammar, iFormula).getTopExpression())
   {
   }
-  
+
+  Container::Container(const std::string& iFormula, const Grammar& iGrammar,
+                       CompileCache& ioCache):
+    _allocator(NULL),
+    _knownTypes(iGrammar),
+    _topExpression(ioCache.compile(iGrammar, iFormula))
+  {
+  }
+
   Container::~Container()
   {
-    delete (&_allocator);
+    delete _allocator;
   }
 
   const Expression& Container::getExpression() const
@@ -0,0 +1,175 @@
+#include <mdw/formula/cache/CostCalibrator.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/Constant.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <chrono>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    double ElapsedNanos(const std::chrono::steady_clock::time_point& iStart, size_t iIterations)
+    {
+      std::chrono::steady_clock::duration aDuration = std::chrono::steady_clock::now() - iStart;
+      return std::chrono::duration<double, std::nano>(aDuration).count() / iIterations;
+    }
+  }
+
+  CostCalibrator::CostCalibrator(ArenaAllocator& ioAllocator,
+                                 IContext& ioSampleContext,
+                                 CostModel& ioModel,
+                                 size_t iIterations):
+    NoopObserver(ioAllocator), _context(ioSampleContext), _model(ioModel),
+    _iterations(iIterations ? iIterations : 1)
+  {}
+
+  void CostCalibrator::calibrate(const Grammar& iGrammar,
+                                 const std::vector<std::string>& iSamples)
+  {
+    Parser aParser(getAllocator(), iGrammar);
+    aParser.addObserver(*this);
+    BOOST_FOREACH(const std::string& aSample, iSamples)
+    {
+      aParser.parse(aSample);
+    }
+    calibrateFixedCosts();
+  }
+
+  void CostCalibrator::calibrateFixedCosts()
+  {
+    ConstExpression<int> aBasic(1);
+    double aUnit = measure(aBasic);
+    if (aUnit > 0)
+    {
+      _model.setUnitCost(aUnit);
+    }
+
+    // Same container and keys as the one used by UnaryCachedByAddress
+    typedef boost::unordered_map<const void*, std::pair<bool, int64_t> > Cache;
+    static const size_t kEntries = 64;
+    Cache aCache;
+    std::vector<int64_t> aKeys(kEntries);
+    for (size_t i = 0; i < kEntries; ++i)
+    {
+      aCache[&aKeys[i]] = std::make_pair(false, (int64_t)i);
+    }
+    int64_t aSum = 0;
+    std::chrono::steady_clock::time_point aStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < _iterations; ++i)
+    {
+      Cache::const_iterator anIt = aCache.find(&aKeys[i % kEntries]);
+      if (anIt != aCache.end())
+      {
+        aSum += anIt->second.second;
+      }
+    }
+    double aLookup = ElapsedNanos(aStart, _iterations);
+    FORMULA_DEBUG("Calibrated cache lookup: " << aLookup << "ns (" << aSum << ")");
+    _model.setCacheLookupCost(aLookup + _model.getUnitCost());
+  }
+
+  double CostCalibrator::measure(const Expression& iExpression)
+  {
+    try {
+      // First evaluation is a warm-up, and checks the sample context is complete
+      iExpression.evaluateUntyped(_context);
+      if (_context.isNaN())
+      {
+        _context.ignoreNaN();
+        return -1;
+      }
+      std::chrono::steady_clock::time_point aStart = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < _iterations; ++i)
+      {
+        iExpression.evaluateUntyped(_context);
+      }
+      _context.ignoreNaN();
+      return ElapsedNanos(aStart, _iterations);
+    } catch (const ValueException&) {
+    } catch (const mdw::UnknownException&) {
+    }
+    _context.ignoreNaN();
+    return -1;
+  }
+
+  double CostCalibrator::getTotal(const Expression& iExpression) const
+  {
+    Totals::const_iterator anIt = _totals.find(&iExpression);
+    if (anIt != _totals.end() && anIt->second > 0)
+    {
+      return anIt->second;
+    }
+    return 0;
+  }
+
+  void CostCalibrator::record(const Expression& iExpression, double iChildrenNanos)
+  {
+    double aTotal = measure(iExpression);
+    _totals[&iExpression] = aTotal;
+    if (aTotal < 0)
+    {
+      FORMULA_DEBUG("Cannot calibrate with the sample context: " << iExpression.toString());
+      return;
+    }
+    double aOwn = aTotal - iChildrenNanos;
+    // Timer noise may make cheap nodes look free: they never are
+    if (aOwn < aTotal / 100)
+    {
+      aOwn = aTotal / 100;
+    }
+    _model.addMeasure(CostModel::GetKind(iExpression), aOwn);
+  }
+
+  Expression& CostCalibrator::newConstant(Expression& ioResult)
+  {
+    record(ioResult, 0);
+    return ioResult;
+  }
+
+  Expression& CostCalibrator::newFact(Expression& ioResult, const std::string& iName)
+  {
+    record(ioResult, 0);
+    return ioResult;
+  }
+
+  Expression& CostCalibrator::newUnary(Expression& ioResult,
+                                       Expression& ioRight,
+                                       const std::string& iSymbol)
+  {
+    record(ioResult, getTotal(ioRight));
+    return ioResult;
+  }
+
+  Expression& CostCalibrator::newBinary(Expression& ioResult,
+                                        Expression& ioLeft,
+                                        Expression& ioRight,
+                                        const std::string& iSymbol)
+  {
+    record(ioResult, getTotal(ioLeft) + getTotal(ioRight));
+    return ioResult;
+  }
+
+  Expression& CostCalibrator::newChoice(Expression& ioResult,
+                                        TypedExpression<bool>& ioCondition,
+                                        Expression& ioLeft,
+                                        Expression& ioRight)
+  {
+    // Only one branch is evaluated: count the average of both
+    record(ioResult, getTotal(ioCondition) + (getTotal(ioLeft) + getTotal(ioRight)) / 2);
+    return ioResult;
+  }
+
+  Expression& CostCalibrator::newArrow(Expression& ioResult,
+                                       Expression& ioContainer,
+                                       Expression& ioCondition,
+                                       const std::string& iLocalName)
+  {
+    // The condition needs the local variable: its cost stays in the arrow
+    record(ioResult, getTotal(ioContainer));
+    return ioResult;
+  }
+
+}}
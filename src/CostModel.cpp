@@ -0,0 +1,134 @@
+#include <mdw/formula/cache/CostModel.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/UnknownException.hpp>
+#include <boost/foreach.hpp>
+#include <fstream>
+#include <sstream>
+#include <typeinfo>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    const char kHeader[] = "formula-cost-model";
+    const size_t kVersion = 1;
+
+    // Historical values, used as long as the model is not calibrated
+    const double kDefaultUnitCost = 1.;
+    const double kDefaultCacheLookupCost = 5.;
+  }
+
+  CostModel::CostModel():
+    _unitCost(kDefaultUnitCost), _cacheLookupCost(kDefaultCacheLookupCost), _calibrated(false)
+  {}
+
+  std::string CostModel::GetKind(const Expression& iExpression)
+  {
+    return typeid(iExpression).name();
+  }
+
+  double CostModel::getCost(const Expression& iExpression) const
+  {
+    if (!_costs.empty())
+    {
+      Costs::const_iterator anIt = _costs.find(GetKind(iExpression));
+      if (anIt != _costs.end())
+      {
+        return anIt->second._nanos;
+      }
+    }
+    return iExpression.complexity() * _unitCost;
+  }
+
+  bool CostModel::hasCost(const std::string& iKind) const
+  {
+    return _costs.find(iKind) != _costs.end();
+  }
+
+  void CostModel::addMeasure(const std::string& iKind, double iNanos, size_t iSamples)
+  {
+    NodeCost& aCost = _costs[iKind];
+    aCost._nanos = (aCost._nanos * aCost._samples + iNanos * iSamples) /
+      (aCost._samples + iSamples);
+    aCost._samples += iSamples;
+    _calibrated = true;
+  }
+
+  void CostModel::setCost(const std::string& iKind, double iNanos)
+  {
+    NodeCost& aCost = _costs[iKind];
+    aCost._nanos = iNanos;
+    aCost._samples = 1;
+    _calibrated = true;
+  }
+
+  void CostModel::save(std::ostream& oStream) const
+  {
+    oStream << kHeader << " " << kVersion << "\n";
+    oStream << "unit " << _unitCost << "\n";
+    oStream << "cache " << _cacheLookupCost << "\n";
+    BOOST_FOREACH(const Costs::value_type& aCost, _costs)
+    {
+      oStream << "node " << aCost.first << " " << aCost.second._nanos << " "
+              << aCost.second._samples << "\n";
+    }
+  }
+
+  void CostModel::load(std::istream& iStream)
+  {
+    std::string aHeader;
+    size_t aVersion = 0;
+    iStream >> aHeader >> aVersion;
+    if (aHeader != kHeader || aVersion != kVersion)
+    {
+      throw mdw::UnknownException("Not a cost model or unsupported version: " + aHeader);
+    }
+    std::string aLine;
+    while (std::getline(iStream, aLine))
+    {
+      std::istringstream aFields(aLine);
+      std::string aTag;
+      if (!(aFields >> aTag))
+      {
+        continue;
+      }
+      if (aTag == "unit")
+      {
+        aFields >> _unitCost;
+      } else if (aTag == "cache") {
+        aFields >> _cacheLookupCost;
+      } else if (aTag == "node") {
+        std::string aKind;
+        NodeCost aCost;
+        if (!(aFields >> aKind >> aCost._nanos >> aCost._samples))
+        {
+          throw mdw::UnknownException("Invalid cost model entry: " + aLine);
+        }
+        _costs[aKind] = aCost;
+      } else {
+        throw mdw::UnknownException("Unknown cost model entry: " + aLine);
+      }
+    }
+    _calibrated = true;
+  }
+
+  void CostModel::save(const std::string& iFileName) const
+  {
+    std::ofstream aFile(iFileName.c_str());
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot write cost model to " + iFileName);
+    }
+    save(aFile);
+  }
+
+  void CostModel::load(const std::string& iFileName)
+  {
+    std::ifstream aFile(iFileName.c_str());
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot read cost model from " + iFileName);
+    }
+    load(aFile);
+  }
+
+}}
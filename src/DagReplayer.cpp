@@ -0,0 +1,139 @@
+#include <mdw/formula/cache/DagReplayer.hpp>
+#include <mdw/formula/cache/PassManager.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/UnknownException.hpp>
+#include <boost/foreach.hpp>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    // The parsed expressions of a Factorizer
+    class FactorizerSource: public DagReplayer::Source {
+    public:
+      explicit FactorizerSource(const Factorizer& iDag):
+        _dag(iDag)
+      {}
+
+      const Factorizer::NodeKey& getNodeKey(size_t iId) const
+      {
+        return _dag.getNodeKey(iId);
+      }
+
+      Expression& createConstant(size_t iId, Parser& ioTarget) const
+      {
+        const Expression& aConstant = _dag.getParsedExpression(iId);
+        switch (aConstant.getType())
+        {
+          case kExprBool:
+            return ioTarget.createConstant<bool>(aConstant.getBool().evaluate(_context));
+          case kExprInt:
+            return ioTarget.createConstant<int64_t>(aConstant.getInt().evaluate(_context));
+          case kExprDouble:
+            return ioTarget.createConstant<double>(aConstant.getDouble().evaluate(_context));
+          case kExprString:
+            {
+              // The constant only refers to its value
+              const std::string& aValue = aConstant.getString().evaluate(_context);
+              return ioTarget.createConstant<std::string>(
+                ioTarget.createString(aValue.data(), aValue.size()));
+            }
+          default:
+            throw mdw::UnknownException("Cannot replay constant: " + aConstant.toString());
+        }
+      }
+
+    private:
+      const Factorizer& _dag;
+      mutable IContext _context;
+    };
+  }
+
+  DagReplayer::DagReplayer(const Factorizer& iSource, Parser& ioTarget, RewritePass *ioPass):
+    _dag(&iSource), _ownSource(new FactorizerSource(iSource)), _source(*_ownSource),
+    _target(ioTarget), _pass(ioPass)
+  {}
+
+  DagReplayer::DagReplayer(const Source& iSource, Parser& ioTarget):
+    _dag(NULL), _ownSource(NULL), _source(iSource), _target(ioTarget), _pass(NULL)
+  {}
+
+  DagReplayer::~DagReplayer()
+  {
+    delete _ownSource;
+  }
+
+  Expression& DagReplayer::replay(const Expression& iRule)
+  {
+    return replay(_dag->getNodeId(iRule), 0);
+  }
+
+  Expression& DagReplayer::replay(size_t iId)
+  {
+    return replay(iId, 0);
+  }
+
+  // Nodes below a local variable are not memoized: their facts depend on the scope
+  Expression& DagReplayer::replay(size_t iId, size_t iLocals)
+  {
+    if (iLocals == 0)
+    {
+      Memo::const_iterator aDone = _memo.find(iId);
+      if (aDone != _memo.end())
+      {
+        return *aDone->second;
+      }
+    }
+    const Factorizer::NodeKey& aKey = _source.getNodeKey(iId);
+    const Factorizer::Children& aChildren = aKey.second;
+    Expression *aResult = NULL;
+    if (aKey.first[0] == '-')
+    {
+      std::string aName = aKey.first.substr(3);
+      Expression& aContainer = replay(aChildren[0], iLocals);
+      _target.declareLocal(aContainer, aName.c_str());
+      Expression& aCondition = replay(aChildren[1], iLocals + 1);
+      aResult = &_target.createArrowOperator(aContainer, aCondition, aName.c_str());
+      _target.popLocal(aName.c_str());
+    } else {
+      std::vector<Expression*> aReplayed;
+      BOOST_FOREACH(size_t aChild, aChildren)
+      {
+        aReplayed.push_back(&replay(aChild, iLocals));
+      }
+      aResult = _pass ? _pass->rewrite(*_dag, aKey, aReplayed, _target) : NULL;
+      if (!aResult)
+      {
+        aResult = &instantiate(iId, aKey, aReplayed);
+      }
+    }
+    if (iLocals == 0)
+    {
+      _memo[iId] = aResult;
+    }
+    return *aResult;
+  }
+
+  Expression& DagReplayer::instantiate(size_t iId, const Factorizer::NodeKey& iKey,
+                                       const std::vector<Expression*>& iChildren)
+  {
+    std::string aName = (iKey.first.size() > 2) ? iKey.first.substr(2) : "";
+    switch (iKey.first[0])
+    {
+      case 'c':
+        return _source.createConstant(iId, _target);
+      case 'f':
+        return _target.createFact(aName.c_str());
+      case 'r':
+        return _target.createSubRule(aName.c_str());
+      case 'u':
+        return _target.createUnaryOperator(*iChildren[0], aName);
+      case 'b':
+        return _target.createBinaryOperator(*iChildren[0], *iChildren[1], aName);
+      case '?':
+        return _target.createChoice(*iChildren[0], *iChildren[1], *iChildren[2]);
+      default:
+        throw mdw::UnknownException("Cannot replay node of kind: " + iKey.first);
+    }
+  }
+
+}}
@@ -0,0 +1,249 @@
+#include <mdw/formula/DecisionDiagram.hpp>
+#include <algorithm>
+
+namespace mdw { namespace formula {
+
+  DecisionDiagram::DecisionDiagram(const std::vector<uint32_t>& iOrder, size_t iMaxSize):
+    _maxSize(iMaxSize), _size(0), _full(false), _root(0)
+  {
+    uint32_t aMaxAtom = 0;
+    for (size_t i = 0; i < iOrder.size(); ++i)
+    {
+      aMaxAtom = std::max(aMaxAtom, iOrder[i] + 1);
+    }
+    _levels.resize(aMaxAtom, 0);
+    for (size_t i = 0; i < iOrder.size(); ++i)
+    {
+      _levels[iOrder[i]] = i;
+    }
+    // The constant functions, numbered by their value
+    for (uint32_t aValue = kFalse; aValue <= kUnknown; ++aValue)
+    {
+      Node aConstant;
+      aConstant._atom = kLeaf;
+      aConstant._children[0] = aValue;
+      aConstant._children[1] = aConstant._children[2] = 0;
+      _functions.push_back(aConstant);
+    }
+    _root = makeLeaf(std::vector<uint32_t>());
+  }
+
+  uint32_t DecisionDiagram::getLevel(const Nodes& iNodes, uint32_t iNode) const
+  {
+    uint32_t anAtom = iNodes[iNode]._atom;
+    return (anAtom == kLeaf) ? kLeaf : _levels[anAtom];
+  }
+
+  uint32_t DecisionDiagram::GetChild(const Nodes& iNodes, uint32_t iNode, uint32_t iAtom,
+                                     size_t iValue)
+  {
+    const Node& aNode = iNodes[iNode];
+    return (aNode._atom == iAtom) ? aNode._children[iValue] : iNode;
+  }
+
+  void DecisionDiagram::grow(size_t iSize)
+  {
+    _size += iSize;
+    if (_size > _maxSize)
+    {
+      _full = true;
+    }
+  }
+
+  uint32_t DecisionDiagram::makeNode(Nodes& ioNodes, UniqueNodes& ioUnique, uint32_t iAtom,
+                                     const uint32_t *iChildren)
+  {
+    // A node whose children are all the same does not need to test its atom
+    if ((iChildren[0] == iChildren[1]) && (iChildren[1] == iChildren[2]))
+    {
+      return iChildren[0];
+    }
+    Node aNode;
+    aNode._atom = iAtom;
+    std::copy(iChildren, iChildren + 3, aNode._children);
+    UniqueNodes::const_iterator aKnown = ioUnique.find(aNode);
+    if (aKnown != ioUnique.end())
+    {
+      return aKnown->second;
+    } else if (_full) {
+      return iChildren[0];
+    }
+    uint32_t anId = ioNodes.size();
+    ioNodes.push_back(aNode);
+    ioUnique.insert(std::make_pair(aNode, anId));
+    grow(1);
+    return anId;
+  }
+
+  uint32_t DecisionDiagram::makeLeaf(const std::vector<uint32_t>& iRules)
+  {
+    uint32_t aLeaf = _leaves.size();
+    std::pair<LeafIds::iterator, bool> anInserted =
+      _leafIds.insert(std::make_pair(iRules, aLeaf));
+    if (anInserted.second)
+    {
+      _leaves.push_back(iRules);
+      grow(iRules.size());
+    } else {
+      aLeaf = anInserted.first->second;
+    }
+    Node aNode;
+    aNode._atom = kLeaf;
+    aNode._children[0] = aLeaf;
+    aNode._children[1] = aNode._children[2] = 0;
+    UniqueNodes::const_iterator aKnown = _uniqueNodes.find(aNode);
+    if (aKnown != _uniqueNodes.end())
+    {
+      return aKnown->second;
+    }
+    uint32_t anId = _nodes.size();
+    _nodes.push_back(aNode);
+    _uniqueNodes.insert(std::make_pair(aNode, anId));
+    grow(1);
+    return anId;
+  }
+
+  DecisionDiagram::Function DecisionDiagram::atom(uint32_t iAtom)
+  {
+    uint32_t aChildren[] = {kFalse, kTrue, kUnknown};
+    return makeNode(_functions, _uniqueFunctions, iAtom, aChildren);
+  }
+
+  DecisionDiagram::Function DecisionDiagram::negate(Function iFunction)
+  {
+    if (_full)
+    {
+      return kUnknown;
+    } else if (iFunction <= kTrue) {
+      return kTrue - iFunction;
+    } else if (iFunction == kUnknown) {
+      return kUnknown;
+    }
+    Operands anOperands(iFunction, 0);
+    Results::const_iterator aKnown = _negations.find(anOperands);
+    if (aKnown != _negations.end())
+    {
+      return aKnown->second;
+    }
+    // Copied, as the recursion may reallocate the nodes
+    Node aNode = _functions[iFunction];
+    uint32_t aChildren[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+      aChildren[i] = negate(aNode._children[i]);
+    }
+    Function aResult = makeNode(_functions, _uniqueFunctions, aNode._atom, aChildren);
+    _negations[anOperands] = aResult;
+    return aResult;
+  }
+
+  DecisionDiagram::Function DecisionDiagram::conjunction(Function iLeft, Function iRight)
+  {
+    return combine(iLeft, iRight, true, _conjunctions);
+  }
+
+  DecisionDiagram::Function DecisionDiagram::disjunction(Function iLeft, Function iRight)
+  {
+    return combine(iLeft, iRight, false, _disjunctions);
+  }
+
+  // As the standard operators: both operands of && are evaluated, and an exception
+  // or NaN of either one goes through, while || ignores them in its left operand.
+  // The constant cases all end here.
+  DecisionDiagram::Function DecisionDiagram::combine(Function iLeft, Function iRight,
+                                                     bool iConjunction, Results& ioResults)
+  {
+    if (_full)
+    {
+      return kUnknown;
+    } else if (iConjunction) {
+      if ((iLeft == kUnknown) || (iRight == kUnknown))
+      {
+        return kUnknown;
+      } else if ((iLeft == kTrue) || (iLeft == iRight)) {
+        return iRight;
+      } else if (iRight == kTrue) {
+        return iLeft;
+      }
+    } else if ((iLeft == kTrue) || (iRight == kTrue)) {
+      return kTrue;
+    } else if ((iLeft == kFalse) || (iLeft == kUnknown) || (iLeft == iRight)) {
+      return iRight;
+    }
+    // Only && is commutative
+    Operands anOperands(iLeft, iRight);
+    if (iConjunction && (iRight < iLeft))
+    {
+      std::swap(anOperands.first, anOperands.second);
+    }
+    Results::const_iterator aKnown = ioResults.find(anOperands);
+    if (aKnown != ioResults.end())
+    {
+      return aKnown->second;
+    }
+    uint32_t anAtom = (getLevel(_functions, iLeft) < getLevel(_functions, iRight)) ?
+      _functions[iLeft]._atom : _functions[iRight]._atom;
+    uint32_t aChildren[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+      aChildren[i] = combine(GetChild(_functions, iLeft, anAtom, i),
+                             GetChild(_functions, iRight, anAtom, i), iConjunction,
+                             ioResults);
+    }
+    Function aResult = makeNode(_functions, _uniqueFunctions, anAtom, aChildren);
+    ioResults[anOperands] = aResult;
+    return aResult;
+  }
+
+  void DecisionDiagram::addRule(Function iFunction, uint32_t iRule)
+  {
+    _merged.clear();
+    uint32_t aRoot = merge(_root, iFunction, iRule);
+    if (!_full)
+    {
+      _root = aRoot;
+    }
+  }
+
+  uint32_t DecisionDiagram::merge(uint32_t iNode, Function iFunction, uint32_t iRule)
+  {
+    if (_full || (iFunction == kFalse) || (iFunction == kUnknown))
+    {
+      return iNode;
+    } else if ((iFunction == kTrue) && (_nodes[iNode]._atom == kLeaf)) {
+      std::vector<uint32_t> aRules(_leaves[_nodes[iNode]._children[0]]);
+      aRules.push_back(iRule);
+      return makeLeaf(aRules);
+    }
+    Operands anOperands(iNode, iFunction);
+    Results::const_iterator aKnown = _merged.find(anOperands);
+    if (aKnown != _merged.end())
+    {
+      return aKnown->second;
+    }
+    uint32_t anAtom = (getLevel(_nodes, iNode) < getLevel(_functions, iFunction)) ?
+      _nodes[iNode]._atom : _functions[iFunction]._atom;
+    uint32_t aChildren[3];
+    for (size_t i = 0; i < 3; ++i)
+    {
+      aChildren[i] = merge(GetChild(_nodes, iNode, anAtom, i),
+                           GetChild(_functions, iFunction, anAtom, i), iRule);
+    }
+    uint32_t aResult = makeNode(_nodes, _uniqueNodes, anAtom, aChildren);
+    _merged[anOperands] = aResult;
+    return aResult;
+  }
+
+  void DecisionDiagram::shrink()
+  {
+    Nodes().swap(_functions);
+    UniqueNodes().swap(_uniqueFunctions);
+    Results().swap(_negations);
+    Results().swap(_conjunctions);
+    Results().swap(_disjunctions);
+    UniqueNodes().swap(_uniqueNodes);
+    Results().swap(_merged);
+    LeafIds().swap(_leafIds);
+  }
+
+}}
@@ -72,6 +72,17 @@ namespace mdw { namespace formula {
     return 1;
   }
 
+  size_t Expression::getChildrenCount() const
+  {
+    return 0;
+  }
+
+  const Expression& Expression::getChild(size_t iIndex) const
+  {
+    throw mdw::UnknownException("Expression " + toString() + " has no child " +
+                                mdw::lexical_cast<std::string>(iIndex));
+  }
+
   template <> TypedExpression<bool>& Expression::get<bool>()
   {
     return getBool();
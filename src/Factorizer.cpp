@@ -1,29 +1,84 @@
 #include <mdw/formula/cache/Factorizer.hpp>
+#include <mdw/formula/cache/ProfiledExpression.hpp>
+#include <mdw/formula/cache/DagReplayer.hpp>
+#include <mdw/formula/Grammar.hpp>
 #include <mdw/UnknownException.hpp>
+#include <mdw/lexical_cast.hpp>
 #include <boost/foreach.hpp>
+#include <algorithm>
 
 namespace mdw { namespace formula {
 
-  Factorizer::KnownExpression::KnownExpression(Expression& ioExpression, Factorizer& ioParent):
-    _expression(ioExpression), _parent(ioParent), _type(ioExpression.getType()),
-    _totalComplexity(ioExpression.complexity()), _toString(ioExpression.toString()),
-    _optimized(&ioExpression)
+  namespace {
+    // Below this number of samples, a profile entry is not trusted
+    const size_t kMinProfileSamples = 100;
+
+    bool IsStandardType(ExpressionType iType)
+    {
+      return (iType == kExprBool) || (iType == kExprInt) || (iType == kExprDouble) ||
+        (iType == kExprString);
+    }
+
+    bool IsAssociative(const std::string& iSymbol, ExpressionType iType)
+    {
+      // Floating point + and * are not associative
+      return ((iSymbol == "&&") && (iType == kExprBool)) ||
+        (((iSymbol == "+") || (iSymbol == "*")) && (iType == kExprInt));
+    }
+
+    bool IsCommutative(const std::string& iSymbol, ExpressionType iType)
+    {
+      // + on strings is a concatenation
+      return (iSymbol == "==") || (iSymbol == "!=") || ((iSymbol == "&&") && (iType == kExprBool)) ||
+        (((iSymbol == "+") || (iSymbol == "*")) && ((iType == kExprInt) || (iType == kExprDouble)));
+    }
+
+    // Symbol to use once the operands are swapped, empty if they cannot be
+    std::string GetMirror(const std::string& iSymbol, ExpressionType iType)
+    {
+      if (IsCommutative(iSymbol, iType))
+      {
+        return iSymbol;
+      } else if (iSymbol == "<") {
+        return ">";
+      } else if (iSymbol == ">") {
+        return "<";
+      } else if (iSymbol == "<=") {
+        return ">=";
+      } else if (iSymbol == ">=") {
+        return "<=";
+      }
+      return "";
+    }
+  }
+
+  Factorizer::KnownExpression::KnownExpression(Expression& ioExpression, size_t iId,
+                                               const CostModel& iCostModel):
+    _expression(ioExpression), _id(iId), _key(NULL), _type(ioExpression.getType()),
+    _totalCost(iCostModel.getCost(ioExpression)), _optimized(&ioExpression), _cache(NULL),
+    _counters(NULL), _references(0)
   {}
 
-  void Factorizer::KnownExpression::addDependency(const Expression& iExpression)
+  void Factorizer::KnownExpression::addDependency(KnownExpression& ioChild)
   {
-    KnownExpression *aKnown = _parent.getKnown(iExpression);
-    if (aKnown)
+    if (_usedFacts.size() < ioChild._usedFacts.size())
     {
-      _usedFacts.insert(aKnown->_usedFacts.begin(), aKnown->_usedFacts.end());
-      _totalComplexity += aKnown->_totalComplexity;
-    } else {
-      throw mdw::UnknownException("Could not find known expression: " + iExpression.toString());
+      _usedFacts.resize(ioChild._usedFacts.size());
+    }
+    for (FactSet::size_type aFact = ioChild._usedFacts.find_first();
+         aFact != FactSet::npos;
+         aFact = ioChild._usedFacts.find_next(aFact))
+    {
+      _usedFacts.set(aFact);
     }
+    _totalCost += ioChild._totalCost;
+    _hash.add(ioChild._hash.get());
+    ++ioChild._references;
   }
 
   Factorizer::Factorizer():
-    Observer(_allocator)
+    Observer(_allocator), _costModel(&_defaultCostModel), _grammar(NULL), _profile(NULL),
+    _profiling(false), _reordering(false), _canonicalizing(true), _nodesCount(0)
   {}
 
   Factorizer::~Factorizer()
@@ -40,28 +95,204 @@ namespace mdw { namespace formula {
     _types.clear();
   }
 
+  void Factorizer::observe(const Grammar& iGrammar)
+  {
+    registerType<bool>(iGrammar);
+    registerType<int>(iGrammar);
+    registerType<double>(iGrammar);
+    registerType<std::string>(iGrammar);
+    setGrammar(iGrammar);
+  }
+
   void Factorizer::reset()
   {
     _expressions.clear();
+    _known.clear();
+    _unreferenced.clear();
+    _nodesCount = 0;
+    _liveProfile.clear();
 
-    _displays.clear();
+    _structures.clear();
 
     _facts.clear();
+    _factIds.clear();
+    _caches.clear();
     getAllocator().clean();
   }
 
-  Factorizer::KnownExpression *Factorizer::getByDisplay(const std::string& iDisplay)
+  void Factorizer::addRule(const Expression& iRule)
   {
-    ByDisplay::iterator anExp = _displays.find(iDisplay);
-    if (anExp != _displays.end())
+    ++getChild(iRule)._references;
+  }
+
+  void Factorizer::retireRule(const Expression& iRule)
+  {
+    KnownExpression& aKnown = getChild(iRule);
+    if (aKnown._references == 0)
+    {
+      throw mdw::UnknownException("Rule was not added: " + iRule.toString());
+    }
+    if (--aKnown._references == 0)
+    {
+      _unreferenced.push_back(&aKnown);
+    }
+  }
+
+  size_t Factorizer::collectGarbage()
+  {
+    size_t aCollected = 0;
+    while (!_unreferenced.empty())
     {
-      KnownExpressions::iterator aKnown = _expressions.find(anExp->second);
-      if (aKnown != _expressions.end())
+      KnownExpression *aKnown = _unreferenced.back();
+      _unreferenced.pop_back();
+      // May have been used again, or already collected (when pushed twice)
+      if ((aKnown->_references == 0) && (_known[aKnown->_id] == aKnown))
       {
-        return aKnown->second;
+        release(*aKnown);
+        ++aCollected;
       }
     }
-    return NULL;
+    FORMULA_DEBUG("Collected " << aCollected << " nodes, " << _nodesCount << " left");
+    return aCollected;
+  }
+
+  void Factorizer::release(KnownExpression& ioKnown)
+  {
+    BOOST_FOREACH(const Expression *anAlias, ioKnown._aliases)
+    {
+      KnownExpressions::iterator anIt = _expressions.find(anAlias);
+      if ((anIt != _expressions.end()) && (anIt->second == &ioKnown))
+      {
+        _expressions.erase(anIt);
+      }
+      const CacheIntrospection *aCache = dynamic_cast<const CacheIntrospection*>(anAlias);
+      if (aCache)
+      {
+        _caches.remove(*aCache);
+      }
+    }
+    NodeKey aKey(*ioKnown._key);
+    _structures.erase(aKey);
+    _known[ioKnown._id] = NULL;
+    --_nodesCount;
+
+    BOOST_FOREACH(size_t aChild, aKey.second)
+    {
+      KnownExpression *aChildKnown = _known[aChild];
+      if (aChildKnown && (--aChildKnown->_references == 0))
+      {
+        _unreferenced.push_back(aChildKnown);
+      }
+    }
+  }
+
+  void Factorizer::setCostModel(const CostModel *iModel)
+  {
+    _costModel = iModel ? iModel : &_defaultCostModel;
+  }
+
+  void Factorizer::exportProfile(OptimizationProfile& ioProfile) const
+  {
+    BOOST_FOREACH(const KnownExpression *aKnown, _known)
+    {
+      if (!aKnown || (!aKnown->_counters && !aKnown->_cache))
+      {
+        continue;
+      }
+      OptimizationProfile::NodeProfile aNode;
+      if (aKnown->_counters)
+      {
+        aNode._evaluations = aKnown->_counters->_evaluations;
+        aNode._trues = aKnown->_counters->_trues;
+      }
+      if (aKnown->_cache)
+      {
+        CacheStatistics aStatistics = aKnown->_cache->getCacheStatistics();
+        aNode._cacheLookups = aStatistics._lookups;
+        aNode._cacheHits = aStatistics._hits;
+      }
+      aNode._cost = aKnown->_totalCost;
+      ioProfile.get(aKnown->_hash.get()).add(aNode);
+    }
+  }
+
+  uint64_t Factorizer::getStructuralHash(const Expression& iExpression) const
+  {
+    KnownExpressions::const_iterator aKnown = _expressions.find(&iExpression);
+    return (aKnown == _expressions.end()) ? 0 : aKnown->second->_hash.get();
+  }
+
+  void Factorizer::compact(Factorizer& ioTarget, std::vector<Expression*>& ioRules,
+                           bool iStrip) const
+  {
+    if (!ioTarget._grammar)
+    {
+      throw mdw::UnknownException("Cannot compact to a Factorizer without grammar");
+    }
+    Parser aParser(ioTarget.getAllocator(), *ioTarget._grammar);
+    aParser.addObserver(ioTarget);
+    DagReplayer aReplayer(*this, aParser);
+    BOOST_FOREACH(Expression *&aRule, ioRules)
+    {
+      aRule = &aReplayer.replay(*aRule);
+      ioTarget.addRule(*aRule);
+    }
+    FORMULA_DEBUG("Compacted " << ioRules.size() << " rules from " << _nodesCount << " to "
+                  << ioTarget._nodesCount << " nodes");
+    if (iStrip)
+    {
+      ioTarget.strip();
+    }
+  }
+
+  void Factorizer::strip()
+  {
+    BOOST_FOREACH(KnownExpression *aKnown, _known)
+    {
+      if (aKnown)
+      {
+        FactSet().swap(aKnown->_usedFacts);
+        std::vector<const Expression*>().swap(aKnown->_aliases);
+      }
+    }
+    KnownExpressions().swap(_expressions);
+    ByStructure().swap(_structures);
+    std::vector<KnownExpression*>().swap(_known);
+    std::vector<KnownExpression*>().swap(_unreferenced);
+    FactIds().swap(_factIds);
+    Facts().swap(_facts);
+    _nodesCount = 0;
+  }
+
+  size_t Factorizer::getNodeId(const Expression& iExpression) const
+  {
+    KnownExpressions::const_iterator aKnown = _expressions.find(&iExpression);
+    if (aKnown == _expressions.end())
+    {
+      throw mdw::UnknownException("Could not find known expression: " + iExpression.toString());
+    }
+    return aKnown->second->_id;
+  }
+
+  const Factorizer::NodeKey& Factorizer::getNodeKey(size_t iId) const
+  {
+    if ((iId >= _known.size()) || !_known[iId])
+    {
+      throw mdw::UnknownException("Unknown node id: " + mdw::lexical_cast<std::string>(iId));
+    }
+    return *_known[iId]->_key;
+  }
+
+  const Expression& Factorizer::getParsedExpression(size_t iId) const
+  {
+    getNodeKey(iId);
+    return _known[iId]->_expression;
+  }
+
+  Factorizer::KnownExpression *Factorizer::getByStructure(const NodeKey& iKey)
+  {
+    ByStructure::iterator aKnown = _structures.find(iKey);
+    return (aKnown == _structures.end()) ? NULL : aKnown->second;
   }
 
   Factorizer::KnownExpression *Factorizer::getKnown(const Expression& iExpression)
@@ -75,18 +306,63 @@ namespace mdw { namespace formula {
     }
   }
 
+  Factorizer::KnownExpression& Factorizer::getChild(const Expression& iExpression)
+  {
+    KnownExpression *aKnown = getKnown(iExpression);
+    if (!aKnown)
+    {
+      throw mdw::UnknownException("Could not find known expression: " + iExpression.toString());
+    }
+    return *aKnown;
+  }
+
+  size_t Factorizer::getFactId(const std::string& iName)
+  {
+    FactIds::iterator anIt = _factIds.find(iName);
+    if (anIt != _factIds.end())
+    {
+      return anIt->second;
+    }
+    size_t anId = _facts.size();
+    _factIds[iName] = anId;
+    _facts.push_back(NULL);
+    return anId;
+  }
+
   Factorizer::KnownExpression& Factorizer::createKnown(Expression& ioExpression,
-                                                       const std::string& iDisplay)
+                                                       const NodeKey& iKey)
   {
-    KnownExpression *anExpr = &getAllocator().create<KnownExpression>(ioExpression, *this);
-    _expressions[&ioExpression] = anExpr;
-    _displays[iDisplay] = &ioExpression;
+    size_t anId = _known.size();
+    KnownExpression *anExpr =
+      &getAllocator().create<KnownExpression>(ioExpression, anId, *_costModel);
+    anExpr->_hash.add(iKey.first);
+    _known.push_back(anExpr);
+    _unreferenced.push_back(anExpr);
+    ++_nodesCount;
+    addAlias(*anExpr, ioExpression);
+    anExpr->_key = &_structures.insert(std::make_pair(iKey, anExpr)).first->first;
+    registerCache(ioExpression);
     return *anExpr;
   }
 
+  void Factorizer::addAlias(KnownExpression& ioKnown, Expression& ioAlias)
+  {
+    _expressions[&ioAlias] = &ioKnown;
+    ioKnown._aliases.push_back(&ioAlias);
+  }
+
+  void Factorizer::registerCache(const Expression& iExpression)
+  {
+    const CacheIntrospection *aCache = dynamic_cast<const CacheIntrospection*>(&iExpression);
+    if (aCache)
+    {
+      _caches.add(*aCache);
+    }
+  }
+
   Expression& Factorizer::optimize(KnownExpression& ioKnown)
   {
-    if (ioKnown._usedFacts.empty())
+    if (ioKnown._usedFacts.none())
     {
       Types::iterator aTypeIt = _types.find(ioKnown._type);
       if ((aTypeIt != _types.end()) && (aTypeIt->second != NULL))
@@ -94,63 +370,203 @@ namespace mdw { namespace formula {
         Expression& aConstant =
           aTypeIt->second->getConstant(ioKnown._expression, ioKnown._type, getAllocator());
         ioKnown._optimized = &aConstant;
-        _expressions[&aConstant] = &ioKnown;
+        addAlias(ioKnown, aConstant);
         FORMULA_DEBUG("Optimized constant expression: " << aConstant.toString());
       } else {
         FORMULA_DEBUG("Missing type for constant: " << ioKnown._expression.toString());
       }
-    } else if ((ioKnown._totalComplexity > 5) && (ioKnown._usedFacts.size() == 1)) {
+    } else if ((ioKnown._usedFacts.count() == 1) && shouldCache(ioKnown)) {
       Types::iterator aTypeIt = _types.find(ioKnown._type);
       if ((aTypeIt != _types.end()) && (aTypeIt->second != NULL))
       {
-        Facts::iterator aFactIt = _facts.find(*ioKnown._usedFacts.begin());
-        if ((aFactIt == _facts.end()) || (aFactIt->second == NULL))
+        FactByAddress *aFact = _facts[ioKnown._usedFacts.find_first()];
+        if (aFact == NULL)
         {
-          FORMULA_DEBUG("Missing fact: " << *ioKnown._usedFacts.begin());
+          FORMULA_DEBUG("Missing fact for: " << ioKnown._expression.toString());
         } else {
           Expression& aCached =
-            aTypeIt->second->getUnaryCached(ioKnown._expression, *aFactIt->second, getAllocator());
+            aTypeIt->second->getUnaryCached(*ioKnown._optimized, *aFact, getAllocator());
           ioKnown._optimized = &aCached;
-          ioKnown._totalComplexity = aCached.complexity();
-          _expressions[&aCached] = &ioKnown;
+          ioKnown._cache = dynamic_cast<const CacheIntrospection*>(&aCached);
+          ioKnown._totalCost = _costModel->getCost(aCached);
+          addAlias(ioKnown, aCached);
+          registerCache(aCached);
           FORMULA_DEBUG("Optimized unary expression: " << aCached.toString());
         }
       } else {
         FORMULA_DEBUG("Missing type for unary: " << ioKnown._expression.toString());
       }
     }
+    if (_profiling && ioKnown._usedFacts.any())
+    {
+      profile(ioKnown);
+    }
     return *ioKnown._optimized;
   }
 
+  bool Factorizer::shouldCache(const KnownExpression& iKnown) const
+  {
+    const OptimizationProfile::NodeProfile *aProfile =
+      _profile ? _profile->find(iKnown._hash.get()) : NULL;
+    if (aProfile && (aProfile->_cacheLookups >= kMinProfileSamples))
+    {
+      // Only the hits save the evaluation, every lookup has to be paid for
+      return aProfile->getHitRatio() * iKnown._totalCost > _costModel->getCacheLookupCost();
+    }
+    return iKnown._totalCost > _costModel->getCacheLookupCost();
+  }
+
+  Expression& Factorizer::reorder(KnownExpression& ioKnown,
+                                  Expression& ioLeft,
+                                  Expression& ioRight,
+                                  const std::string& iSymbol)
+  {
+    KnownExpression *aLeft = getKnown(ioLeft);
+    KnownExpression *aRight = getKnown(ioRight);
+    if (!_profile || !_grammar || !aLeft || !aRight)
+    {
+      return *ioKnown._optimized;
+    }
+    const OptimizationProfile::NodeProfile *aLeftProfile = _profile->find(aLeft->_hash.get());
+    const OptimizationProfile::NodeProfile *aRightProfile = _profile->find(aRight->_hash.get());
+    if (!aLeftProfile || !aRightProfile ||
+        (aLeftProfile->_evaluations < kMinProfileSamples) ||
+        (aRightProfile->_evaluations < kMinProfileSamples))
+    {
+      return *ioKnown._optimized;
+    }
+    // The right operand is only evaluated when the left one is false:
+    // the most likely true per unit of cost goes first
+    double aUnit = _costModel->getUnitCost();
+    double aLeftScore = aLeftProfile->getSelectivity() / std::max(aLeft->_totalCost, aUnit);
+    double aRightScore = aRightProfile->getSelectivity() / std::max(aRight->_totalCost, aUnit);
+    if (aRightScore <= aLeftScore)
+    {
+      return *ioKnown._optimized;
+    }
+    Expression& aSwapped =
+      _grammar->instantiateBinaryOperator(getAllocator(), ioRight, ioLeft, iSymbol);
+    addAlias(ioKnown, aSwapped);
+    FORMULA_DEBUG("Reordered expression: " << aSwapped.toString());
+    return aSwapped;
+  }
+
+  void Factorizer::profile(KnownExpression& ioKnown)
+  {
+    TypedExpression<bool> *aCondition = dynamic_cast<TypedExpression<bool>*>(ioKnown._optimized);
+    if (aCondition)
+    {
+      ioKnown._counters = &_liveProfile.get(ioKnown._hash.get());
+      Expression& aProfiled =
+        getAllocator().create<ProfiledCondition>(*aCondition, *ioKnown._counters);
+      ioKnown._optimized = &aProfiled;
+      addAlias(ioKnown, aProfiled);
+    }
+  }
+
+  Expression *Factorizer::canonicalize(KnownExpression& ioLeft,
+                                       KnownExpression& ioRight,
+                                       const std::string& iSymbol)
+  {
+    if (!_grammar || (ioLeft._type != ioRight._type) || !IsStandardType(ioLeft._type))
+    {
+      return NULL;
+    }
+    if (IsAssociative(iSymbol, ioLeft._type))
+    {
+      // Canonical chain: left-deep, operands sorted by structural hash
+      std::string aKind = "b " + iSymbol;
+      std::vector<KnownExpression*> anOperands;
+      flatten(ioLeft, aKind, anOperands);
+      flatten(ioRight, aKind, anOperands);
+      bool isSorted = (ioRight._key->first != aKind);
+      for (size_t i = 1; isSorted && (i < anOperands.size()); ++i)
+      {
+        isSorted = !IsBefore(anOperands[i], anOperands[i - 1]);
+      }
+      if (isSorted)
+      {
+        return NULL;
+      }
+      std::stable_sort(anOperands.begin(), anOperands.end(), &Factorizer::IsBefore);
+      Expression *aChain = anOperands[0]->_optimized;
+      for (size_t i = 1; i < anOperands.size(); ++i)
+      {
+        aChain = &combine(*aChain, *anOperands[i]->_optimized, iSymbol);
+      }
+      return aChain;
+    }
+    std::string aMirror = GetMirror(iSymbol, ioLeft._type);
+    if (!aMirror.empty() && IsBefore(&ioRight, &ioLeft))
+    {
+      return &combine(*ioRight._optimized, *ioLeft._optimized, aMirror);
+    }
+    return NULL;
+  }
+
+  bool Factorizer::IsBefore(const KnownExpression *iLeft, const KnownExpression *iRight)
+  {
+    // Structural hashes are stable across restarts, unlike ids
+    return iLeft->_hash.get() < iRight->_hash.get();
+  }
+
+  void Factorizer::flatten(KnownExpression& ioKnown,
+                           const std::string& iKind,
+                           std::vector<KnownExpression*>& oOperands)
+  {
+    if (ioKnown._key->first == iKind)
+    {
+      BOOST_FOREACH(size_t aChild, ioKnown._key->second)
+      {
+        flatten(*_known[aChild], iKind, oOperands);
+      }
+    } else {
+      oOperands.push_back(&ioKnown);
+    }
+  }
+
+  Expression& Factorizer::combine(Expression& ioLeft,
+                                  Expression& ioRight,
+                                  const std::string& iSymbol)
+  {
+    Expression& aResult = _grammar->instantiateBinaryOperator(getAllocator(), ioLeft, ioRight,
+                                                              iSymbol);
+    return newBinary(aResult, ioLeft, ioRight, iSymbol);
+  }
+
   Expression& Factorizer::newConstant(Expression& ioResult)
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    // Constants are leaves, their display is short
+    NodeKey aKey(std::string("c ") + ioResult.getTypeAsString() + " " + ioResult.toString(),
+                 Children());
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      createKnown(ioResult, aDisplay);
+      createKnown(ioResult, aKey);
       return ioResult;
     }
   }
 
   Expression& Factorizer::newFact(Expression& ioResult, const std::string& iName)
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    NodeKey aKey("f " + iName, Children());
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      KnownExpression& anExpr = createKnown(ioResult, aDisplay);
-      anExpr._usedFacts.insert(iName);
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      size_t aFactId = getFactId(iName);
+      anExpr._usedFacts.resize(aFactId + 1);
+      anExpr._usedFacts.set(aFactId);
 
       Types::iterator aFactTypeIt = _types.find(ioResult.getType());
       if ((aFactTypeIt != _types.end()) && (aFactTypeIt->second != NULL))
       {
         FactByAddress& aFactPtr = aFactTypeIt->second->getFactByAddress(ioResult, getAllocator());
-        _facts[iName] = &aFactPtr;
+        _facts[aFactId] = &aFactPtr;
       } else {
         FORMULA_DEBUG("Missing fact type for " << iName);
       }
@@ -158,18 +574,42 @@ namespace mdw { namespace formula {
     }
   }
 
+  Expression& Factorizer::newSubRule(Expression& ioResult, const std::string& iName)
+  {
+    NodeKey aKey("r " + iName, Children());
+    KnownExpression *aKnown = getByStructure(aKey);
+    if (aKnown)
+    {
+      return *aKnown->_optimized;
+    } else {
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      // Depends on unknown facts: never folded, and never cached by a single fact
+      size_t aFactId = getFactId("@" + iName);
+      anExpr._usedFacts.resize(aFactId + 1);
+      anExpr._usedFacts.set(aFactId);
+      return ioResult;
+    }
+  }
+
   Expression& Factorizer::newUnary(Expression& ioResult,
                                    Expression& ioRight,
                                    const std::string& iSymbol)
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    KnownExpression& aRight = getChild(ioRight);
+    if (_canonicalizing && ((iSymbol == "!") || (iSymbol == "-")) &&
+        (aRight._key->first == "u " + iSymbol) && IsStandardType(aRight._type))
+    {
+      // Double negation
+      return *_known[aRight._key->second[0]]->_optimized;
+    }
+    NodeKey aKey("u " + iSymbol, Children(1, aRight._id));
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      KnownExpression& anExpr = createKnown(ioResult, aDisplay);
-      anExpr.addDependency(ioRight);
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      anExpr.addDependency(aRight);
       return optimize(anExpr);
     }
   }
@@ -179,15 +619,27 @@ namespace mdw { namespace formula {
                                     Expression& ioRight,
                                     const std::string& iSymbol)
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    KnownExpression& aLeft = getChild(ioLeft);
+    KnownExpression& aRight = getChild(ioRight);
+    Expression *aCanonical = _canonicalizing ? canonicalize(aLeft, aRight, iSymbol) : NULL;
+    if (aCanonical)
+    {
+      return *aCanonical;
+    }
+    NodeKey aKey("b " + iSymbol, Children(1, aLeft._id));
+    aKey.second.push_back(aRight._id);
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      KnownExpression& anExpr = createKnown(ioResult, aDisplay);
-      anExpr.addDependency(ioLeft);
-      anExpr.addDependency(ioRight);
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      anExpr.addDependency(aLeft);
+      anExpr.addDependency(aRight);
+      if (_reordering && (iSymbol == "||"))
+      {
+        anExpr._optimized = &reorder(anExpr, ioLeft, ioRight, iSymbol);
+      }
       return optimize(anExpr);
     }
   }
@@ -197,16 +649,21 @@ namespace mdw { namespace formula {
                                     Expression& ioLeft,
                                     Expression& ioRight)
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    KnownExpression& aCondition = getChild(ioCondition);
+    KnownExpression& aLeft = getChild(ioLeft);
+    KnownExpression& aRight = getChild(ioRight);
+    NodeKey aKey("?", Children(1, aCondition._id));
+    aKey.second.push_back(aLeft._id);
+    aKey.second.push_back(aRight._id);
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      KnownExpression& anExpr = createKnown(ioResult, aDisplay);
-      anExpr.addDependency(ioCondition);
-      anExpr.addDependency(ioLeft);
-      anExpr.addDependency(ioRight);
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      anExpr.addDependency(aCondition);
+      anExpr.addDependency(aLeft);
+      anExpr.addDependency(aRight);
       return optimize(anExpr);
     }
   }
@@ -217,19 +674,25 @@ namespace mdw { namespace formula {
                                    const std::string& iLocalName)
 
   {
-    std::string aDisplay = ioResult.toString();
-    KnownExpression *aKnown = getByDisplay(aDisplay);
+    KnownExpression& aContainer = getChild(ioContainer);
+    KnownExpression& aCondition = getChild(ioCondition);
+    NodeKey aKey("-> " + iLocalName, Children(1, aContainer._id));
+    aKey.second.push_back(aCondition._id);
+    KnownExpression *aKnown = getByStructure(aKey);
     if (aKnown)
     {
       return *aKnown->_optimized;
     } else {
-      KnownExpression& anExpr = createKnown(ioResult, aDisplay);
-      anExpr.addDependency(ioContainer);
-      anExpr.addDependency(ioCondition);
-      anExpr._usedFacts.erase(iLocalName);
+      KnownExpression& anExpr = createKnown(ioResult, aKey);
+      anExpr.addDependency(aContainer);
+      anExpr.addDependency(aCondition);
+      FactIds::const_iterator aLocal = _factIds.find(iLocalName);
+      if ((aLocal != _factIds.end()) && (aLocal->second < anExpr._usedFacts.size()))
+      {
+        anExpr._usedFacts.reset(aLocal->second);
+      }
       return optimize(anExpr);
     }
   }
 
 }}
-
@@ -4,13 +4,17 @@
 #include <mdw/formula/Expression.hpp>
 #include <mdw/formula/StandardTypes.hpp>
 #include <mdw/formula/cache/Factorizer.hpp>
+#include <mdw/Tracer.hpp>
 #include <functional>
 #include <string>
 
 namespace mdw { namespace formula {
 
+  std::atomic<size_t> Grammar::LatestUniqueId(0);
+
   Grammar::Grammar():
-    _maxId(kExprMaxType), _chainedGrammar(NULL)
+    _maxId(kExprMaxType), _chainedGrammar(NULL), _uniqueId(++LatestUniqueId),
+    _frozen(false), _dispatchSeed(0)
   {
     _types["int"] = kExprInt;
     _types["bool"] = kExprBool;
@@ -20,19 +24,168 @@ namespace mdw { namespace formula {
 
   void Grammar::linkGrammar(const Grammar& iChainedGrammar)
   {
+    checkNotFrozen();
     _chainedGrammar = &iChainedGrammar;
   }
 
   void Grammar::addObserver(Factorizer& ioFactorizer)
   {
-    ioFactorizer.registerType<bool>(*this);
-    ioFactorizer.registerType<int>(*this);
-    ioFactorizer.registerType<double>(*this);
-    ioFactorizer.registerType<std::string>(*this);
-
+    ioFactorizer.observe(*this);
     _factorizers.push_back(&ioFactorizer);
   }
 
+  void Grammar::freeze()
+  {
+    if (_frozen)
+    {
+      return;
+    }
+    typedef std::pair<std::pair<ExpressionType, ExpressionType>, uint32_t> Key;
+    boost::unordered_map<Key, size_t> anIndexes;
+    // The first grammar of the chain wins, as for the lookups
+    for (const Grammar *aGrammar = this; aGrammar; aGrammar = aGrammar->_chainedGrammar)
+    {
+      BOOST_FOREACH(const Operators::value_type& anOperator, aGrammar->_operators)
+      {
+        const OperatorId& anId = anOperator.first;
+        uint32_t aSymbol =
+          _symbols.insert(std::make_pair(anId._symbol, (uint32_t)_symbols.size())).first->second;
+        Key aKey(std::make_pair(anId._arg1Type, anId._arg2Type), aSymbol);
+        std::pair<boost::unordered_map<Key, size_t>::iterator, bool> anIndex =
+          anIndexes.insert(std::make_pair(aKey, _frozenOperators.size()));
+        if (anIndex.second)
+        {
+          FrozenOperator aFrozen;
+          aFrozen._arg1Type = anId._arg1Type;
+          aFrozen._arg2Type = anId._arg2Type;
+          aFrozen._symbol = aSymbol;
+          _frozenOperators.push_back(aFrozen);
+        }
+        FrozenOperator& aFrozen = _frozenOperators[anIndex.first->second];
+        for (size_t i = 0; i < kUsages; ++i)
+        {
+          if (!aFrozen._resolutions[i]._operator && IsUsableAs(anOperator.second, (Usage)i))
+          {
+            aFrozen._resolutions[i]._grammar = aGrammar;
+            aFrozen._resolutions[i]._operator = &anOperator;
+          }
+        }
+      }
+      BOOST_FOREACH(const SubRules::value_type& aSubRule, aGrammar->_subRules)
+      {
+        _frozenSubRules.insert(aSubRule);
+      }
+    }
+
+    // Looks for a seed without collision, growing the table when it takes too long
+    size_t aSize = 1;
+    while (aSize < 2 * _frozenOperators.size())
+    {
+      aSize *= 2;
+    }
+    for (uint64_t aSeed = 1; ; ++aSeed)
+    {
+      if (aSeed % 32 == 0)
+      {
+        aSize *= 2;
+      }
+      _dispatch.assign(aSize, -1);
+      bool aCollision = false;
+      for (size_t i = 0; (i < _frozenOperators.size()) && !aCollision; ++i)
+      {
+        const FrozenOperator& anOperator = _frozenOperators[i];
+        int32_t& aSlot = _dispatch[Hash(anOperator._arg1Type, anOperator._arg2Type,
+                                        anOperator._symbol, aSeed) & (aSize - 1)];
+        aCollision = (aSlot >= 0);
+        aSlot = i;
+      }
+      if (!aCollision)
+      {
+        _dispatchSeed = aSeed;
+        break;
+      }
+    }
+    _frozen = true;
+    FORMULA_DEBUG("Froze grammar with " << _frozenOperators.size() << " operators in "
+                  << _dispatch.size() << " slots");
+  }
+
+  void Grammar::checkNotFrozen() const
+  {
+    if (_frozen)
+    {
+      throw mdw::UnknownException("Grammar is frozen");
+    }
+  }
+
+  bool Grammar::IsUsableAs(const Operator& iOperator, Usage iUsage)
+  {
+    switch (iUsage)
+    {
+      case kAsUnary:
+        return (iOperator._unary == Operator::kUnary) && iOperator._unaryInstantiator;
+      case kAsBinary:
+        return (iOperator._unary == Operator::kBinary) && iOperator._binaryInstantiator;
+      case kAsArrow:
+        return (iOperator._unary == Operator::kBinary) && iOperator._arrowInstantiator;
+      case kAsFact:
+        return (iOperator._unary == Operator::kObject) && iOperator._factInstantiator;
+      default:
+        return false;
+    }
+  }
+
+  size_t Grammar::Hash(ExpressionType iLeftType, ExpressionType iRightType, uint32_t iSymbol,
+                       uint64_t iSeed)
+  {
+    // splitmix64 finalizer
+    uint64_t aHash = iSeed * 0x9E3779B97F4A7C15ULL;
+    aHash ^= ((uint64_t)iLeftType << 40) ^ ((uint64_t)iRightType << 20) ^ iSymbol;
+    aHash = (aHash ^ (aHash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    aHash = (aHash ^ (aHash >> 27)) * 0x94D049BB133111EBULL;
+    return aHash ^ (aHash >> 31);
+  }
+
+  Grammar::Resolution Grammar::findOperator(ExpressionType iLeftType,
+                                            ExpressionType iRightType,
+                                            const std::string& iSymbol,
+                                            Usage iUsage) const
+  {
+    if (_frozen)
+    {
+      boost::unordered_map<std::string, uint32_t>::const_iterator aSymbol =
+        _symbols.find(iSymbol);
+      if (aSymbol != _symbols.end())
+      {
+        int32_t anIndex = _dispatch[Hash(iLeftType, iRightType, aSymbol->second, _dispatchSeed) &
+                                    (_dispatch.size() - 1)];
+        if (anIndex >= 0)
+        {
+          const FrozenOperator& anOperator = _frozenOperators[anIndex];
+          if ((anOperator._arg1Type == iLeftType) && (anOperator._arg2Type == iRightType) &&
+              (anOperator._symbol == aSymbol->second))
+          {
+            return anOperator._resolutions[iUsage];
+          }
+        }
+      }
+      return Resolution();
+    }
+
+    Operators::const_iterator anIt = _operators.find(OperatorId(iLeftType, iRightType, iSymbol));
+    if ((anIt != _operators.end()) && IsUsableAs(anIt->second, iUsage))
+    {
+      Resolution aResolution;
+      aResolution._grammar = this;
+      aResolution._operator = &*anIt;
+      return aResolution;
+    } else if (_chainedGrammar) {
+      return _chainedGrammar->findOperator(iLeftType, iRightType, iSymbol, iUsage);
+    } else {
+      return Resolution();
+    }
+  }
+
   Grammar::OperatorId::OperatorId(ExpressionType iLeftType,
                                   ExpressionType iRightType,
                                   const std::string& iSymbol):
@@ -98,6 +251,7 @@ namespace mdw { namespace formula {
                                       const std::string& iSymbol,
                                       UnaryOpInstantiator& iInstantiator)
   {
+    checkNotFrozen();
     OperatorId anId(iInputType, kExprVoid, iSymbol);
     Operator anOperator(iOutputType, iInstantiator);
 
@@ -110,6 +264,7 @@ namespace mdw { namespace formula {
                                        const std::string& iSymbol,
                                        BinaryOpInstantiator& iInstantiator)
   {
+    checkNotFrozen();
     OperatorId anId(iLeftType, iRightType, iSymbol);
     Operator anOperator(iOutputType, iInstantiator);
 
@@ -122,6 +277,7 @@ namespace mdw { namespace formula {
                                         const std::string& iSymbol,
                                         ArrowInstantiator& iInstantiator)
   {
+    checkNotFrozen();
     OperatorId anId(iLeftType, iRightType, iSymbol);
     Operator anOperator(iOutputType, iInstantiator);
 
@@ -135,6 +291,7 @@ namespace mdw { namespace formula {
                                      ExpressionType iOutputType,
                                      FactInstantiator& iInstantiator)
   {
+    checkNotFrozen();
     OperatorId anId(kExprVoid, kExprVoid, iName);
     Operator anOperator(iOutputType, iInstantiator);
 
@@ -153,16 +310,12 @@ namespace mdw { namespace formula {
                                                 const Expression& iChild,
                                                 const std::string& iSymbol) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(iChild.getType(), kExprVoid, iSymbol));
-    if (anIt != _operators.end()
-        && anIt->second._unary == Operator::kUnary
-        && anIt->second._unaryInstantiator != NULL)
+    Resolution aFound = findOperator(iChild.getType(), kExprVoid, iSymbol, kAsUnary);
+    if (aFound._operator)
     {
-      return anIt->second._unaryInstantiator->instantiate(ioAllocator, *this,
-                                                          anIt->first._symbol, iChild);
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->instantiateUnaryOperator(ioAllocator, iChild, iSymbol);
+      const Operators::value_type& anOperator = *aFound._operator;
+      return anOperator.second._unaryInstantiator->instantiate(ioAllocator, *aFound._grammar,
+                                                               anOperator.first._symbol, iChild);
     } else {
       throw mdw::UnknownException("Unary operator not found: " + iSymbol + " on type " +
                                   std::string(iChild.getTypeAsString()));
@@ -174,16 +327,13 @@ namespace mdw { namespace formula {
                                                  const Expression& iRight,
                                                  const std::string& iSymbol) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(iLeft.getType(), iRight.getType(), iSymbol));
-    if (anIt != _operators.end() 
-        && anIt->second._unary == Operator::kBinary
-        && anIt->second._binaryInstantiator != NULL)
+    Resolution aFound = findOperator(iLeft.getType(), iRight.getType(), iSymbol, kAsBinary);
+    if (aFound._operator)
     {
-      return anIt->second._binaryInstantiator->instantiate(ioAllocator, *this, anIt->first._symbol,
-                                                           iLeft, iRight);
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->instantiateBinaryOperator(ioAllocator, iLeft, iRight, iSymbol);
+      const Operators::value_type& anOperator = *aFound._operator;
+      return anOperator.second._binaryInstantiator->instantiate(ioAllocator, *aFound._grammar,
+                                                                anOperator.first._symbol,
+                                                                iLeft, iRight);
     } else {
       throw mdw::UnknownException("Binary operator not found: " + iSymbol + " between types " +
                                   std::string(iLeft.getTypeAsString()) + " (" +
@@ -198,17 +348,14 @@ namespace mdw { namespace formula {
                                                 const Expression& iRight,
                                                 const char *iSymbol) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(iLeft.getType(), iRight.getType(), "->"));
-    if (anIt != _operators.end() 
-        && anIt->second._unary == Operator::kBinary
-        && anIt->second._arrowInstantiator != NULL)
+    Resolution aFound = findOperator(iLeft.getType(), iRight.getType(), "->", kAsArrow);
+    if (aFound._operator)
     {
+      const Operators::value_type& anOperator = *aFound._operator;
       const std::string& aSymbol = ioAllocator.create<std::string>(iSymbol);
-      return anIt->second._arrowInstantiator->instantiate(ioAllocator, *this, anIt->first._symbol,
-                                                          iLeft, iRight, aSymbol);
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->instantiateArrowOperator(ioAllocator, iLeft, iRight, iSymbol);
+      return anOperator.second._arrowInstantiator->instantiate(ioAllocator, *aFound._grammar,
+                                                               anOperator.first._symbol,
+                                                               iLeft, iRight, aSymbol);
     } else {
       throw mdw::UnknownException("Binary operator not found: -> between types " +
                                   std::string(iLeft.getTypeAsString()) + " (" +
@@ -222,15 +369,12 @@ namespace mdw { namespace formula {
                                               const Expression& iLeft,
                                               const char *iIdentifier) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(iLeft.getType(), kExprVoid, "->"));
-    if (anIt != _operators.end() 
-        && anIt->second._unary == Operator::kBinary
-        && anIt->second._arrowInstantiator != NULL)
+    Resolution aFound = findOperator(iLeft.getType(), kExprVoid, "->", kAsArrow);
+    if (aFound._operator)
     {
-      return anIt->second._arrowInstantiator->subFact(ioAllocator, *this, iLeft, iIdentifier);
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->instantiateLocal(ioAllocator, iLeft, iIdentifier);
+      const Operators::value_type& anOperator = *aFound._operator;
+      return anOperator.second._arrowInstantiator->subFact(ioAllocator, *aFound._grammar, iLeft,
+                                                           iIdentifier);
     } else {
       throw mdw::UnknownException("Fact instantiator not found: -> on type " +
                                   std::string(iLeft.getTypeAsString()) + " (" +
@@ -241,37 +385,62 @@ namespace mdw { namespace formula {
 
   bool Grammar::hasFact(const std::string& iName) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(kExprVoid, kExprVoid, iName));
-    if (anIt != _operators.end() 
-        && anIt->second._unary == Operator::kObject 
-        && anIt->second._factInstantiator != NULL)
-    {
-      return true;
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->hasFact(iName);
-    } else {
-      return false;
-    }
+    return findOperator(kExprVoid, kExprVoid, iName, kAsFact)._operator != NULL;
   }
 
   Expression& Grammar::instantiateFactResolver(ArenaAllocator& ioAllocator,
                                                const std::string& iObject) const
   {
-    std::map<OperatorId, Operator>::const_iterator anIt =
-      _operators.find(OperatorId(kExprVoid, kExprVoid, iObject));
-    if (anIt != _operators.end() 
-        && anIt->second._unary == Operator::kObject 
-        && anIt->second._factInstantiator != NULL)
+    Resolution aFound = findOperator(kExprVoid, kExprVoid, iObject, kAsFact);
+    if (aFound._operator)
     {
-      return anIt->second._factInstantiator->instantiate(ioAllocator, *this, anIt->first._symbol);
-    } else if (_chainedGrammar) {
-      return _chainedGrammar->instantiateFactResolver(ioAllocator, iObject);
+      const Operators::value_type& anOperator = *aFound._operator;
+      return anOperator.second._factInstantiator->instantiate(ioAllocator, *aFound._grammar,
+                                                              anOperator.first._symbol);
     } else {
       throw mdw::UnknownException("Fact resolver not found: " + iObject);
     }
   }
 
+  Expression& Grammar::parseSubRule(ArenaAllocator& ioAllocator, const std::string& iFormula) const
+  {
+    return Parser(ioAllocator, *this, iFormula).getTopExpression();
+  }
+
+  void Grammar::addSubRule(const std::string& iName, Expression& ioSubRule)
+  {
+    checkNotFrozen();
+    if (_subRules.find(iName) != _subRules.end())
+    {
+      throw mdw::UnknownException("Sub-rule already registered: " + iName);
+    }
+    _subRules[iName] = &ioSubRule;
+  }
+
+  bool Grammar::hasSubRule(const std::string& iName) const
+  {
+    if (_frozen)
+    {
+      return _frozenSubRules.find(iName) != _frozenSubRules.end();
+    }
+    return (_subRules.find(iName) != _subRules.end()) ||
+      (_chainedGrammar && _chainedGrammar->hasSubRule(iName));
+  }
+
+  Expression& Grammar::instantiateSubRule(const std::string& iName) const
+  {
+    const SubRules& aSubRules = _frozen ? _frozenSubRules : _subRules;
+    SubRules::const_iterator anIt = aSubRules.find(iName);
+    if (anIt != aSubRules.end())
+    {
+      return *anIt->second;
+    } else if (_chainedGrammar && !_frozen) {
+      return _chainedGrammar->instantiateSubRule(iName);
+    } else {
+      throw mdw::UnknownException("Sub-rule not found: " + iName);
+    }
+  }
+
   Expression& Grammar::instantiateAttributeResolver(ArenaAllocator& ioAllocator,
                                                     const Expression& iFact,
                                                     const std::string& iAttribute) const
@@ -3,7 +3,8 @@
 
 namespace mdw { namespace formula {
 
-  int IContext::LatestUniqueId = 0;
+  std::atomic<int> IContext::LatestUniqueId(0);
+  std::atomic<size_t> IContext::LatestSlot(0);
 
   IContext::IContext(ArenaAllocator& ioAllocator):
     _allocator(ioAllocator), _uniqueId(++LatestUniqueId),
@@ -23,6 +24,11 @@ namespace mdw { namespace formula {
     }
   }
 
+  size_t IContext::AllocateSlot()
+  {
+    return LatestSlot++;
+  }
+
   const ArenaAllocator& IContext::getAllocator() const
   {
     return _allocator;
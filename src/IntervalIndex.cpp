@@ -0,0 +1,177 @@
+#include <mdw/formula/IntervalIndex.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    class ByLow {
+    public:
+      ByLow(const std::vector<IntervalIndex::Interval>& iIntervals):
+        _intervals(iIntervals)
+      {}
+
+      bool operator()(uint32_t iLeft, uint32_t iRight) const
+      {
+        return _intervals[iLeft]._low < _intervals[iRight]._low;
+      }
+
+    private:
+      const std::vector<IntervalIndex::Interval>& _intervals;
+    };
+
+    class ByHighDescending {
+    public:
+      ByHighDescending(const std::vector<IntervalIndex::Interval>& iIntervals):
+        _intervals(iIntervals)
+      {}
+
+      bool operator()(uint32_t iLeft, uint32_t iRight) const
+      {
+        return _intervals[iLeft]._high > _intervals[iRight]._high;
+      }
+
+    private:
+      const std::vector<IntervalIndex::Interval>& _intervals;
+    };
+  }
+
+  void IntervalIndex::Interval::restrictLow(double iLow, bool iClosed)
+  {
+    if ((iLow > _low) || ((iLow == _low) && !iClosed))
+    {
+      _low = iLow;
+      _lowClosed = iClosed;
+    }
+  }
+
+  void IntervalIndex::Interval::restrictHigh(double iHigh, bool iClosed)
+  {
+    if ((iHigh < _high) || ((iHigh == _high) && !iClosed))
+    {
+      _high = iHigh;
+      _highClosed = iClosed;
+    }
+  }
+
+  void IntervalIndex::build()
+  {
+    _nodes.clear();
+    _byLow.clear();
+    _byHigh.clear();
+    std::vector<uint32_t> anAll(_intervals.size());
+    for (size_t i = 0; i < anAll.size(); ++i)
+    {
+      anAll[i] = i;
+    }
+    _root = build(anAll);
+  }
+
+  // The center is the median of the finite bounds. An interval which does not contain
+  // it, but cannot go to either side (open bounds), stays in the node: find() checks
+  // each interval anyway.
+  size_t IntervalIndex::build(std::vector<uint32_t>& ioIntervals)
+  {
+    if (ioIntervals.empty())
+    {
+      return kNone;
+    }
+    std::vector<double> aBounds;
+    for (size_t i = 0; i < ioIntervals.size(); ++i)
+    {
+      const Interval& anInterval = _intervals[ioIntervals[i]];
+      if (std::isfinite(anInterval._low))
+      {
+        aBounds.push_back(anInterval._low);
+      }
+      if (std::isfinite(anInterval._high))
+      {
+        aBounds.push_back(anInterval._high);
+      }
+    }
+    Node aNode;
+    aNode._center = 0;
+    if (!aBounds.empty())
+    {
+      std::nth_element(aBounds.begin(), aBounds.begin() + aBounds.size() / 2, aBounds.end());
+      aNode._center = aBounds[aBounds.size() / 2];
+    }
+    std::vector<uint32_t> aLeft;
+    std::vector<uint32_t> aRight;
+    std::vector<uint32_t> aCentered;
+    for (size_t i = 0; i < ioIntervals.size(); ++i)
+    {
+      const Interval& anInterval = _intervals[ioIntervals[i]];
+      if (anInterval.contains(aNode._center))
+      {
+        aCentered.push_back(ioIntervals[i]);
+      } else if (anInterval._high <= aNode._center) {
+        aLeft.push_back(ioIntervals[i]);
+      } else {
+        aRight.push_back(ioIntervals[i]);
+      }
+    }
+    if ((aLeft.size() == ioIntervals.size()) || (aRight.size() == ioIntervals.size()))
+    {
+      aCentered.swap(ioIntervals);
+      aLeft.clear();
+      aRight.clear();
+    }
+    aNode._begin = _byLow.size();
+    std::sort(aCentered.begin(), aCentered.end(), ByLow(_intervals));
+    _byLow.insert(_byLow.end(), aCentered.begin(), aCentered.end());
+    std::sort(aCentered.begin(), aCentered.end(), ByHighDescending(_intervals));
+    _byHigh.insert(_byHigh.end(), aCentered.begin(), aCentered.end());
+    aNode._end = _byLow.size();
+    // Children are built after the node is stored, so it is updated through its index
+    size_t anIndex = _nodes.size();
+    _nodes.push_back(aNode);
+    size_t aLeftChild = build(aLeft);
+    size_t aRightChild = build(aRight);
+    _nodes[anIndex]._left = aLeftChild;
+    _nodes[anIndex]._right = aRightChild;
+    return anIndex;
+  }
+
+  void IntervalIndex::find(double iValue, std::vector<uint32_t>& oIds) const
+  {
+    size_t aCurrent = _nodes.empty() ? kNone : _root;
+    while (aCurrent != kNone)
+    {
+      const Node& aNode = _nodes[aCurrent];
+      if (iValue < aNode._center)
+      {
+        for (size_t i = aNode._begin;
+             (i < aNode._end) && (_intervals[_byLow[i]]._low <= iValue); ++i)
+        {
+          if (_intervals[_byLow[i]].contains(iValue))
+          {
+            oIds.push_back(_intervals[_byLow[i]]._id);
+          }
+        }
+        aCurrent = aNode._left;
+      } else if (iValue > aNode._center) {
+        for (size_t i = aNode._begin;
+             (i < aNode._end) && (_intervals[_byHigh[i]]._high >= iValue); ++i)
+        {
+          if (_intervals[_byHigh[i]].contains(iValue))
+          {
+            oIds.push_back(_intervals[_byHigh[i]]._id);
+          }
+        }
+        aCurrent = aNode._right;
+      } else {
+        for (size_t i = aNode._begin; i < aNode._end; ++i)
+        {
+          if (_intervals[_byLow[i]].contains(iValue))
+          {
+            oIds.push_back(_intervals[_byLow[i]]._id);
+          }
+        }
+        // NaN compares false with everything and ends here too
+        aCurrent = kNone;
+      }
+    }
+  }
+
+}}
@@ -0,0 +1,113 @@
+#include <mdw/formula/LazyRuleStore.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    class ByPriority {
+    public:
+      ByPriority(const std::vector<int>& iPriorities):
+        _priorities(iPriorities)
+      {}
+
+      bool operator()(size_t iLeft, size_t iRight) const
+      {
+        return _priorities[iLeft] > _priorities[iRight];
+      }
+
+    private:
+      const std::vector<int>& _priorities;
+    };
+  }
+
+  LazyRuleStore::LazyRuleStore(const Grammar& iGrammar, size_t iBlockSize):
+    _store(iGrammar, iBlockSize), _compiled(0), _stopping(false), _backgroundDone(false)
+  {}
+
+  LazyRuleStore::~LazyRuleStore()
+  {
+    stopBackground();
+  }
+
+  LazyRuleStore::Rule LazyRuleStore::add(const std::string& iFormula, int iPriority)
+  {
+    if (_background.joinable())
+    {
+      throw mdw::UnknownException("Cannot add rules while compiling in the background");
+    }
+    _rules.emplace_back(iFormula, iPriority);
+    return _rules.size() - 1;
+  }
+
+  const Expression& LazyRuleStore::get(Rule iRule)
+  {
+    Entry& anEntry = _rules[iRule];
+    const Expression *anExpression = anEntry._expression.load(std::memory_order_acquire);
+    if (!anExpression)
+    {
+      // Not done if parsing throws: the next call tries again
+      std::call_once(anEntry._once, &LazyRuleStore::compile, this, std::ref(anEntry));
+      anExpression = anEntry._expression.load(std::memory_order_acquire);
+    }
+    return *anExpression;
+  }
+
+  void LazyRuleStore::compile(Entry& ioEntry)
+  {
+    std::lock_guard<std::mutex> aLock(_storeMutex);
+    const Expression& anExpression = _store.get(_store.add(ioEntry._formula));
+    ioEntry._expression.store(&anExpression, std::memory_order_release);
+    ++_compiled;
+  }
+
+  void LazyRuleStore::startBackground()
+  {
+    if (!_background.joinable())
+    {
+      _stopping = false;
+      _backgroundDone = false;
+      _background = std::thread(&LazyRuleStore::runBackground, this);
+    }
+  }
+
+  void LazyRuleStore::stopBackground()
+  {
+    if (_background.joinable())
+    {
+      _stopping = true;
+      _background.join();
+    }
+  }
+
+  void LazyRuleStore::runBackground()
+  {
+    std::vector<int> aPriorities;
+    std::vector<size_t> anOrder(_rules.size());
+    for (size_t i = 0; i < _rules.size(); ++i)
+    {
+      aPriorities.push_back(_rules[i]._priority);
+      anOrder[i] = i;
+    }
+    std::stable_sort(anOrder.begin(), anOrder.end(), ByPriority(aPriorities));
+
+    size_t aFailed = 0;
+    for (size_t i = 0; (i < anOrder.size()) && !_stopping; ++i)
+    {
+      try
+      {
+        get(anOrder[i]);
+      }
+      catch (...)
+      {
+        // Reported to the callers of get()
+        ++aFailed;
+      }
+    }
+    FORMULA_DEBUG("Background compilation done, " << aFailed << " rules failed");
+    _backgroundDone = !_stopping;
+  }
+
+}}
@@ -12,5 +12,10 @@ namespace mdw { namespace formula {
     _subObserver = ioSubObserver;
   }
 
+  Expression& Observer::newSubRule(Expression& ioResult, const std::string& iName)
+  {
+    return _subObserver ? _subObserver->newSubRule(ioResult, iName) : ioResult;
+  }
+
 }}
 
@@ -0,0 +1,95 @@
+#include <mdw/formula/cache/OptimizationProfile.hpp>
+#include <mdw/UnknownException.hpp>
+#include <boost/foreach.hpp>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    const char kHeader[] = "formula-optimization-profile";
+    const size_t kVersion = 1;
+  }
+
+  void OptimizationProfile::NodeProfile::add(const NodeProfile& iOther)
+  {
+    _evaluations += iOther._evaluations;
+    _trues += iOther._trues;
+    _cacheLookups += iOther._cacheLookups;
+    _cacheHits += iOther._cacheHits;
+    _cost = iOther._cost;
+  }
+
+  void OptimizationProfile::merge(const OptimizationProfile& iOther)
+  {
+    BOOST_FOREACH(const Nodes::value_type& aNode, iOther._nodes)
+    {
+      _nodes[aNode.first].add(aNode.second);
+    }
+  }
+
+  void OptimizationProfile::save(std::ostream& oStream) const
+  {
+    oStream << kHeader << " " << kVersion << "\n";
+    BOOST_FOREACH(const Nodes::value_type& aNode, _nodes)
+    {
+      oStream << "node " << std::hex << std::setw(16) << std::setfill('0') << aNode.first
+              << std::dec << " " << aNode.second._evaluations << " " << aNode.second._trues
+              << " " << aNode.second._cacheLookups << " " << aNode.second._cacheHits
+              << " " << aNode.second._cost << "\n";
+    }
+  }
+
+  void OptimizationProfile::load(std::istream& iStream)
+  {
+    std::string aHeader;
+    size_t aVersion = 0;
+    iStream >> aHeader >> aVersion;
+    if (aHeader != kHeader || aVersion != kVersion)
+    {
+      throw mdw::UnknownException("Not an optimization profile or unsupported version: " +
+                                  aHeader);
+    }
+    std::string aLine;
+    while (std::getline(iStream, aLine))
+    {
+      std::istringstream aFields(aLine);
+      std::string aTag;
+      if (!(aFields >> aTag))
+      {
+        continue;
+      }
+      uint64_t aHash = 0;
+      NodeProfile aNode;
+      if (aTag != "node" ||
+          !(aFields >> std::hex >> aHash >> std::dec >> aNode._evaluations >> aNode._trues
+            >> aNode._cacheLookups >> aNode._cacheHits >> aNode._cost))
+      {
+        throw mdw::UnknownException("Invalid optimization profile entry: " + aLine);
+      }
+      _nodes[aHash].add(aNode);
+    }
+  }
+
+  void OptimizationProfile::save(const std::string& iFileName) const
+  {
+    std::ofstream aFile(iFileName.c_str());
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot write optimization profile to " + iFileName);
+    }
+    save(aFile);
+  }
+
+  void OptimizationProfile::load(const std::string& iFileName)
+  {
+    std::ifstream aFile(iFileName.c_str());
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot read optimization profile from " + iFileName);
+    }
+    load(aFile);
+  }
+
+}}
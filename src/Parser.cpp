@@ -8,12 +8,40 @@
 #include <mdw/formula/parse/flex/Lexer.hpp>
 
 #include <boost/foreach.hpp>
+#include <algorithm>
 #include <mdw/Tracer.hpp>
 
 extern int formulaparse(mdw::formula::Parser& ioParser);
 
 namespace mdw { namespace formula {
 
+  namespace {
+    // Owns the state of the reentrant flex scanner for one formula
+    class Scanner: private boost::noncopyable {
+    public:
+      Scanner(Parser& ioParser, const std::string& iFormula)
+      {
+        formulalex_init_extra(&ioParser, &_scanner);
+        _buffer = formula_scan_string(iFormula.c_str(), _scanner);
+      }
+
+      ~Scanner()
+      {
+        formula_delete_buffer(_buffer, _scanner);
+        formulalex_destroy(_scanner);
+      }
+
+      yyscan_t get() const
+      {
+        return _scanner;
+      }
+
+    private:
+      yyscan_t _scanner;
+      YY_BUFFER_STATE _buffer;
+    };
+  }
+
   Parser::AdditionalFacts::AdditionalFacts(ArenaAllocator& ioAllocator, const Grammar& iGrammar):
     _allocator(ioAllocator), _grammar(iGrammar)
   {}
@@ -47,14 +75,16 @@ namespace mdw { namespace formula {
   Parser::Parser(ArenaAllocator& ioAllocator, const Grammar& iGrammar,
                  const std::string& iFormula, AdditionalFacts *ioFacts):
     _allocator(ioAllocator), _grammar(iGrammar), _formula(&iFormula),
-    _topExpression(NULL), _additionalFacts(ioFacts), _observer(NULL), _ownedFacts(false)
+    _topExpression(NULL), _additionalFacts(ioFacts), _observer(NULL), _ownedFacts(false),
+    _scanner(NULL)
   {
     parse(iFormula);
   }
 
   Parser::Parser(ArenaAllocator& ioAllocator, const Grammar& iGrammar):
     _allocator(ioAllocator), _grammar(iGrammar), _formula(NULL),
-    _topExpression(NULL), _additionalFacts(NULL), _observer(NULL), _ownedFacts(false)
+    _topExpression(NULL), _additionalFacts(NULL), _observer(NULL), _ownedFacts(false),
+    _scanner(NULL)
   {}
 
   Parser::~Parser()
@@ -86,13 +116,27 @@ namespace mdw { namespace formula {
   {
     _formula = &iFormula;
 
-    formula_scan_string(iFormula.c_str());
+    Scanner aScanner(*this, iFormula);
+    _scanner = aScanner.get();
 
     FORMULA_DEBUG("Parsing formula: " << iFormula);
 
-    formulaparse(*this);
-    formulalex_destroy();
-    formula_delete_buffer(YY_CURRENT_BUFFER);
+    try
+    {
+      formulaparse(*this);
+    }
+    catch (...)
+    {
+      _scanner = NULL;
+      // The rule declaring them was not reduced, so they would hide the next formulas
+      BOOST_FOREACH(const std::string& aLocal, _locals)
+      {
+        _additionalFacts->removeFact(aLocal);
+      }
+      _locals.clear();
+      throw;
+    }
+    _scanner = NULL;
     return getTopExpression();
   }
 
@@ -184,6 +228,7 @@ namespace mdw { namespace formula {
         throw mdw::UnknownException("Temporary variable overloads itself: " + std::string(iName));
       }
       _additionalFacts->addFact(iName, *aTemporary);
+      _locals.push_back(iName);
     }
   }
 
@@ -194,6 +239,12 @@ namespace mdw { namespace formula {
       throw mdw::UnknownException("Cannot remove missing fact: " + std::string(iName));
     }
     _additionalFacts->removeFact(iName);
+    std::vector<std::string>::reverse_iterator aLocal =
+      std::find(_locals.rbegin(), _locals.rend(), iName);
+    if (aLocal != _locals.rend())
+    {
+      _locals.erase(--aLocal.base());
+    }
   }
 
   Expression& Parser::createChoice(Expression& iCondition, Expression& iLeft, Expression& iRight)
@@ -251,6 +302,18 @@ namespace mdw { namespace formula {
     }
   }
 
+  Expression& Parser::createSubRule(const char *iName)
+  {
+    std::string aName(iName);
+    Expression& aResult = getGrammar().instantiateSubRule(aName);
+    if (_observer)
+    {
+      return _observer->newSubRule(aResult, aName);
+    } else {
+      return aResult;
+    }
+  }
+
   Expression& Parser::createAttribute(Expression& iInput, const char *iName)
   {
     Expression& aResult = getGrammar().instantiateAttributeResolver(getAllocator(), iInput, iName);
@@ -0,0 +1,52 @@
+#include <mdw/formula/cache/PassManager.hpp>
+#include <mdw/formula/cache/DagReplayer.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+
+namespace mdw { namespace formula {
+
+  PassManager::PassManager(Factorizer& ioDag, const Grammar& iGrammar):
+    _dag(ioDag), _grammar(iGrammar)
+  {}
+
+  void PassManager::addPass(RewritePass& ioPass)
+  {
+    _passes.push_back(&ioPass);
+  }
+
+  size_t PassManager::run(std::vector<Expression*>& ioRules, size_t iMaxIterations)
+  {
+    Parser aParser(_dag.getAllocator(), _grammar);
+    aParser.addObserver(_dag);
+    size_t anIterations = 0;
+    bool aChanged = true;
+    while (aChanged && (anIterations < iMaxIterations))
+    {
+      aChanged = false;
+      ++anIterations;
+      BOOST_FOREACH(RewritePass *aPass, _passes)
+      {
+        // A new replayer for each pass, as the previous one memoizes the former nodes
+        DagReplayer aReplayer(_dag, aParser, aPass);
+        size_t aRewritten = 0;
+        BOOST_FOREACH(Expression *&aRule, ioRules)
+        {
+          Expression& aNew = aReplayer.replay(*aRule);
+          if (&aNew != aRule)
+          {
+            _dag.addRule(aNew);
+            _dag.retireRule(*aRule);
+            aRule = &aNew;
+            ++aRewritten;
+          }
+        }
+        FORMULA_DEBUG("Pass " << aPass->getName() << " rewrote " << aRewritten
+                      << " rules at iteration " << anIterations);
+        aChanged = aChanged || (aRewritten > 0);
+      }
+    }
+    return anIterations;
+  }
+
+}}
@@ -0,0 +1,355 @@
+#include <mdw/formula/RuleImage.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/cache/DagReplayer.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/lexical_cast.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    const char kMagic[8] = {'F', 'R', 'M', 'L', 'I', 'M', 'G', '\0'};
+    const uint32_t kVersion = 2;
+
+    // Layout: header, nodes, rules (node indexes), then the strings pool
+    struct ImageHeader {
+      char _magic[8];
+      uint32_t _version;
+      uint32_t _nodes;
+      uint32_t _rules;
+      uint32_t _stringsSize;
+    };
+
+    struct ImageNode {
+      uint8_t _kind; // As in Factorizer::NodeKey
+      uint8_t _type; // Constants only
+      uint8_t _childrenCount;
+      uint32_t _children[3]; // Always lower indexes
+      uint32_t _name; // Offset in the strings pool
+      uint32_t _nameSize;
+      uint64_t _value; // Constants only, strings are in the pool
+    };
+
+    const size_t kMaxChildren = 3;
+
+    void Write(std::ostream& oStream, const void *iData, size_t iSize)
+    {
+      oStream.write(static_cast<const char*>(iData), iSize);
+    }
+
+    // The nodes of an image, checked once so that replaying them cannot go out of it
+    class ImageSource: public DagReplayer::Source {
+    public:
+      ImageSource(const ImageHeader& iHeader, const char *iData):
+        _header(iHeader),
+        _nodes(reinterpret_cast<const ImageNode*>(iData + sizeof(ImageHeader))),
+        _strings(iData + sizeof(ImageHeader) + iHeader._nodes * sizeof(ImageNode) +
+                 iHeader._rules * sizeof(uint32_t))
+      {
+        _keys.reserve(_header._nodes);
+        for (uint32_t i = 0; i < _header._nodes; ++i)
+        {
+          _keys.push_back(getKey(i));
+        }
+      }
+
+      const Factorizer::NodeKey& getNodeKey(size_t iId) const
+      {
+        return _keys[iId];
+      }
+
+      Expression& createConstant(size_t iId, Parser& ioTarget) const
+      {
+        const ImageNode& aNode = _nodes[iId];
+        switch (aNode._type)
+        {
+          case kExprBool:
+            return ioTarget.createConstant<bool>(aNode._value != 0);
+          case kExprInt:
+            return ioTarget.createConstant<int64_t>(static_cast<int64_t>(aNode._value));
+          case kExprDouble:
+            {
+              double aValue;
+              std::memcpy(&aValue, &aNode._value, sizeof(aValue));
+              return ioTarget.createConstant<double>(aValue);
+            }
+          case kExprString:
+            // The constant only refers to its value
+            return ioTarget.createConstant<std::string>(
+              ioTarget.createString(_strings + aNode._name, aNode._nameSize));
+          default:
+            throw mdw::UnknownException("Invalid constant type in image: " +
+                                        mdw::lexical_cast<std::string>((int)aNode._type));
+        }
+      }
+
+    private:
+      static size_t GetChildrenCount(char iKind)
+      {
+        switch (iKind)
+        {
+          case 'c':
+          case 'f':
+          case 'r':
+            return 0;
+          case 'u':
+            return 1;
+          case 'b':
+          case '-':
+            return 2;
+          case '?':
+            return 3;
+          default:
+            return kMaxChildren + 1;
+        }
+      }
+
+      Factorizer::NodeKey getKey(uint32_t iIndex) const
+      {
+        const ImageNode& aNode = _nodes[iIndex];
+        if (aNode._childrenCount != GetChildrenCount(aNode._kind))
+        {
+          throw mdw::UnknownException("Invalid node in image: " +
+                                      mdw::lexical_cast<std::string>(iIndex));
+        }
+        Factorizer::NodeKey aKey;
+        for (size_t i = 0; i < aNode._childrenCount; ++i)
+        {
+          if (aNode._children[i] >= iIndex)
+          {
+            throw mdw::UnknownException("Invalid child in image: " +
+                                        mdw::lexical_cast<std::string>(iIndex));
+          }
+          aKey.second.push_back(aNode._children[i]);
+        }
+        if ((aNode._name > _header._stringsSize) ||
+            (aNode._nameSize > _header._stringsSize - aNode._name))
+        {
+          throw mdw::UnknownException("Invalid string in image");
+        }
+        std::string aName(_strings + aNode._name, aNode._nameSize);
+        switch (aNode._kind)
+        {
+          case 'c':
+          case '?':
+            aKey.first = aNode._kind;
+            break;
+          case '-':
+            aKey.first = "-> " + aName;
+            break;
+          default:
+            aKey.first = std::string(1, aNode._kind) + " " + aName;
+        }
+        return aKey;
+      }
+
+      const ImageHeader& _header;
+      const ImageNode *_nodes;
+      const char *_strings;
+      std::vector<Factorizer::NodeKey> _keys; // By node index
+    };
+  }
+
+  void RuleImage::Save(const Factorizer& iFactorizer, const std::vector<Expression*>& iRules,
+                       std::ostream& oStream)
+  {
+    // Nodes used by the rules
+    typedef boost::unordered_set<size_t> Used;
+    Used aUsed;
+    std::vector<size_t> aStack;
+    BOOST_FOREACH(const Expression *aRule, iRules)
+    {
+      aStack.push_back(iFactorizer.getNodeId(*aRule));
+    }
+    while (!aStack.empty())
+    {
+      size_t anId = aStack.back();
+      aStack.pop_back();
+      if (!aUsed.insert(anId).second)
+      {
+        continue;
+      }
+      const Factorizer::NodeKey& aKey = iFactorizer.getNodeKey(anId);
+      aStack.insert(aStack.end(), aKey.second.begin(), aKey.second.end());
+    }
+
+    // Children have lower ids than their parents: sorting the ids keeps this order
+    std::vector<size_t> anIds;
+    anIds.reserve(aUsed.size());
+    BOOST_FOREACH(size_t anId, aUsed)
+    {
+      anIds.push_back(anId);
+    }
+    std::sort(anIds.begin(), anIds.end());
+    boost::unordered_map<size_t, uint32_t> anIndexes;
+    for (size_t i = 0; i < anIds.size(); ++i)
+    {
+      anIndexes[anIds[i]] = i;
+    }
+
+    std::vector<ImageNode> aNodes(anIds.size());
+    std::string aStrings;
+    IContext aContext;
+    for (size_t i = 0; i < anIds.size(); ++i)
+    {
+      const Factorizer::NodeKey& aKey = iFactorizer.getNodeKey(anIds[i]);
+      ImageNode& aNode = aNodes[i];
+      std::memset(&aNode, 0, sizeof(aNode));
+      aNode._kind = aKey.first[0];
+      aNode._childrenCount = aKey.second.size();
+      for (size_t j = 0; j < aKey.second.size(); ++j)
+      {
+        aNode._children[j] = anIndexes[aKey.second[j]];
+      }
+      std::string aName;
+      if (aNode._kind == 'c')
+      {
+        const Expression& aConstant = iFactorizer.getParsedExpression(anIds[i]);
+        aNode._type = aConstant.getType();
+        switch (aConstant.getType())
+        {
+          case kExprBool:
+            aNode._value = aConstant.getBool().evaluate(aContext);
+            break;
+          case kExprInt:
+            aNode._value = aConstant.getInt().evaluate(aContext);
+            break;
+          case kExprDouble:
+            {
+              double aValue = aConstant.getDouble().evaluate(aContext);
+              std::memcpy(&aNode._value, &aValue, sizeof(aValue));
+            }
+            break;
+          case kExprString:
+            aName = aConstant.getString().evaluate(aContext);
+            break;
+          default:
+            throw mdw::UnknownException("Cannot save constant: " + aConstant.toString());
+        }
+      } else if (aNode._kind == '-') {
+        aName = aKey.first.substr(3);
+      } else if (aKey.first.size() > 2) {
+        aName = aKey.first.substr(2);
+      }
+      aNode._name = aStrings.size();
+      aNode._nameSize = aName.size();
+      aStrings += aName;
+    }
+
+    ImageHeader aHeader;
+    std::memcpy(aHeader._magic, kMagic, sizeof(kMagic));
+    aHeader._version = kVersion;
+    aHeader._nodes = aNodes.size();
+    aHeader._rules = iRules.size();
+    aHeader._stringsSize = aStrings.size();
+    Write(oStream, &aHeader, sizeof(aHeader));
+    if (!aNodes.empty())
+    {
+      Write(oStream, &aNodes[0], aNodes.size() * sizeof(ImageNode));
+    }
+    BOOST_FOREACH(const Expression *aRule, iRules)
+    {
+      uint32_t anIndex = anIndexes[iFactorizer.getNodeId(*aRule)];
+      Write(oStream, &anIndex, sizeof(anIndex));
+    }
+    Write(oStream, aStrings.data(), aStrings.size());
+  }
+
+  void RuleImage::Save(const Factorizer& iFactorizer, const std::vector<Expression*>& iRules,
+                       const std::string& iFileName)
+  {
+    std::ofstream aFile(iFileName.c_str(), std::ios::binary);
+    if (!aFile)
+    {
+      throw mdw::UnknownException("Cannot write rule image to " + iFileName);
+    }
+    Save(iFactorizer, iRules, aFile);
+    if (!aFile.flush())
+    {
+      throw mdw::UnknownException("Cannot write rule image to " + iFileName);
+    }
+  }
+
+  RuleImage::RuleImage(const std::string& iFileName):
+    _data(NULL), _size(0)
+  {
+    int aFile = open(iFileName.c_str(), O_RDONLY);
+    if (aFile < 0)
+    {
+      throw mdw::UnknownException("Cannot read rule image from " + iFileName);
+    }
+    struct stat aStat;
+    void *aData = MAP_FAILED;
+    if ((fstat(aFile, &aStat) == 0) && (aStat.st_size > 0))
+    {
+      _size = aStat.st_size;
+      aData = mmap(NULL, _size, PROT_READ, MAP_SHARED, aFile, 0);
+    }
+    close(aFile);
+    if (aData == MAP_FAILED)
+    {
+      throw mdw::UnknownException("Cannot map rule image " + iFileName);
+    }
+    _data = static_cast<const char*>(aData);
+
+    const ImageHeader *aHeader = reinterpret_cast<const ImageHeader*>(_data);
+    if ((_size < sizeof(ImageHeader)) ||
+        (std::memcmp(aHeader->_magic, kMagic, sizeof(kMagic)) != 0) ||
+        (aHeader->_version != kVersion) ||
+        (_size != sizeof(ImageHeader) + (uint64_t)aHeader->_nodes * sizeof(ImageNode) +
+         (uint64_t)aHeader->_rules * sizeof(uint32_t) + aHeader->_stringsSize))
+    {
+      munmap(const_cast<char*>(_data), _size);
+      throw mdw::UnknownException("Not a rule image or unsupported version: " + iFileName);
+    }
+  }
+
+  RuleImage::~RuleImage()
+  {
+    munmap(const_cast<char*>(_data), _size);
+  }
+
+  size_t RuleImage::getNodesCount() const
+  {
+    return reinterpret_cast<const ImageHeader*>(_data)->_nodes;
+  }
+
+  size_t RuleImage::getRulesCount() const
+  {
+    return reinterpret_cast<const ImageHeader*>(_data)->_rules;
+  }
+
+  void RuleImage::load(Parser& ioParser, std::vector<Expression*>& oRules) const
+  {
+    const ImageHeader& aHeader = *reinterpret_cast<const ImageHeader*>(_data);
+    ImageSource aSource(aHeader, _data);
+    DagReplayer aReplayer(aSource, ioParser);
+    const uint32_t *aRules =
+      reinterpret_cast<const uint32_t*>(_data + sizeof(ImageHeader) +
+                                        aHeader._nodes * sizeof(ImageNode));
+    oRules.reserve(oRules.size() + aHeader._rules);
+    for (uint32_t i = 0; i < aHeader._rules; ++i)
+    {
+      if (aRules[i] >= aHeader._nodes)
+      {
+        throw mdw::UnknownException("Invalid rule in image: " +
+                                    mdw::lexical_cast<std::string>(i));
+      }
+      oRules.push_back(&aReplayer.replay(aRules[i]));
+    }
+    FORMULA_DEBUG("Loaded " << aHeader._rules << " rules from " << aHeader._nodes
+                  << " nodes");
+  }
+
+}}
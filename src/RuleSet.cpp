@@ -0,0 +1,767 @@
+#include <mdw/formula/RuleSet.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    // Values of the atoms and terms
+    const unsigned char kFalse = 0;
+    const unsigned char kTrue = 1;
+    const unsigned char kUnknown = 2;
+    const unsigned char kPending = 3; // Atoms not evaluated yet
+
+    // A term shared by more rules than 1 in 4 words has a whole bitmap
+    const size_t kDenseRatio = 4;
+
+    // Value of a numeric path, false if unknown. Integers beyond 2^53 lose precision.
+    bool EvaluateNumber(const Expression& iPath, IContext& ioContext, double& oValue)
+    {
+      try {
+        if (iPath.getType() == kExprInt)
+        {
+          oValue = iPath.getInt().evaluate(ioContext);
+        } else {
+          oValue = iPath.getDouble().evaluate(ioContext);
+        }
+      } catch (const ValueException&) {
+        return false;
+      }
+      if (ioContext.isNaN())
+      {
+        ioContext.ignoreNaN();
+        return false;
+      }
+      return true;
+    }
+
+    bool IsNumeric(ExpressionType iType)
+    {
+      return (iType == kExprInt) || (iType == kExprDouble);
+    }
+
+    // Orders atoms by increasing score
+    class ByScore {
+    public:
+      explicit ByScore(const std::vector<double>& iScores):
+        _scores(iScores)
+      {}
+
+      bool operator()(uint32_t iLeft, uint32_t iRight) const
+      {
+        return _scores[iLeft] < _scores[iRight];
+      }
+
+    private:
+      const std::vector<double>& _scores;
+    };
+
+    // Orders rules by decreasing priority
+    class ByPriority {
+    public:
+      explicit ByPriority(const std::vector<int>& iPriorities):
+        _priorities(iPriorities)
+      {}
+
+      bool operator()(uint32_t iLeft, uint32_t iRight) const
+      {
+        return _priorities[iLeft] > _priorities[iRight];
+      }
+
+    private:
+      const std::vector<int>& _priorities;
+    };
+  }
+
+  class RuleSet::AtomValues {
+  public:
+    AtomValues(const RuleSet& iSet, IContext& ioContext):
+      _set(iSet), _context(ioContext)
+    {}
+
+    size_t operator()(uint32_t iAtom)
+    {
+      return _set.evaluateAtom(iAtom, _context);
+    }
+
+  private:
+    const RuleSet& _set;
+    IContext& _context;
+  };
+
+  RuleSet::RuleSet(const Grammar& iGrammar):
+    _grammar(iGrammar), _parser(_dag.getAllocator(), iGrammar), _indexedRules(0),
+    _diagramLimit(0), _diagram(NULL), _compiled(true)
+  {
+    _dag.observe(iGrammar);
+    _parser.addObserver(_dag);
+  }
+
+  RuleSet::~RuleSet()
+  {
+    delete _diagram;
+  }
+
+  RuleSet::Rule RuleSet::add(const std::string& iFormula, int iPriority)
+  {
+    if (_rules.size() >= std::numeric_limits<Rule>::max())
+    {
+      throw mdw::UnknownException("Too many rules in the set");
+    }
+    Expression& aRule = _parser.parse(iFormula);
+    if (aRule.getType() != kExprBool)
+    {
+      throw mdw::UnknownException("Not a boolean rule: " + iFormula);
+    }
+    _dag.addRule(aRule);
+    std::vector<uint32_t> aTerms;
+    addConjuncts(_dag.getNodeId(aRule), aTerms);
+    _rules.push_back(aTerms);
+    _priorities.push_back(iPriority);
+    _compiled = false;
+    return _rules.size() - 1;
+  }
+
+  bool RuleSet::isLogical(const Factorizer::NodeKey& iKey, size_t iNode,
+                          const char *iKind) const
+  {
+    return (iKey.first == iKind) && (_dag.getParsedExpression(iNode).getType() == kExprBool);
+  }
+
+  void RuleSet::addConjuncts(size_t iNode, std::vector<uint32_t>& oTerms)
+  {
+    const Factorizer::NodeKey& aKey = _dag.getNodeKey(iNode);
+    if (isLogical(aKey, iNode, "b &&"))
+    {
+      addConjuncts(aKey.second[0], oTerms);
+      addConjuncts(aKey.second[1], oTerms);
+    } else {
+      oTerms.push_back(getTerm(iNode));
+    }
+  }
+
+  uint32_t RuleSet::getTerm(size_t iNode)
+  {
+    Indexes::const_iterator aKnown = _termIndexes.find(iNode);
+    if (aKnown != _termIndexes.end())
+    {
+      return aKnown->second;
+    }
+    Term aTerm;
+    aTerm._programBegin = _program.size();
+    emit(iNode);
+    aTerm._programEnd = _program.size();
+    setGuard(aTerm, iNode);
+    setRange(aTerm, iNode);
+    aTerm._dense = false;
+    aTerm._rulesBegin = aTerm._rulesEnd = 0;
+    _terms.push_back(aTerm);
+    return _termIndexes[iNode] = _terms.size() - 1;
+  }
+
+  // Doubles are not indexed, as equal values may have different representations.
+  // Neither are paths of another type than the constant (C strings, user types), as
+  // the value of the path must be in a ValueKey to be looked up.
+  void RuleSet::setGuard(Term& ioTerm, size_t iNode)
+  {
+    ioTerm._guardPath = kNoGuard;
+    const Factorizer::NodeKey& aKey = _dag.getNodeKey(iNode);
+    if (aKey.first != "b ==")
+    {
+      return;
+    }
+    size_t aLeft = aKey.second[0];
+    size_t aRight = aKey.second[1];
+    bool aLeftConstant = _dag.getNodeKey(aLeft).first[0] == 'c';
+    bool aRightConstant = _dag.getNodeKey(aRight).first[0] == 'c';
+    if (aLeftConstant == aRightConstant)
+    {
+      return;
+    }
+    const Expression& aConstant = _dag.getParsedExpression(aLeftConstant ? aLeft : aRight);
+    size_t aPath = aLeftConstant ? aRight : aLeft;
+    ExpressionType aType = aConstant.getType();
+    if (!ValueKey::IsSupported(aType) || (aType == kExprDouble) ||
+        (_dag.getParsedExpression(aPath).getType() != aType))
+    {
+      return;
+    }
+    IContext aContext;
+    if (ioTerm._guardValue.appendValue(aConstant, aContext))
+    {
+      ioTerm._guardPath = aPath;
+    }
+  }
+
+  void RuleSet::setRange(Term& ioTerm, size_t iNode)
+  {
+    ioTerm._rangePath = kNoGuard;
+    const Factorizer::NodeKey& aKey = _dag.getNodeKey(iNode);
+    if ((aKey.first != "b <") && (aKey.first != "b <=") &&
+        (aKey.first != "b >") && (aKey.first != "b >="))
+    {
+      return;
+    }
+    size_t aLeft = aKey.second[0];
+    size_t aRight = aKey.second[1];
+    bool aLeftConstant = _dag.getNodeKey(aLeft).first[0] == 'c';
+    bool aRightConstant = _dag.getNodeKey(aRight).first[0] == 'c';
+    if (aLeftConstant == aRightConstant)
+    {
+      return;
+    }
+    const Expression& aConstant = _dag.getParsedExpression(aLeftConstant ? aLeft : aRight);
+    size_t aPath = aLeftConstant ? aRight : aLeft;
+    IContext aContext;
+    if (!IsNumeric(aConstant.getType()) ||
+        !IsNumeric(_dag.getParsedExpression(aPath).getType()) ||
+        !EvaluateNumber(aConstant, aContext, ioTerm._rangeBound))
+    {
+      return;
+    }
+    // 'c < path' is a lower bound of the path
+    ioTerm._rangePath = aPath;
+    ioTerm._rangeLow = (aKey.first[2] == '>') != aLeftConstant;
+    ioTerm._rangeClosed = aKey.first.size() == 4;
+  }
+
+  void RuleSet::emit(size_t iNode)
+  {
+    const Factorizer::NodeKey& aKey = _dag.getNodeKey(iNode);
+    Instruction anInstruction;
+    anInstruction._atom = 0;
+    if (isLogical(aKey, iNode, "b &&") || isLogical(aKey, iNode, "b ||"))
+    {
+      emit(aKey.second[0]);
+      emit(aKey.second[1]);
+      anInstruction._operation = (aKey.first == "b &&") ? kAnd : kOr;
+    } else if (isLogical(aKey, iNode, "u !")) {
+      emit(aKey.second[0]);
+      anInstruction._operation = kNot;
+    } else {
+      anInstruction._operation = kAtom;
+      Indexes::const_iterator aKnown = _atomIndexes.find(iNode);
+      if (aKnown != _atomIndexes.end())
+      {
+        anInstruction._atom = aKnown->second;
+      } else {
+        anInstruction._atom = _atoms.size();
+        _atoms.push_back(&_dag.getParsedExpression(iNode).getBool());
+        _atomIndexes[iNode] = anInstruction._atom;
+      }
+    }
+    _program.push_back(anInstruction);
+  }
+
+  void RuleSet::compile()
+  {
+    size_t aWords = (_rules.size() + 63) / 64;
+    // Each rule is indexed by its guard on the path shared by most rules, or else by
+    // its ranges on the numeric path shared by most rules
+    PathCounts aGuardPaths;
+    countPaths(&Term::_guardPath, aGuardPaths);
+    PathCounts aRangePaths;
+    countPaths(&Term::_rangePath, aRangePaths);
+    _indexes.clear();
+    _rangeIndexes.clear();
+    _unindexed.assign(aWords, 0);
+    _indexedRules = 0;
+    Indexes aGuardIndexes;
+    Indexes aRangeIndexes;
+    std::vector<std::vector<Block> > aBlocks(_terms.size());
+    for (size_t aRule = 0; aRule < _rules.size(); ++aRule)
+    {
+      uint32_t aWord = aRule / 64;
+      uint64_t aBit = uint64_t(1) << (aRule % 64);
+      const std::vector<uint32_t>& aTerms = _rules[aRule];
+      size_t aGuardPath = choosePath(aTerms, &Term::_guardPath, aGuardPaths);
+      size_t aRangePath = (aGuardPath == kNoGuard) ?
+        choosePath(aTerms, &Term::_rangePath, aRangePaths) : kNoGuard;
+      const Term *aGuard = NULL;
+      if (aGuardPath != kNoGuard)
+      {
+        for (size_t i = 0; !aGuard; ++i)
+        {
+          if (_terms[aTerms[i]]._guardPath == aGuardPath)
+          {
+            aGuard = &_terms[aTerms[i]];
+          }
+        }
+        Indexes::const_iterator anIndex = aGuardIndexes.find(aGuardPath);
+        if (anIndex == aGuardIndexes.end())
+        {
+          anIndex = aGuardIndexes.insert(std::make_pair(aGuardPath, _indexes.size())).first;
+          _indexes.push_back(Index());
+          _indexes.back()._path = &_dag.getParsedExpression(aGuardPath);
+        }
+        _indexes[anIndex->second]._candidates[aGuard->_guardValue].push_back(aRule);
+        ++_indexedRules;
+      } else if (aRangePath != kNoGuard) {
+        IntervalIndex::Interval anInterval;
+        anInterval._id = aRule;
+        BOOST_FOREACH(uint32_t aTerm, aTerms)
+        {
+          const Term& aRange = _terms[aTerm];
+          if (aRange._rangePath != aRangePath)
+          {
+            continue;
+          } else if (aRange._rangeLow) {
+            anInterval.restrictLow(aRange._rangeBound, aRange._rangeClosed);
+          } else {
+            anInterval.restrictHigh(aRange._rangeBound, aRange._rangeClosed);
+          }
+        }
+        Indexes::const_iterator anIndex = aRangeIndexes.find(aRangePath);
+        if (anIndex == aRangeIndexes.end())
+        {
+          anIndex = aRangeIndexes.insert(std::make_pair(aRangePath,
+                                                        _rangeIndexes.size())).first;
+          _rangeIndexes.push_back(RangeIndex());
+          _rangeIndexes.back()._path = &_dag.getParsedExpression(aRangePath);
+        }
+        _rangeIndexes[anIndex->second]._intervals.add(anInterval);
+        ++_indexedRules;
+      } else {
+        _unindexed[aWord] |= aBit;
+      }
+      // The guard or the ranges of an indexed rule are checked by the index
+      BOOST_FOREACH(uint32_t aTerm, aTerms)
+      {
+        if ((&_terms[aTerm] == aGuard) ||
+            ((aRangePath != kNoGuard) && (_terms[aTerm]._rangePath == aRangePath)))
+        {
+          continue;
+        }
+        std::vector<Block>& aTermBlocks = aBlocks[aTerm];
+        if (aTermBlocks.empty() || (aTermBlocks.back()._word != aWord))
+        {
+          Block aBlock;
+          aBlock._word = aWord;
+          aBlock._rules = 0;
+          aTermBlocks.push_back(aBlock);
+        }
+        aTermBlocks.back()._rules |= aBit;
+      }
+    }
+    BOOST_FOREACH(RangeIndex& anIndex, _rangeIndexes)
+    {
+      anIndex._intervals.build();
+    }
+    _byPriority.resize(_rules.size());
+    for (size_t i = 0; i < _rules.size(); ++i)
+    {
+      _byPriority[i] = i;
+    }
+    std::stable_sort(_byPriority.begin(), _byPriority.end(), ByPriority(_priorities));
+    _ranks.resize(_rules.size());
+    _unindexedRanks.assign(aWords, 0);
+    for (size_t aRank = 0; aRank < _rules.size(); ++aRank)
+    {
+      Rule aRule = _byPriority[aRank];
+      _ranks[aRule] = aRank;
+      if (_unindexed[aRule / 64] & (uint64_t(1) << (aRule % 64)))
+      {
+        _unindexedRanks[aRank / 64] |= uint64_t(1) << (aRank % 64);
+      }
+    }
+    _denseRules.clear();
+    _sparseRules.clear();
+    size_t aDenseCount = 0;
+    for (size_t i = 0; i < _terms.size(); ++i)
+    {
+      Term& aTerm = _terms[i];
+      aTerm._dense = aBlocks[i].size() * kDenseRatio > aWords;
+      if (aTerm._dense)
+      {
+        aTerm._rulesBegin = _denseRules.size();
+        _denseRules.resize(_denseRules.size() + aWords, 0);
+        BOOST_FOREACH(const Block& aBlock, aBlocks[i])
+        {
+          _denseRules[aTerm._rulesBegin + aBlock._word] = aBlock._rules;
+        }
+        aTerm._rulesEnd = _denseRules.size();
+        ++aDenseCount;
+      } else {
+        aTerm._rulesBegin = _sparseRules.size();
+        _sparseRules.insert(_sparseRules.end(), aBlocks[i].begin(), aBlocks[i].end());
+        aTerm._rulesEnd = _sparseRules.size();
+      }
+    }
+    _compiled = true;
+    FORMULA_DEBUG("Compiled " << _rules.size() << " rules into " << _terms.size()
+                  << " terms (" << aDenseCount << " dense) of " << _atoms.size() << " atoms, "
+                  << _indexedRules << " rules indexed on " << _indexes.size() << " + "
+                  << _rangeIndexes.size() << " paths");
+    compileDiagram();
+  }
+
+  void RuleSet::compileDiagram()
+  {
+    delete _diagram;
+    _diagram = NULL;
+    if (!_diagramLimit)
+    {
+      return;
+    }
+    // Cheap atoms used by many rules first: they are the most likely to be needed
+    std::vector<double> aScores(_atoms.size(), 0);
+    BOOST_FOREACH(const Indexes::value_type& anAtom, _atomIndexes)
+    {
+      aScores[anAtom.second] = getCost(anAtom.first);
+    }
+    std::vector<size_t> aUses(_atoms.size(), 0);
+    BOOST_FOREACH(const std::vector<uint32_t>& aTerms, _rules)
+    {
+      BOOST_FOREACH(uint32_t aTerm, aTerms)
+      {
+        for (size_t i = _terms[aTerm]._programBegin; i < _terms[aTerm]._programEnd; ++i)
+        {
+          if (_program[i]._operation == kAtom)
+          {
+            ++aUses[_program[i]._atom];
+          }
+        }
+      }
+    }
+    std::vector<uint32_t> anOrder(_atoms.size());
+    for (size_t i = 0; i < _atoms.size(); ++i)
+    {
+      aScores[i] /= std::max(aUses[i], size_t(1));
+      anOrder[i] = i;
+    }
+    std::stable_sort(anOrder.begin(), anOrder.end(), ByScore(aScores));
+
+    DecisionDiagram *aDiagram = new DecisionDiagram(anOrder, _diagramLimit);
+    std::vector<DecisionDiagram::Function> aTerms(_terms.size());
+    std::vector<DecisionDiagram::Function> aStack;
+    for (size_t aTerm = 0; aTerm < _terms.size(); ++aTerm)
+    {
+      aStack.clear();
+      for (size_t i = _terms[aTerm]._programBegin; i < _terms[aTerm]._programEnd; ++i)
+      {
+        const Instruction& anInstruction = _program[i];
+        if (anInstruction._operation == kAtom)
+        {
+          aStack.push_back(aDiagram->atom(anInstruction._atom));
+        } else if (anInstruction._operation == kNot) {
+          aStack.back() = aDiagram->negate(aStack.back());
+        } else {
+          DecisionDiagram::Function aRight = aStack.back();
+          aStack.pop_back();
+          aStack.back() = (anInstruction._operation == kAnd) ?
+            aDiagram->conjunction(aStack.back(), aRight) :
+            aDiagram->disjunction(aStack.back(), aRight);
+        }
+      }
+      aTerms[aTerm] = aStack.back();
+    }
+    for (size_t aRule = 0; (aRule < _rules.size()) && !aDiagram->isFull(); ++aRule)
+    {
+      DecisionDiagram::Function aFunction = DecisionDiagram::kTrue;
+      BOOST_FOREACH(uint32_t aTerm, _rules[aRule])
+      {
+        aFunction = aDiagram->conjunction(aFunction, aTerms[aTerm]);
+      }
+      aDiagram->addRule(aFunction, aRule);
+    }
+    if (aDiagram->isFull())
+    {
+      FORMULA_DEBUG("Decision diagram of " << _rules.size() << " rules over "
+                    << _atoms.size() << " atoms above " << _diagramLimit);
+      delete aDiagram;
+      return;
+    }
+    aDiagram->shrink();
+    _diagram = aDiagram;
+    FORMULA_DEBUG("Decision diagram of " << _rules.size() << " rules: "
+                  << _diagram->getNodesCount() << " nodes, "
+                  << _diagram->getLeavesCount() << " leaves");
+  }
+
+  double RuleSet::getCost(size_t iNode) const
+  {
+    double aCost = _dag.getCostModel().getCost(_dag.getParsedExpression(iNode));
+    BOOST_FOREACH(size_t aChild, _dag.getNodeKey(iNode).second)
+    {
+      aCost += getCost(aChild);
+    }
+    return aCost;
+  }
+
+  void RuleSet::countPaths(size_t Term::*iPath, PathCounts& oCounts) const
+  {
+    BOOST_FOREACH(const std::vector<uint32_t>& aTerms, _rules)
+    {
+      PathCounts aRulePaths;
+      BOOST_FOREACH(uint32_t aTerm, aTerms)
+      {
+        size_t aPath = _terms[aTerm].*iPath;
+        if ((aPath != kNoGuard) && aRulePaths.insert(std::make_pair(aPath, 0)).second)
+        {
+          ++oCounts[aPath];
+        }
+      }
+    }
+  }
+
+  size_t RuleSet::choosePath(const std::vector<uint32_t>& iTerms, size_t Term::*iPath,
+                             const PathCounts& iCounts) const
+  {
+    size_t aBest = kNoGuard;
+    size_t aBestCount = 0;
+    BOOST_FOREACH(uint32_t aTerm, iTerms)
+    {
+      size_t aPath = _terms[aTerm].*iPath;
+      if (aPath != kNoGuard)
+      {
+        size_t aCount = iCounts.find(aPath)->second;
+        if (aCount > aBestCount)
+        {
+          aBest = aPath;
+          aBestCount = aCount;
+        }
+      }
+    }
+    return aBest;
+  }
+
+  bool RuleSet::isLive(const Term& iTerm, const std::vector<uint64_t>& iMatches) const
+  {
+    uint64_t aLive = 0;
+    if (iTerm._dense)
+    {
+      const uint64_t *aRules = &_denseRules[iTerm._rulesBegin];
+      for (size_t i = 0; i < iMatches.size(); ++i)
+      {
+        aLive |= iMatches[i] & aRules[i];
+      }
+    } else {
+      for (size_t i = iTerm._rulesBegin; i < iTerm._rulesEnd; ++i)
+      {
+        aLive |= iMatches[_sparseRules[i]._word] & _sparseRules[i]._rules;
+      }
+    }
+    return aLive != 0;
+  }
+
+  unsigned char RuleSet::evaluateAtom(uint32_t iAtom, IContext& ioContext) const
+  {
+    unsigned char aValue = kUnknown;
+    try {
+      aValue = _atoms[iAtom]->evaluate(ioContext) ? kTrue : kFalse;
+    } catch (const ValueException&) {
+      return kUnknown;
+    }
+    if (ioContext.isNaN())
+    {
+      ioContext.ignoreNaN();
+      return kUnknown;
+    }
+    return aValue;
+  }
+
+  unsigned char RuleSet::evaluate(const Term& iTerm, IContext& ioContext,
+                                  std::vector<unsigned char>& ioAtoms,
+                                  std::vector<unsigned char>& ioStack) const
+  {
+    ioStack.clear();
+    for (size_t i = iTerm._programBegin; i < iTerm._programEnd; ++i)
+    {
+      const Instruction& anInstruction = _program[i];
+      if (anInstruction._operation == kAtom)
+      {
+        unsigned char& anAtom = ioAtoms[anInstruction._atom];
+        if (anAtom == kPending)
+        {
+          anAtom = evaluateAtom(anInstruction._atom, ioContext);
+        }
+        ioStack.push_back(anAtom);
+      } else if (anInstruction._operation == kNot) {
+        unsigned char& aValue = ioStack.back();
+        aValue = (aValue == kUnknown) ? kUnknown : (kTrue - aValue);
+      } else if (anInstruction._operation == kAnd) {
+        unsigned char aRight = ioStack.back();
+        ioStack.pop_back();
+        unsigned char& aLeft = ioStack.back();
+        // Both operands are evaluated, and an exception or NaN of either one goes through
+        if ((aLeft == kUnknown) || (aRight == kUnknown))
+        {
+          aLeft = kUnknown;
+        } else if (aRight == kFalse) {
+          aLeft = kFalse;
+        }
+      } else {
+        unsigned char aRight = ioStack.back();
+        ioStack.pop_back();
+        unsigned char& aLeft = ioStack.back();
+        // As LogicalOrOperator: a left operand which is not true gives the right one
+        if (aLeft != kTrue)
+        {
+          aLeft = aRight;
+        }
+      }
+    }
+    return ioStack.back();
+  }
+
+  void RuleSet::findCandidates(IContext& ioContext, bool iByRank,
+                               std::vector<uint64_t>& ioRules) const
+  {
+    ValueKey aValue;
+    BOOST_FOREACH(const Index& anIndex, _indexes)
+    {
+      aValue.clear();
+      if (!aValue.appendValue(*anIndex._path, ioContext))
+      {
+        // Unknown path: none of its guards is true
+        ioContext.ignoreNaN();
+        continue;
+      }
+      boost::unordered_map<ValueKey, std::vector<Rule> >::const_iterator aCandidates =
+        anIndex._candidates.find(aValue);
+      if (aCandidates != anIndex._candidates.end())
+      {
+        BOOST_FOREACH(Rule aRule, aCandidates->second)
+        {
+          uint32_t aBit = iByRank ? _ranks[aRule] : aRule;
+          ioRules[aBit / 64] |= uint64_t(1) << (aBit % 64);
+        }
+      }
+    }
+
+    std::vector<uint32_t> aFound;
+    BOOST_FOREACH(const RangeIndex& anIndex, _rangeIndexes)
+    {
+      double aNumber = 0;
+      if (EvaluateNumber(*anIndex._path, ioContext, aNumber))
+      {
+        aFound.clear();
+        anIndex._intervals.find(aNumber, aFound);
+        BOOST_FOREACH(uint32_t aRule, aFound)
+        {
+          uint32_t aBit = iByRank ? _ranks[aRule] : aRule;
+          ioRules[aBit / 64] |= uint64_t(1) << (aBit % 64);
+        }
+      }
+    }
+  }
+
+  size_t RuleSet::match(IContext& ioContext, Rule *oMatches, size_t iCapacity) const
+  {
+    if (!_compiled)
+    {
+      throw mdw::UnknownException("Rules added since the RuleSet was compiled");
+    }
+    if (_diagram)
+    {
+      AtomValues anAtoms(*this, ioContext);
+      const std::vector<uint32_t>& aRules = _diagram->find(anAtoms);
+      std::copy(aRules.begin(), aRules.begin() + std::min(aRules.size(), iCapacity),
+                oMatches);
+      return aRules.size();
+    }
+    std::vector<uint64_t> aMatches(_unindexed);
+    findCandidates(ioContext, false, aMatches);
+
+    std::vector<unsigned char> anAtoms(_atoms.size(), kPending);
+    std::vector<unsigned char> aStack;
+    BOOST_FOREACH(const Term& aTerm, _terms)
+    {
+      if (!isLive(aTerm, aMatches) || (evaluate(aTerm, ioContext, anAtoms, aStack) == kTrue))
+      {
+        continue;
+      }
+      if (aTerm._dense)
+      {
+        // Plain loop over contiguous words: vectorized by the compiler
+        const uint64_t *aRules = &_denseRules[aTerm._rulesBegin];
+        uint64_t *aResult = &aMatches[0];
+        for (size_t i = 0; i < aMatches.size(); ++i)
+        {
+          aResult[i] &= ~aRules[i];
+        }
+      } else {
+        for (size_t i = aTerm._rulesBegin; i < aTerm._rulesEnd; ++i)
+        {
+          aMatches[_sparseRules[i]._word] &= ~_sparseRules[i]._rules;
+        }
+      }
+    }
+
+    size_t aCount = 0;
+    for (size_t i = 0; i < aMatches.size(); ++i)
+    {
+      for (uint64_t aWord = aMatches[i]; aWord; aWord &= aWord - 1)
+      {
+        if (aCount < iCapacity)
+        {
+          oMatches[aCount] = i * 64 + __builtin_ctzll(aWord);
+        }
+        ++aCount;
+      }
+    }
+    return aCount;
+  }
+
+  bool RuleSet::matchFirst(IContext& ioContext, Rule& oRule) const
+  {
+    if (!_compiled)
+    {
+      throw mdw::UnknownException("Rules added since the RuleSet was compiled");
+    }
+    if (_diagram)
+    {
+      AtomValues anAtoms(*this, ioContext);
+      const std::vector<uint32_t>& aRules = _diagram->find(anAtoms);
+      if (aRules.empty())
+      {
+        return false;
+      }
+      oRule = aRules[0];
+      BOOST_FOREACH(Rule aRule, aRules)
+      {
+        if (_ranks[aRule] < _ranks[oRule])
+        {
+          oRule = aRule;
+        }
+      }
+      return true;
+    }
+    std::vector<uint64_t> aCandidates(_unindexedRanks);
+    findCandidates(ioContext, true, aCandidates);
+
+    std::vector<unsigned char> anAtoms(_atoms.size(), kPending);
+    std::vector<unsigned char> aTerms(_terms.size(), kPending);
+    std::vector<unsigned char> aStack;
+    for (size_t i = 0; i < aCandidates.size(); ++i)
+    {
+      for (uint64_t aWord = aCandidates[i]; aWord; aWord &= aWord - 1)
+      {
+        Rule aRule = _byPriority[i * 64 + __builtin_ctzll(aWord)];
+        // Terms already checked by the indexes are evaluated again, but each term
+        // and atom is only evaluated once for all the rules
+        bool aTrue = true;
+        for (size_t j = 0; aTrue && (j < _rules[aRule].size()); ++j)
+        {
+          uint32_t aTerm = _rules[aRule][j];
+          if (aTerms[aTerm] == kPending)
+          {
+            aTerms[aTerm] = evaluate(_terms[aTerm], ioContext, anAtoms, aStack);
+          }
+          aTrue = aTerms[aTerm] == kTrue;
+        }
+        if (aTrue)
+        {
+          oRule = aRule;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+}}
@@ -0,0 +1,172 @@
+#include <mdw/formula/RuleSetHolder.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <new>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    std::atomic<size_t> gReadersCount(0);
+    // Where the thread looks for a free slot first: distinct threads start from distinct
+    // slots, and a thread pinning again usually finds the slot it has just released
+    thread_local size_t tSlotHint = gReadersCount++;
+  }
+
+  RuleSetHolder::Slots::Slots(size_t iCount, Slots *iNext):
+    _buffer(new char[iCount * sizeof(Slot) + alignof(Slot)]), _count(iCount), _next(iNext)
+  {
+    size_t aMisalignment = reinterpret_cast<uintptr_t>(_buffer) % alignof(Slot);
+    size_t anOffset = aMisalignment ? alignof(Slot) - aMisalignment : 0;
+    _slots = reinterpret_cast<Slot*>(_buffer + anOffset);
+    for (size_t i = 0; i < _count; ++i)
+    {
+      new (_slots + i) Slot();
+    }
+  }
+
+  RuleSetHolder::Slots::~Slots()
+  {
+    delete[] _buffer;
+  }
+
+  RuleSetHolder::RuleSetHolder(size_t iMaxReaders):
+    _slots(new Slots(std::max(iMaxReaders, (size_t)1), NULL)), _current(NULL), _lastNumber(0)
+  {}
+
+  RuleSetHolder::~RuleSetHolder()
+  {
+    Slots *aSlots = _slots.load();
+    while (aSlots)
+    {
+      Slots *aNext = aSlots->_next;
+      delete aSlots;
+      aSlots = aNext;
+    }
+    BOOST_FOREACH(Version *aVersion, _retired)
+    {
+      delete aVersion->_rules;
+      delete aVersion;
+    }
+    Version *aCurrent = _current.load();
+    if (aCurrent)
+    {
+      delete aCurrent->_rules;
+      delete aCurrent;
+    }
+  }
+
+  uint64_t RuleSetHolder::publish(RuleStore *ioRules)
+  {
+    std::lock_guard<std::mutex> aLock(_writerMutex);
+    Version *aVersion = new Version(ioRules, ++_lastNumber);
+    Version *aFormer = _current.exchange(aVersion);
+    if (aFormer)
+    {
+      _retired.push_back(aFormer);
+    }
+    FORMULA_DEBUG("Published rules version " << aVersion->_number);
+    return aVersion->_number;
+  }
+
+  size_t RuleSetHolder::reclaim()
+  {
+    std::vector<Version*> aReclaimed;
+    {
+      std::lock_guard<std::mutex> aLock(_writerMutex);
+      std::vector<Version*> aPinned;
+      BOOST_FOREACH(Version *aVersion, _retired)
+      {
+        (isPinned(aVersion) ? aPinned : aReclaimed).push_back(aVersion);
+      }
+      _retired.swap(aPinned);
+    }
+    // Outside the lock: freeing big arenas must not delay the other writers
+    BOOST_FOREACH(Version *aVersion, aReclaimed)
+    {
+      FORMULA_DEBUG("Reclaimed rules version " << aVersion->_number);
+      delete aVersion->_rules;
+      delete aVersion;
+    }
+    return aReclaimed.size();
+  }
+
+  size_t RuleSetHolder::getRetiredCount() const
+  {
+    std::lock_guard<std::mutex> aLock(_writerMutex);
+    return _retired.size();
+  }
+
+  bool RuleSetHolder::isPinned(const Version *iVersion) const
+  {
+    for (const Slots *aSlots = _slots.load(); aSlots; aSlots = aSlots->_next)
+    {
+      for (size_t i = 0; i < aSlots->_count; ++i)
+      {
+        if (aSlots->_slots[i]._hazard.load() == iVersion)
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  RuleSetHolder::Slot& RuleSetHolder::acquireSlot()
+  {
+    Slots *aHead = _slots.load(std::memory_order_acquire);
+    for (Slots *aSlots = aHead; aSlots; aSlots = aSlots->_next)
+    {
+      for (size_t i = 0; i < aSlots->_count; ++i)
+      {
+        size_t anIndex = (tSlotHint + i) % aSlots->_count;
+        Slot& aSlot = aSlots->_slots[anIndex];
+        bool aFree = false;
+        if (!aSlot._taken.load(std::memory_order_relaxed) &&
+            aSlot._taken.compare_exchange_strong(aFree, true, std::memory_order_acquire))
+        {
+          tSlotHint = anIndex;
+          return aSlot;
+        }
+      }
+    }
+    // All taken: as many slots again, one of them being taken before they are visible.
+    // Sequentially consistent, as the hazards: a writer seeing the hazard sees its slots.
+    Slots *aMore = new Slots(aHead->_count, aHead);
+    Slot& aSlot = aMore->_slots[tSlotHint % aMore->_count];
+    aSlot._taken.store(true, std::memory_order_relaxed);
+    while (!_slots.compare_exchange_weak(aMore->_next, aMore))
+    {
+    }
+    FORMULA_DEBUG("Added " << aMore->_count << " reader slots to pin rules");
+    return aSlot;
+  }
+
+  RuleSetHolder::Pin::Pin(RuleSetHolder& ioHolder):
+    _slot(ioHolder.acquireSlot()), _version(ioHolder._current.load())
+  {
+    // The version may be retired (and reclaimed) before the hazard is visible:
+    // it is only safe once it is still current after publishing the hazard.
+    while (_version)
+    {
+      _slot._hazard.store(_version);
+      Version *aCurrent = ioHolder._current.load();
+      if (aCurrent == _version)
+      {
+        return;
+      }
+      _version = aCurrent;
+    }
+    _slot._hazard.store(NULL);
+    _slot._taken.store(false, std::memory_order_release);
+    throw mdw::UnknownException("No rules published yet");
+  }
+
+  RuleSetHolder::Pin::~Pin()
+  {
+    _slot._hazard.store(NULL, std::memory_order_release);
+    _slot._taken.store(false, std::memory_order_release);
+  }
+
+}}
@@ -0,0 +1,27 @@
+#include <mdw/formula/RuleStore.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <limits>
+
+namespace mdw { namespace formula {
+
+  RuleStore::RuleStore(const Grammar& iGrammar, size_t iBlockSize):
+    _grammar(iGrammar), _allocator(iBlockSize, iBlockSize), _parser(_allocator, iGrammar)
+  {}
+
+  RuleStore::Rule RuleStore::add(const std::string& iFormula)
+  {
+    if (_rules.size() >= std::numeric_limits<Rule>::max())
+    {
+      throw mdw::UnknownException("Too many rules in the store");
+    }
+    size_t aUsed = _allocator.getUsedBytes();
+    Entry anEntry;
+    anEntry._expression = &_parser.parse(iFormula);
+    anEntry._bytes = _allocator.getUsedBytes() - aUsed;
+    _rules.push_back(anEntry);
+    FORMULA_DEBUG("Stored rule " << _rules.size() - 1 << " in " << anEntry._bytes << " bytes");
+    return _rules.size() - 1;
+  }
+
+}}
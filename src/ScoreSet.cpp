@@ -0,0 +1,206 @@
+#include <mdw/formula/ScoreSet.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    const double kInfinity = std::numeric_limits<double>::infinity();
+
+    // Score of a rule, false if unknown
+    bool Evaluate(const Expression& iRule, IContext& ioContext, double& oScore)
+    {
+      try {
+        if (iRule.getType() == kExprInt)
+        {
+          oScore = iRule.getInt().evaluate(ioContext);
+        } else {
+          oScore = iRule.getDouble().evaluate(ioContext);
+        }
+      } catch (const ValueException&) {
+        return false;
+      }
+      if (ioContext.isNaN())
+      {
+        ioContext.ignoreNaN();
+        return false;
+      }
+      return !std::isnan(oScore);
+    }
+
+    // Heap order: the worst score is on top
+    class IsBetter {
+    public:
+      bool operator()(const ScoreSet::Score& iLeft, const ScoreSet::Score& iRight) const
+      {
+        return (iLeft._score > iRight._score) ||
+          ((iLeft._score == iRight._score) && (iLeft._rule < iRight._rule));
+      }
+    };
+
+    class ByBound {
+    public:
+      explicit ByBound(const std::vector<double>& iBounds):
+        _bounds(iBounds)
+      {}
+
+      bool operator()(ScoreSet::Rule iLeft, ScoreSet::Rule iRight) const
+      {
+        return _bounds[iLeft] > _bounds[iRight];
+      }
+
+    private:
+      const std::vector<double>& _bounds;
+    };
+  }
+
+  ScoreSet::ScoreSet(const Grammar& iGrammar):
+    _parser(_dag.getAllocator(), iGrammar), _compiled(true)
+  {
+    _dag.observe(iGrammar);
+    _parser.addObserver(_dag);
+  }
+
+  ScoreSet::Rule ScoreSet::add(const std::string& iFormula, double iMaxScore)
+  {
+    if (_rules.size() >= std::numeric_limits<Rule>::max())
+    {
+      throw mdw::UnknownException("Too many rules in the set");
+    }
+    Expression& aRule = _parser.parse(iFormula);
+    if ((aRule.getType() != kExprInt) && (aRule.getType() != kExprDouble))
+    {
+      throw mdw::UnknownException("Not a numeric rule: " + iFormula);
+    }
+    _dag.addRule(aRule);
+    _rules.push_back(&aRule);
+    _upperBounds.push_back(std::min(getBounds(_dag.getNodeId(aRule))._high, iMaxScore));
+    _compiled = false;
+    return _rules.size() - 1;
+  }
+
+  // Interval arithmetic on the structure of the node. Integer overflows are ignored.
+  const ScoreSet::Bounds& ScoreSet::getBounds(size_t iNode)
+  {
+    KnownBounds::const_iterator aKnown = _bounds.find(iNode);
+    if (aKnown != _bounds.end())
+    {
+      return aKnown->second;
+    }
+    Bounds aBounds;
+    aBounds._low = -kInfinity;
+    aBounds._high = kInfinity;
+    const Factorizer::NodeKey& aKey = _dag.getNodeKey(iNode);
+    const Expression& anExpression = _dag.getParsedExpression(iNode);
+    if ((anExpression.getType() != kExprInt) && (anExpression.getType() != kExprDouble))
+    {
+      // Not numeric
+    } else if (aKey.first[0] == 'c') {
+      IContext aContext;
+      double aValue = 0;
+      if (Evaluate(anExpression, aContext, aValue))
+      {
+        aBounds._low = aBounds._high = aValue;
+      }
+    } else if (aKey.first == "u -") {
+      Bounds aRight = getBounds(aKey.second[0]);
+      aBounds._low = -aRight._high;
+      aBounds._high = -aRight._low;
+    } else if (aKey.first == "?") {
+      Bounds aLeft = getBounds(aKey.second[1]);
+      Bounds aRight = getBounds(aKey.second[2]);
+      aBounds._low = std::min(aLeft._low, aRight._low);
+      aBounds._high = std::max(aLeft._high, aRight._high);
+    } else if ((aKey.first == "b +") || (aKey.first == "b -") || (aKey.first == "b *")) {
+      Bounds aLeft = getBounds(aKey.second[0]);
+      Bounds aRight = getBounds(aKey.second[1]);
+      if (aKey.first == "b +")
+      {
+        aBounds._low = aLeft._low + aRight._low;
+        aBounds._high = aLeft._high + aRight._high;
+      } else if (aKey.first == "b -") {
+        aBounds._low = aLeft._low - aRight._high;
+        aBounds._high = aLeft._high - aRight._low;
+      } else {
+        double aProducts[] = {aLeft._low * aRight._low, aLeft._low * aRight._high,
+                              aLeft._high * aRight._low, aLeft._high * aRight._high};
+        aBounds._low = *std::min_element(aProducts, aProducts + 4);
+        aBounds._high = *std::max_element(aProducts, aProducts + 4);
+      }
+      // Infinities of opposite signs, or zero times infinity
+      if (std::isnan(aBounds._low) || std::isnan(aBounds._high))
+      {
+        aBounds._low = -kInfinity;
+        aBounds._high = kInfinity;
+      }
+    }
+    return _bounds[iNode] = aBounds;
+  }
+
+  void ScoreSet::compile()
+  {
+    _order.resize(_rules.size());
+    for (size_t i = 0; i < _rules.size(); ++i)
+    {
+      _order[i] = i;
+    }
+    std::stable_sort(_order.begin(), _order.end(), ByBound(_upperBounds));
+    _compiled = true;
+    FORMULA_DEBUG("Compiled " << _rules.size() << " scoring rules, the highest bound being "
+                  << (_order.empty() ? -kInfinity : _upperBounds[_order[0]]));
+  }
+
+  size_t ScoreSet::top(IContext& ioContext, Score *oScores, size_t iK,
+                       size_t *oEvaluated) const
+  {
+    if (!_compiled)
+    {
+      throw mdw::UnknownException("Rules added since the ScoreSet was compiled");
+    }
+    size_t aCount = 0;
+    size_t anEvaluated = 0;
+    IsBetter anIsBetter;
+    for (size_t i = 0; (i < _order.size()) && iK; ++i)
+    {
+      Score aScore;
+      aScore._rule = _order[i];
+      if (aCount == iK)
+      {
+        // The next rules have lower bounds
+        const Score& aWorst = oScores[0];
+        double aBound = _upperBounds[aScore._rule];
+        if (aBound < aWorst._score)
+        {
+          break;
+        } else if ((aBound == aWorst._score) && (aScore._rule > aWorst._rule)) {
+          continue;
+        }
+      }
+      ++anEvaluated;
+      if (!Evaluate(*_rules[aScore._rule], ioContext, aScore._score))
+      {
+        continue;
+      }
+      if (aCount < iK)
+      {
+        oScores[aCount++] = aScore;
+        std::push_heap(oScores, oScores + aCount, anIsBetter);
+      } else if (anIsBetter(aScore, oScores[0])) {
+        std::pop_heap(oScores, oScores + aCount, anIsBetter);
+        oScores[aCount - 1] = aScore;
+        std::push_heap(oScores, oScores + aCount, anIsBetter);
+      }
+    }
+    std::sort_heap(oScores, oScores + aCount, anIsBetter);
+    if (oEvaluated)
+    {
+      *oEvaluated = anEvaluated;
+    }
+    return aCount;
+  }
+
+}}
@@ -0,0 +1,94 @@
+#include <mdw/formula/TieredRuleStore.hpp>
+#include <mdw/formula/Parser.hpp>
+#include <mdw/UnknownException.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/foreach.hpp>
+#include <limits>
+
+namespace mdw { namespace formula {
+
+  TieredRuleStore::TieredRuleStore(const Grammar& iGrammar, Clock::duration iIdlePeriod):
+    _grammar(iGrammar), _idlePeriod(iIdlePeriod), _hotCount(0), _accesses(0),
+    _promotions(0), _demotions(0)
+  {}
+
+  TieredRuleStore::~TieredRuleStore()
+  {
+    BOOST_FOREACH(Entry& anEntry, _rules)
+    {
+      delete anEntry._hot;
+    }
+  }
+
+  TieredRuleStore::Rule TieredRuleStore::add(const std::string& iFormula)
+  {
+    if (_rules.size() >= std::numeric_limits<Rule>::max())
+    {
+      throw mdw::UnknownException("Too many rules in the store");
+    }
+    _rules.push_back(Entry(iFormula));
+    return _rules.size() - 1;
+  }
+
+  const Expression& TieredRuleStore::get(Rule iRule, Clock::time_point iNow)
+  {
+    Entry& anEntry = _rules[iRule];
+    ++_accesses;
+    if (!anEntry._hot)
+    {
+      HotRule *aHot = new HotRule();
+      try {
+        Parser aParser(aHot->_allocator, _grammar);
+        aHot->_expression = &aParser.parse(anEntry._formula);
+      } catch (...) {
+        delete aHot;
+        throw;
+      }
+      anEntry._hot = aHot;
+      ++_hotCount;
+      ++_promotions;
+      FORMULA_DEBUG("Promoted rule " << iRule << " in "
+                    << aHot->_allocator.getAllocatedBytes() << " bytes");
+    }
+    anEntry._lastAccess = iNow;
+    return *anEntry._hot->_expression;
+  }
+
+  size_t TieredRuleStore::demoteIdle(Clock::time_point iNow)
+  {
+    size_t aDemoted = 0;
+    BOOST_FOREACH(Entry& anEntry, _rules)
+    {
+      if (anEntry._hot && (iNow - anEntry._lastAccess >= _idlePeriod))
+      {
+        delete anEntry._hot;
+        anEntry._hot = NULL;
+        ++aDemoted;
+      }
+    }
+    _hotCount -= aDemoted;
+    _demotions += aDemoted;
+    FORMULA_DEBUG("Demoted " << aDemoted << " rules, " << _hotCount << " still hot");
+    return aDemoted;
+  }
+
+  TierStatistics TieredRuleStore::getStatistics() const
+  {
+    TierStatistics aResult;
+    aResult._hot = _hotCount;
+    aResult._cold = _rules.size() - _hotCount;
+    aResult._accesses = _accesses;
+    aResult._promotions = _promotions;
+    aResult._demotions = _demotions;
+    BOOST_FOREACH(const Entry& anEntry, _rules)
+    {
+      aResult._coldBytes += anEntry._formula.capacity();
+      if (anEntry._hot)
+      {
+        aResult._hotBytes += anEntry._hot->_allocator.getAllocatedBytes();
+      }
+    }
+    return aResult;
+  }
+
+}}
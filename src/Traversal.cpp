@@ -0,0 +1,55 @@
+#include <mdw/formula/Traversal.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_set.hpp>
+#include <utility>
+
+namespace mdw { namespace formula {
+
+  namespace {
+    typedef boost::unordered_set<const Expression*> Visited;
+    // Node and index of its next child to visit
+    typedef std::vector<std::pair<const Expression*, size_t> > Stack;
+
+    // Iterative, as rules may be deep chains of && or ||
+    void Visit(const Expression& iRoot, ExpressionVisitor& ioVisitor, Visited& ioVisited)
+    {
+      if (!ioVisited.insert(&iRoot).second)
+      {
+        return;
+      }
+      Stack aStack(1, std::make_pair(&iRoot, 0));
+      while (!aStack.empty())
+      {
+        const Expression& aNode = *aStack.back().first;
+        size_t& aNext = aStack.back().second;
+        if (aNext < aNode.getChildrenCount())
+        {
+          const Expression& aChild = aNode.getChild(aNext++);
+          if (ioVisited.insert(&aChild).second)
+          {
+            aStack.push_back(std::make_pair(&aChild, 0));
+          }
+        } else {
+          aStack.pop_back();
+          ioVisitor.visit(aNode);
+        }
+      }
+    }
+  }
+
+  void VisitDag(const Expression& iRoot, ExpressionVisitor& ioVisitor)
+  {
+    Visited aVisited;
+    Visit(iRoot, ioVisitor, aVisited);
+  }
+
+  void VisitDag(const std::vector<Expression*>& iRoots, ExpressionVisitor& ioVisitor)
+  {
+    Visited aVisited;
+    BOOST_FOREACH(const Expression *aRoot, iRoots)
+    {
+      Visit(*aRoot, ioVisitor, aVisited);
+    }
+  }
+
+}}
@@ -0,0 +1,79 @@
+#include <mdw/formula/ValueKey.hpp>
+#include <mdw/formula/Expression.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <boost/functional/hash.hpp>
+
+namespace mdw { namespace formula {
+
+  void ValueKey::appendBytes(char iTag, const void *iData, size_t iSize)
+  {
+    size_t aStart = _bytes.size();
+    _bytes.push_back(iTag);
+    _bytes.append(static_cast<const char*>(iData), iSize);
+    boost::hash_combine(_hash, boost::hash_range(_bytes.begin() + aStart, _bytes.end()));
+  }
+
+  void ValueKey::append(bool iValue)
+  {
+    char aValue = iValue ? 1 : 0;
+    appendBytes('b', &aValue, sizeof(aValue));
+  }
+
+  void ValueKey::append(int64_t iValue)
+  {
+    appendBytes('i', &iValue, sizeof(iValue));
+  }
+
+  void ValueKey::append(double iValue)
+  {
+    // -0. and 0. compare equal, so they must be the same key
+    if (iValue == 0.)
+    {
+      iValue = 0.;
+    }
+    appendBytes('d', &iValue, sizeof(iValue));
+  }
+
+  void ValueKey::append(const std::string& iValue)
+  {
+    // The size prefix avoids collisions between ("ab", "c") and ("a", "bc")
+    uint64_t aSize = iValue.size();
+    appendBytes('s', &aSize, sizeof(aSize));
+    _bytes.append(iValue);
+    boost::hash_combine(_hash, boost::hash_range(iValue.begin(), iValue.end()));
+  }
+
+  bool ValueKey::IsSupported(ExpressionType iType)
+  {
+    return (iType == kExprBool) || (iType == kExprInt) ||
+      (iType == kExprDouble) || (iType == kExprString);
+  }
+
+  bool ValueKey::appendValue(const Expression& iExpression, IContext& ioContext)
+  {
+    try {
+      switch (iExpression.getType())
+      {
+      case kExprBool:
+        append(iExpression.getBool().evaluate(ioContext));
+        break;
+      case kExprInt:
+        append(iExpression.getInt().evaluate(ioContext));
+        break;
+      case kExprDouble:
+        append(iExpression.getDouble().evaluate(ioContext));
+        break;
+      case kExprString:
+        append(iExpression.getString().evaluate(ioContext));
+        break;
+      default:
+        return false;
+      }
+    } catch (const ValueException&) {
+      return false;
+    }
+    return !ioContext.isNaN();
+  }
+
+}}
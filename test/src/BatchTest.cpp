@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright of this program is the property of AMADEUS, without
+/// whose written permission reproduction in whole or in part is prohibited.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <mdw/formula/BatchEvaluator.hpp>
+#include <mdw/formula/ValueKey.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/StandardTypes.hpp>
+#include <mdw/formula/Facts.hpp>
+#include <mdw/Tracer.hpp>
+#include <boost/mem_fn.hpp>
+#include <iostream>
+#include <vector>
+
+#define ASSERT_TRUE(x) if (!(x)) {std::cerr << "Failed to check: " #x << std::endl; return 1;}
+#define ASSERT_FALSE(x) if (x) {std::cerr << "Failed to fail: " #x << std::endl; return 1;}
+#define ASSERT_EQ(x,y) ASSERT_TRUE(x == y)
+
+namespace mdw { namespace formula {
+
+  class Booking
+  {
+    std::string _route;
+    std::string _cabin;
+    int _passengers;
+    double _fare;
+  public:
+    Booking(const std::string& iRoute, const std::string& iCabin, int iPassengers, double iFare):
+      _route(iRoute), _cabin(iCabin), _passengers(iPassengers), _fare(iFare)
+    {}
+
+    const std::string& getRoute() const {return _route;}
+    const std::string& getCabin() const {return _cabin;}
+    int getPassengers() const {return _passengers;}
+    double getFare() const {return _fare;}
+    bool hasFare() const {return _fare >= 0;}
+  };
+
+  struct BookingBinder
+  {
+    void operator()(IContext& ioContext, const Booking& iBooking) const
+    {
+      ioContext.setFact(iBooking, "Booking");
+    }
+  };
+
+  struct BookingOutput
+  {
+    BookingOutput(std::vector<bool>& oResults):
+      _results(oResults)
+    {}
+
+    void operator()(const Booking& iBooking,
+                    const BatchEvaluator<bool>::Outcomes& iOutcomes) const
+    {
+      _results.push_back(!iOutcomes[0]._isNaN && iOutcomes[0]._value);
+    }
+
+    std::vector<bool>& _results;
+  };
+
+  void RegisterBooking(ArenaAllocator& ioAlloc, Grammar& ioGrammar)
+  {
+    ioGrammar.registerStandardOperators(ioAlloc);
+    Fact<Booking>::RegisterMe(ioAlloc, ioGrammar, "Booking");
+    RegisterAttribute(ioAlloc, ioGrammar, boost::mem_fn(&Booking::getRoute), "Route");
+    RegisterAttribute(ioAlloc, ioGrammar, boost::mem_fn(&Booking::getCabin), "Cabin");
+    RegisterAttribute(ioAlloc, ioGrammar, boost::mem_fn(&Booking::getPassengers), "Passengers");
+    RegisterOptionalAttribute(ioAlloc, ioGrammar,
+                              boost::mem_fn(&Booking::getFare),
+                              boost::mem_fn(&Booking::hasFare),
+                              "Fare");
+  }
+
+  int ValueKeyTest()
+  {
+    ValueKey aKey1;
+    aKey1.append(std::string("ab"));
+    aKey1.append(std::string("c"));
+    ValueKey aKey2;
+    aKey2.append(std::string("a"));
+    aKey2.append(std::string("bc"));
+    ASSERT_TRUE(aKey1 != aKey2);
+
+    ValueKey aKey3;
+    aKey3.append((int64_t)1);
+    ValueKey aKey4;
+    aKey4.append(true);
+    ASSERT_TRUE(aKey3 != aKey4);
+
+    aKey4.clear();
+    aKey4.append((int64_t)1);
+    ASSERT_TRUE(aKey3 == aKey4);
+    ASSERT_EQ(aKey3.hash(), aKey4.hash());
+
+    ValueKey aKey5;
+    aKey5.append(0.);
+    ValueKey aKey6;
+    aKey6.append(-0.);
+    ASSERT_TRUE(aKey5 == aKey6);
+    return 0;
+  }
+
+  int BatchDeduplicationTest()
+  {
+    ArenaAllocator aAlloc;
+    Grammar aGrammar;
+    RegisterBooking(aAlloc, aGrammar);
+
+    BatchEvaluator<bool> anEvaluator(aGrammar);
+    anEvaluator.addRule("$Booking.Route == 'NCE-CDG' && $Booking.Cabin == 'Y'");
+    anEvaluator.addRule("$Booking.Cabin == 'J' || $Booking.Passengers > 3");
+    ASSERT_TRUE(anEvaluator.isDeduplicable());
+    ASSERT_EQ(anEvaluator.getKeys().size(), (size_t)3);
+
+    std::vector<Booking> aBookings;
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, 100.));
+    aBookings.push_back(Booking("NCE-CDG", "J", 1, 200.));
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, 150.));
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, 100.));
+    aBookings.push_back(Booking("LHR-JFK", "Y", 5, 300.));
+    aBookings.push_back(Booking("NCE-CDG", "J", 1, 250.));
+
+    std::vector<bool> aResults;
+    BatchEvaluator<bool>::Session aSession(anEvaluator);
+    aSession.run(aBookings.begin(), aBookings.end(), BookingBinder(), BookingOutput(aResults));
+
+    ASSERT_EQ(aResults.size(), aBookings.size());
+    ASSERT_TRUE(aResults[0]);
+    ASSERT_FALSE(aResults[1]);
+    ASSERT_TRUE(aResults[2]);
+    ASSERT_TRUE(aResults[3]);
+    ASSERT_FALSE(aResults[4]);
+    ASSERT_FALSE(aResults[5]);
+    ASSERT_EQ(aSession.getRecordsCount(), (size_t)6);
+    ASSERT_EQ(aSession.getEvaluationsCount(), (size_t)3);
+
+    // The second rule is still evaluated for all the groups
+    const BatchEvaluator<bool>::Outcomes& anOutcomes =
+      aSession.evaluate(Booking("LHR-JFK", "J", 1, 10.), BookingBinder());
+    ASSERT_FALSE(anOutcomes[0]._value);
+    ASSERT_TRUE(anOutcomes[1]._value);
+
+    // With a single group, all distinct consecutive records are evaluated
+    BatchEvaluator<bool>::Session aSmallSession(anEvaluator, 1);
+    aResults.clear();
+    aSmallSession.run(aBookings.begin(), aBookings.end(), BookingBinder(), BookingOutput(aResults));
+    ASSERT_EQ(aSmallSession.getEvaluationsCount(), (size_t)5);
+    ASSERT_TRUE(aResults[3]);
+    return 0;
+  }
+
+  int BatchNaNTest()
+  {
+    ArenaAllocator aAlloc;
+    Grammar aGrammar;
+    RegisterBooking(aAlloc, aGrammar);
+
+    BatchEvaluator<bool> anEvaluator(aGrammar);
+    anEvaluator.addRule("$Booking.Fare > 120.");
+    ASSERT_TRUE(anEvaluator.isDeduplicable());
+
+    std::vector<Booking> aBookings;
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, -1.));
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, -1.));
+    aBookings.push_back(Booking("NCE-CDG", "Y", 1, 130.));
+
+    BatchEvaluator<bool>::Session aSession(anEvaluator);
+    ASSERT_TRUE(aSession.evaluate(aBookings[0], BookingBinder())[0]._isNaN);
+    ASSERT_TRUE(aSession.evaluate(aBookings[1], BookingBinder())[0]._isNaN);
+    // Records with missing values are never grouped
+    ASSERT_EQ(aSession.getEvaluationsCount(), (size_t)2);
+    const BatchEvaluator<bool>::Outcomes& anOutcomes =
+      aSession.evaluate(aBookings[2], BookingBinder());
+    ASSERT_FALSE(anOutcomes[0]._isNaN);
+    ASSERT_TRUE(anOutcomes[0]._value);
+    return 0;
+  }
+
+  int AllBatchTests() {
+    int aResult = 0;
+    aResult += ValueKeyTest();
+    aResult += BatchDeduplicationTest();
+    aResult += BatchNaNTest();
+    return aResult;
+  }
+
+}}
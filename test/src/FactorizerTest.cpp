@@ -0,0 +1,1237 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright of this program is the property of AMADEUS, without
+/// whose written permission reproduction in whole or in part is prohibited.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <mdw/formula/Parser.hpp>
+#include <mdw/formula/IContext.hpp>
+#include <mdw/formula/Grammar.hpp>
+#include <mdw/formula/StandardTypes.hpp>
+#include <mdw/formula/Facts.hpp>
+#include <mdw/formula/BulkCompiler.hpp>
+#include <mdw/formula/CString.hpp>
+#include <mdw/formula/IntervalIndex.hpp>
+#include <mdw/formula/RuleImage.hpp>
+#include <mdw/formula/RuleSet.hpp>
+#include <mdw/formula/ScoreSet.hpp>
+#include <mdw/formula/Traversal.hpp>
+#include <mdw/formula/ValueException.hpp>
+#include <mdw/formula/cache/Factorizer.hpp>
+#include <mdw/formula/cache/CostModel.hpp>
+#include <mdw/formula/cache/CostCalibrator.hpp>
+#include <mdw/formula/cache/CachableFacts.hpp>
+#include <mdw/formula/cache/OptimizationProfile.hpp>
+#include <mdw/formula/cache/PassManager.hpp>
+#include <mdw/Tracer.hpp>
+#include <mdw/lexical_cast.hpp>
+#include <boost/mem_fn.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+#define ASSERT_TRUE(x) if (!(x)) {std::cerr << "Failed to check: " #x << std::endl; return 1;}
+#define ASSERT_FALSE(x) if (x) {std::cerr << "Failed to fail: " #x << std::endl; return 1;}
+#define ASSERT_EQ(x,y) ASSERT_TRUE(x == y)
+
+namespace mdw { namespace formula {
+
+  class Aircraft
+  {
+    int _seats;
+    std::string _model;
+  public:
+    Aircraft(int iSeats, const std::string& iModel):
+      _seats(iSeats), _model(iModel)
+    {}
+
+    int getSeats() const
+    {
+      return _seats;
+    }
+
+    const std::string& getModel() const
+    {
+      return _model;
+    }
+
+    const char *getCode() const
+    {
+      return _model.c_str();
+    }
+  };
+
+  void RegisterAircraft(ArenaAllocator& ioAlloc, Grammar& ioGrammar)
+  {
+    ioGrammar.registerStandardOperators(ioAlloc);
+    Fact<Aircraft>::RegisterMe(ioAlloc, ioGrammar, "Aircraft");
+    RegisterAttribute(ioAlloc, ioGrammar, boost::mem_fn(&Aircraft::getSeats), "Seats");
+    RegisterAttribute(ioAlloc, ioGrammar, boost::mem_fn(&Aircraft::getModel), "Model");
+  }
+
+  int CostCalibrationTest()
+  {
+    ArenaAllocator aAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(aAlloc, aGrammar);
+
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+
+    CostModel aModel;
+    ASSERT_FALSE(aModel.isCalibrated());
+
+    CostCalibrator aCalibrator(aAlloc, aContext, aModel, 100);
+    std::vector<std::string> aSamples;
+    aSamples.push_back("$Aircraft.Seats * 2 + 1 > 200");
+    aSamples.push_back("$Aircraft.Model == 'A320' && $Aircraft.Seats < 300");
+    aCalibrator.calibrate(aGrammar, aSamples);
+
+    ASSERT_TRUE(aModel.isCalibrated());
+    ASSERT_FALSE(aModel.getCosts().empty());
+    ASSERT_TRUE(aModel.getUnitCost() > 0);
+    ASSERT_TRUE(aModel.getCacheLookupCost() > 0);
+
+    Parser aParser(aAlloc, aGrammar);
+    Expression& anExpr = aParser.parse("$Aircraft.Seats * 2");
+    ASSERT_TRUE(aModel.hasCost(CostModel::GetKind(anExpr)));
+    ASSERT_TRUE(aModel.getCost(anExpr) > 0);
+    return 0;
+  }
+
+  int CostModelSaveLoadTest()
+  {
+    CostModel aModel;
+    aModel.setUnitCost(1.5);
+    aModel.setCacheLookupCost(12.25);
+    aModel.setCost("SomeNode", 3.5);
+    aModel.addMeasure("OtherNode", 2.);
+    aModel.addMeasure("OtherNode", 4.);
+
+    std::stringstream aStream;
+    aModel.save(aStream);
+
+    CostModel aLoaded;
+    aLoaded.load(aStream);
+    ASSERT_TRUE(aLoaded.isCalibrated());
+    ASSERT_EQ(aLoaded.getUnitCost(), 1.5);
+    ASSERT_EQ(aLoaded.getCacheLookupCost(), 12.25);
+    ASSERT_EQ(aLoaded.getCosts().size(), (size_t)2);
+    ASSERT_EQ(aLoaded.getCosts().find("OtherNode")->second._nanos, 3.);
+    ASSERT_EQ(aLoaded.getCosts().find("OtherNode")->second._samples, (size_t)2);
+
+    std::stringstream aBadStream("not-a-model 1\n");
+    try {
+      aLoaded.load(aBadStream);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    return 0;
+  }
+
+  int FactorizerCostModelTest()
+  {
+    Aircraft anAircraft(180, "A320");
+    std::string aFormula("$Aircraft.Seats * 2 + 1 > 200");
+
+    for (int i = 0; i < 2; ++i)
+    {
+      bool aCheapCache = (i == 0);
+      Factorizer aFactorizer;
+      ArenaAllocator& aAlloc(aFactorizer.getAllocator());
+      Grammar aGrammar;
+      aGrammar.addObserver(aFactorizer);
+      RegisterAircraft(aAlloc, aGrammar);
+
+      CostModel aModel;
+      aModel.setCacheLookupCost(aCheapCache ? 0. : 1e9);
+      aFactorizer.setCostModel(&aModel);
+
+      Parser aParser(aAlloc, aGrammar);
+      aParser.addObserver(aFactorizer);
+      Expression& anExpr = aParser.parse(aFormula);
+      FORMULA_DEBUG(CostModel::GetKind(anExpr));
+      bool isCached = CostModel::GetKind(anExpr).find("UnaryCachedByAddress") != std::string::npos;
+      ASSERT_EQ(isCached, aCheapCache);
+
+      IContext aContext;
+      aContext.setFact(anAircraft, "Aircraft");
+      ASSERT_TRUE(anExpr.getBool().evaluate(aContext));
+      ASSERT_TRUE(anExpr.getBool().evaluate(aContext));
+    }
+    return 0;
+  }
+
+  int CacheStatisticsTest()
+  {
+    Factorizer aFactorizer;
+    ArenaAllocator& aAlloc(aFactorizer.getAllocator());
+    Grammar aGrammar;
+    aGrammar.addObserver(aFactorizer);
+    aGrammar.registerStandardOperators(aAlloc);
+    CachableFact<Aircraft>::RegisterMe(aAlloc, aGrammar, "Aircraft");
+    RegisterAttribute(aAlloc, aGrammar, boost::mem_fn(&Aircraft::getSeats), "Seats");
+
+    CostModel aModel;
+    aModel.setCacheLookupCost(0.);
+    aFactorizer.setCostModel(&aModel);
+
+    Parser aParser(aAlloc, aGrammar);
+    aParser.addObserver(aFactorizer);
+    Expression& anExpr = aParser.parse("$Aircraft.Seats * 2 > 200");
+    ASSERT_TRUE(aFactorizer.getCaches().size() > 1);
+    ASSERT_EQ(aFactorizer.getCaches().getTotal()._lookups, (size_t)0);
+
+    Aircraft aSmall(50, "E190");
+    Aircraft aBig(180, "A320");
+    IContext aContext;
+    aContext.setFact(aBig, "Aircraft");
+    ASSERT_TRUE(anExpr.getBool().evaluate(aContext));
+    ASSERT_TRUE(anExpr.getBool().evaluate(aContext));
+
+    CacheStatistics aTotal = aFactorizer.getCaches().getTotal();
+    ASSERT_TRUE(aTotal._hits > 0);
+    ASSERT_TRUE(aTotal._misses > 0);
+    ASSERT_EQ(aTotal._lookups, aTotal._hits + aTotal._misses);
+    ASSERT_TRUE(aTotal._entries > 0);
+    ASSERT_TRUE(aTotal._bytes > 0);
+    ASSERT_EQ(aTotal._invalidations, (size_t)0);
+
+    aContext.clean();
+    aContext.setFact(aSmall, "Aircraft");
+    ASSERT_FALSE(anExpr.getBool().evaluate(aContext));
+    ASSERT_TRUE(aFactorizer.getCaches().getTotal()._invalidations > 0);
+
+    std::ostringstream aText;
+    aFactorizer.getCaches().printText(aText);
+    FORMULA_DEBUG(aText.str());
+    ASSERT_TRUE(aText.str().find("Total (") != std::string::npos);
+
+    std::ostringstream aJson;
+    aFactorizer.getCaches().printJson(aJson);
+    FORMULA_DEBUG(aJson.str());
+    ASSERT_TRUE(aJson.str().find("{\"total\":{\"lookups\":") == 0);
+    ASSERT_TRUE(aJson.str().find("\"description\":\"container of $Aircraft\"") != std::string::npos);
+
+    aFactorizer.getCaches().resetStatistics();
+    ASSERT_EQ(aFactorizer.getCaches().getTotal()._lookups, (size_t)0);
+    return 0;
+  }
+
+  int OptimizationProfileTest()
+  {
+    Aircraft anAircraft(180, "A320");
+    std::string aFormula("$Aircraft.Seats > 300 || $Aircraft.Model == 'A320'");
+    std::string aSubFormula("$Aircraft.Seats * 2");
+
+    // Production run: profile the conditions, no cache
+    Factorizer aProduction;
+    Grammar aGrammar;
+    aGrammar.addObserver(aProduction);
+    RegisterAircraft(aProduction.getAllocator(), aGrammar);
+    CostModel anExpensiveCache;
+    anExpensiveCache.setCacheLookupCost(1e9);
+    aProduction.setCostModel(&anExpensiveCache);
+    aProduction.setProfiling(true);
+
+    Parser aParser(aProduction.getAllocator(), aGrammar);
+    aParser.addObserver(aProduction);
+    Expression& aProfiled = aParser.parse(aFormula);
+    Expression& aSub = aParser.parse(aSubFormula);
+    ASSERT_TRUE(aProduction.getStructuralHash(aProfiled) != 0);
+
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    for (int i = 0; i < 200; ++i)
+    {
+      ASSERT_TRUE(aProfiled.getBool().evaluate(aContext));
+    }
+
+    OptimizationProfile aProfile;
+    aProduction.exportProfile(aProfile);
+    const OptimizationProfile::NodeProfile *aTop =
+      aProfile.find(aProduction.getStructuralHash(aProfiled));
+    ASSERT_TRUE(aTop != NULL);
+    ASSERT_EQ(aTop->_evaluations, (size_t)200);
+    ASSERT_EQ(aTop->getSelectivity(), 1.);
+
+    // Sub-expression never hitting the cache
+    OptimizationProfile::NodeProfile& aNoHits = aProfile.get(aProduction.getStructuralHash(aSub));
+    aNoHits._cacheLookups = 1000;
+
+    std::stringstream aStream;
+    aProfile.save(aStream);
+    OptimizationProfile aLoaded;
+    aLoaded.load(aStream);
+    ASSERT_EQ(aLoaded.getNodes().size(), aProfile.getNodes().size());
+
+    std::stringstream aBadStream("formula-optimization-profile 1\nnode zz\n");
+    try {
+      aLoaded.load(aBadStream);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+
+    // After restart: the profile drives ordering and caching
+    for (int i = 0; i < 2; ++i)
+    {
+      bool isReordering = (i == 0);
+      Factorizer aFactorizer;
+      Grammar aRestartedGrammar;
+      aRestartedGrammar.addObserver(aFactorizer);
+      RegisterAircraft(aFactorizer.getAllocator(), aRestartedGrammar);
+      CostModel aCheapCache;
+      aCheapCache.setCacheLookupCost(0.);
+      aFactorizer.setCostModel(&aCheapCache);
+      aFactorizer.setProfile(&aLoaded);
+      aFactorizer.setReordering(isReordering);
+
+      Parser aRestartedParser(aFactorizer.getAllocator(), aRestartedGrammar);
+      aRestartedParser.addObserver(aFactorizer);
+      Expression& anExpr = aRestartedParser.parse(aFormula);
+      ASSERT_EQ(aFactorizer.getStructuralHash(anExpr), aProduction.getStructuralHash(aProfiled));
+      FORMULA_DEBUG(anExpr.toString());
+      bool isReordered = (anExpr.toString() != aProfiled.toString());
+      ASSERT_EQ(isReordered, isReordering);
+      ASSERT_TRUE(anExpr.getBool().evaluate(aContext));
+
+      Expression& aNotCached = aRestartedParser.parse(aSubFormula);
+      ASSERT_TRUE(CostModel::GetKind(aNotCached).find("UnaryCachedByAddress") == std::string::npos);
+    }
+    return 0;
+  }
+
+  int StructuralSharingTest()
+  {
+    Factorizer aFactorizer;
+    Grammar aGrammar;
+    aGrammar.addObserver(aFactorizer);
+    RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+    CostModel anExpensiveCache;
+    anExpensiveCache.setCacheLookupCost(1e9);
+    aFactorizer.setCostModel(&anExpensiveCache);
+
+    Parser aParser(aFactorizer.getAllocator(), aGrammar);
+    aParser.addObserver(aFactorizer);
+    std::string aFirst("$Aircraft.Seats * 2 > 200");
+    std::string aSecond("$Aircraft.Seats * 2 > 200");
+    std::string aThird("$Aircraft.Seats * 2 > 300");
+    Expression& aFirstExpr = aParser.parse(aFirst);
+    ASSERT_TRUE(&aFirstExpr == &aParser.parse(aSecond));
+    ASSERT_FALSE(&aFirstExpr == &aParser.parse(aThird));
+
+    // Deep rules are factorized without rebuilding the text of each sub-tree
+    std::string aDeep("$Aircraft.Seats");
+    for (int i = 0; i < 500; ++i)
+    {
+      aDeep += " + 1";
+    }
+    Expression& aDeepExpr = aParser.parse(aDeep);
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    ASSERT_EQ(aDeepExpr.getInt().evaluate(aContext), 680);
+    return 0;
+  }
+
+  int CanonicalizationTest()
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      bool isCanonicalizing = (i == 0);
+      Factorizer aFactorizer;
+      Grammar aGrammar;
+      aGrammar.addObserver(aFactorizer);
+      RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+      aFactorizer.setCanonicalization(isCanonicalizing);
+
+      Parser aParser(aFactorizer.getAllocator(), aGrammar);
+      aParser.addObserver(aFactorizer);
+      const char *kEquivalents[][2] = {
+        {"$Aircraft.Seats == 3 && $Aircraft.Model == 'A320'",
+         "$Aircraft.Model == 'A320' && $Aircraft.Seats == 3"},
+        {"3 < $Aircraft.Seats", "$Aircraft.Seats > 3"},
+        {"$Aircraft.Seats >= 3 * $Aircraft.Seats", "$Aircraft.Seats * 3 <= $Aircraft.Seats"},
+        {"($Aircraft.Seats > 1 && $Aircraft.Seats > 2) && $Aircraft.Seats > 3",
+         "$Aircraft.Seats > 3 && ($Aircraft.Seats > 2 && $Aircraft.Seats > 1)"},
+        {"!!($Aircraft.Seats > 3)", "$Aircraft.Seats > 3"}
+      };
+      std::vector<std::string> aFormulas;
+      for (size_t j = 0; j < sizeof(kEquivalents) / sizeof(kEquivalents[0]); ++j)
+      {
+        aFormulas.push_back(kEquivalents[j][0]);
+        aFormulas.push_back(kEquivalents[j][1]);
+      }
+      aFormulas.push_back("3 - $Aircraft.Seats");
+      aFormulas.push_back("$Aircraft.Seats - 3");
+
+      Aircraft anAircraft(180, "A320");
+      IContext aContext;
+      aContext.setFact(anAircraft, "Aircraft");
+      for (size_t j = 0; j + 1 < aFormulas.size(); j += 2)
+      {
+        Expression& aFirst = aParser.parse(aFormulas[j]);
+        Expression& aSecond = aParser.parse(aFormulas[j + 1]);
+        FORMULA_DEBUG(aFirst.toString() << " / " << aSecond.toString());
+        bool isShared = (&aFirst == &aSecond);
+        bool isEquivalent = (j + 2 < aFormulas.size());
+        ASSERT_EQ(isShared, (isCanonicalizing && isEquivalent));
+        if (aFirst.getType() == kExprBool)
+        {
+          ASSERT_EQ(aFirst.getBool().evaluate(aContext), aSecond.getBool().evaluate(aContext));
+        }
+      }
+    }
+    return 0;
+  }
+
+  int IncrementalFactorizerTest()
+  {
+    Factorizer aFactorizer;
+    Grammar aGrammar;
+    aGrammar.addObserver(aFactorizer);
+    RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+    CostModel aCheapCache;
+    aCheapCache.setCacheLookupCost(0.);
+    aFactorizer.setCostModel(&aCheapCache);
+
+    Parser aParser(aFactorizer.getAllocator(), aGrammar);
+    aParser.addObserver(aFactorizer);
+    std::string aFirst("$Aircraft.Seats * 2 > 200");
+    std::string aSecond("$Aircraft.Seats * 2 < 400");
+    Expression& aFirstRule = aParser.parse(aFirst);
+    Expression& aSecondRule = aParser.parse(aSecond);
+    aFactorizer.addRule(aFirstRule);
+    aFactorizer.addRule(aSecondRule);
+    size_t aNodes = aFactorizer.getNodesCount();
+    size_t aCaches = aFactorizer.getCaches().size();
+    ASSERT_EQ(aFactorizer.collectGarbage(), (size_t)0);
+
+    // Only the nodes specific to the first rule go away: "> 200" and "200"
+    aFactorizer.retireRule(aFirstRule);
+    ASSERT_EQ(aFactorizer.collectGarbage(), (size_t)2);
+    ASSERT_EQ(aFactorizer.getNodesCount(), aNodes - 2);
+    ASSERT_TRUE(aFactorizer.getCaches().size() < aCaches);
+
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    ASSERT_TRUE(aSecondRule.getBool().evaluate(aContext));
+
+    // Adding it back only creates the missing nodes
+    std::string aFirstAgain(aFirst);
+    Expression& aNewFirstRule = aParser.parse(aFirstAgain);
+    aFactorizer.addRule(aNewFirstRule);
+    ASSERT_EQ(aFactorizer.getNodesCount(), aNodes);
+    ASSERT_TRUE(aNewFirstRule.getBool().evaluate(aContext));
+
+    aFactorizer.retireRule(aNewFirstRule);
+    aFactorizer.retireRule(aSecondRule);
+    ASSERT_EQ(aFactorizer.collectGarbage(), aNodes);
+    ASSERT_EQ(aFactorizer.getNodesCount(), (size_t)0);
+    ASSERT_EQ(aFactorizer.getCaches().size(), (size_t)0);
+    try {
+      aFactorizer.retireRule(aSecondRule);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    return 0;
+  }
+
+  int BulkCompilerTest()
+  {
+    Factorizer aFactorizer;
+    Grammar aGrammar;
+    aGrammar.addObserver(aFactorizer);
+    RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+
+    std::vector<std::string> aFormulas;
+    for (int i = 0; i < 200; ++i)
+    {
+      std::string aLimit = mdw::lexical_cast<std::string>(i % 7);
+      aFormulas.push_back("$Aircraft.Seats * 2 > " + aLimit + "00 && $Aircraft.Model == 'A320'");
+      aFormulas.push_back("$Aircraft.Seats > 1" + aLimit + "0 ? 'big' : 'small'");
+      aFormulas.push_back("!!($Aircraft.Seats - " + aLimit + " < 150)");
+    }
+
+    BulkCompiler aCompiler(aGrammar, aFactorizer, 4);
+    std::vector<Expression*> aRules;
+    aCompiler.compile(aFormulas, aRules);
+    ASSERT_EQ(aRules.size(), aFormulas.size());
+    // Same rule in different shards: merged in the same DAG
+    ASSERT_TRUE(aRules[0] == aRules[aRules.size() - 12]);
+
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    ArenaAllocator aReferenceAlloc;
+    for (size_t i = 0; i < aFormulas.size(); ++i)
+    {
+      Parser aParser(aReferenceAlloc, aGrammar);
+      Expression& aReference = aParser.parse(aFormulas[i]);
+      if (aReference.getType() == kExprBool)
+      {
+        ASSERT_EQ(aRules[i]->getBool().evaluate(aContext), aReference.getBool().evaluate(aContext));
+      } else {
+        ASSERT_EQ(aRules[i]->getString().evaluate(aContext),
+                  aReference.getString().evaluate(aContext));
+      }
+    }
+
+    aFormulas[5] = "$Aircraft.Seats >";
+    try {
+      aCompiler.compile(aFormulas, aRules);
+      ASSERT_TRUE(false);
+    } catch (mdw::UnknownException& anException) {
+      ASSERT_TRUE(std::string(anException.what()).find("Rule 5:") == 0);
+    }
+    return 0;
+  }
+
+  int RuleImageTest()
+  {
+    const std::string aFileName("RuleImageTest.img");
+    std::vector<std::string> aFormulas;
+    aFormulas.push_back("$Aircraft.Seats * 2 > 300 && $Aircraft.Model == 'A320'");
+    aFormulas.push_back("$Aircraft.Seats > 100 ? 'big one' : 'small one'");
+    aFormulas.push_back("!($Aircraft.Seats - 1 < 150) || false");
+    aFormulas.push_back("$Aircraft.Model == 'A320'");
+
+    size_t aNodesCount = 0;
+    {
+      Factorizer aFactorizer;
+      Grammar aGrammar;
+      aGrammar.addObserver(aFactorizer);
+      RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+      Parser aParser(aFactorizer.getAllocator(), aGrammar);
+      aParser.addObserver(aFactorizer);
+      std::vector<Expression*> aRules;
+      BOOST_FOREACH(const std::string& aFormula, aFormulas)
+      {
+        aRules.push_back(&aParser.parse(aFormula));
+      }
+      aNodesCount = aFactorizer.getNodesCount();
+      RuleImage::Save(aFactorizer, aRules, aFileName);
+    }
+
+    // As another process would: no formula text is parsed
+    Factorizer aFactorizer;
+    Grammar aGrammar;
+    aGrammar.addObserver(aFactorizer);
+    RegisterAircraft(aFactorizer.getAllocator(), aGrammar);
+    RuleImage anImage(aFileName);
+    ASSERT_EQ(anImage.getRulesCount(), aFormulas.size());
+    ASSERT_TRUE(anImage.getNodesCount() <= aNodesCount);
+    Parser aParser(aFactorizer.getAllocator(), aGrammar);
+    aParser.addObserver(aFactorizer);
+    std::vector<Expression*> aRules;
+    anImage.load(aParser, aRules);
+    ASSERT_EQ(aRules.size(), aFormulas.size());
+    ASSERT_EQ(aFactorizer.getNodesCount(), anImage.getNodesCount());
+
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    ArenaAllocator aReferenceAlloc;
+    for (size_t i = 0; i < aFormulas.size(); ++i)
+    {
+      Parser aReferenceParser(aReferenceAlloc, aGrammar);
+      Expression& aReference = aReferenceParser.parse(aFormulas[i]);
+      if (aReference.getType() == kExprBool)
+      {
+        ASSERT_EQ(aRules[i]->getBool().evaluate(aContext), aReference.getBool().evaluate(aContext));
+      } else {
+        ASSERT_EQ(aRules[i]->getString().evaluate(aContext),
+                  aReference.getString().evaluate(aContext));
+      }
+    }
+
+    {
+      std::ofstream aBadFile(aFileName.c_str());
+      aBadFile << "formula-optimization-profile 1\n";
+    }
+    try {
+      RuleImage aBadImage(aFileName);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    std::remove(aFileName.c_str());
+    return 0;
+  }
+
+  int CompactionTest()
+  {
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+
+    Factorizer aSource;
+    Grammar aGrammar;
+    aGrammar.addObserver(aSource);
+    RegisterAircraft(aSource.getAllocator(), aGrammar);
+    std::vector<Expression*> aRules;
+    std::vector<bool> aResults;
+    {
+      Parser aParser(aSource.getAllocator(), aGrammar);
+      aParser.addObserver(aSource);
+      for (int i = 0; i < 100; ++i)
+      {
+        std::string aLimit = mdw::lexical_cast<std::string>(i);
+        Expression& aRule = aParser.parse("$Aircraft.Seats * (1 + 1) > " + aLimit + "0 && " +
+                                          "$Aircraft.Model != 'B7" + aLimit + "7'");
+        // Only some of the parsed rules are kept
+        if (i % 10 == 0)
+        {
+          aRules.push_back(&aRule);
+          aResults.push_back(aRule.getBool().evaluate(aContext));
+        }
+      }
+    }
+
+    ArenaAllocator aGrammarAlloc;
+    Factorizer aCompacted;
+    Grammar aCompactedGrammar;
+    aCompactedGrammar.addObserver(aCompacted);
+    RegisterAircraft(aGrammarAlloc, aCompactedGrammar);
+    std::vector<Expression*> aCompactedRules(aRules);
+    aSource.compact(aCompacted, aCompactedRules);
+    ASSERT_EQ(aCompactedRules.size(), aRules.size());
+    ASSERT_TRUE(aCompacted.getNodesCount() < aSource.getNodesCount() / 5);
+    ASSERT_TRUE(aCompacted.getAllocator().getAllocatedBytes() <
+                aSource.getAllocator().getAllocatedBytes() / 2);
+    // The rules are added: they survive garbage collection
+    ASSERT_EQ(aCompacted.collectGarbage(), 0u);
+
+    Factorizer aStripped;
+    aStripped.setGrammar(aCompactedGrammar);
+    aCompacted.compact(aStripped, aCompactedRules, true);
+    ASSERT_EQ(aStripped.getNodesCount(), 0u);
+    try {
+      aStripped.getNodeId(*aCompactedRules[0]);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+
+    aSource.reset();
+    aCompacted.reset();
+    aContext.clean();
+    aContext.setFact(anAircraft, "Aircraft");
+    for (size_t i = 0; i < aRules.size(); ++i)
+    {
+      ASSERT_TRUE(aCompactedRules[i] != aRules[i]);
+      ASSERT_EQ(aCompactedRules[i]->getBool().evaluate(aContext), aResults[i]);
+    }
+
+    Factorizer aNoGrammar;
+    try {
+      aStripped.compact(aNoGrammar, aCompactedRules);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    return 0;
+  }
+
+  class NodeCounter: public ExpressionVisitor
+  {
+  public:
+    NodeCounter():
+      _count(0)
+    {}
+
+    void visit(const Expression& iExpression)
+    {
+      ++_count;
+    }
+
+    size_t _count;
+  };
+
+  // Replaces "x <symbol> <neutral>" by x
+  class NeutralRemover: public RewritePass
+  {
+    std::string _symbol;
+    std::string _neutral;
+
+    bool isNeutral(const Factorizer& iDag, const Expression& iExpression) const
+    {
+      return (iDag.getNodeKey(iDag.getNodeId(iExpression)).first[0] == 'c') &&
+        (iExpression.toString() == _neutral);
+    }
+
+  public:
+    NeutralRemover(const std::string& iSymbol, const std::string& iNeutral):
+      _symbol(iSymbol), _neutral(iNeutral)
+    {}
+
+    std::string getName() const
+    {
+      return "remove " + _symbol + " " + _neutral;
+    }
+
+    Expression *rewrite(const Factorizer& iDag,
+                        const Factorizer::NodeKey& iKey,
+                        const std::vector<Expression*>& iChildren,
+                        Parser& ioParser)
+    {
+      if (iKey.first != "b " + _symbol)
+      {
+        return NULL;
+      } else if (isNeutral(iDag, *iChildren[1])) {
+        return iChildren[0];
+      } else if (isNeutral(iDag, *iChildren[0])) {
+        return iChildren[1];
+      }
+      return NULL;
+    }
+  };
+
+  int RewritePassTest()
+  {
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+
+    Factorizer aDag;
+    Grammar aGrammar;
+    aGrammar.addObserver(aDag);
+    RegisterAircraft(aDag.getAllocator(), aGrammar);
+    Parser aParser(aDag.getAllocator(), aGrammar);
+    aParser.addObserver(aDag);
+    std::vector<Expression*> aRules;
+    aRules.push_back(&aParser.parse("$Aircraft.Seats * 1 > 100 && true"));
+    aRules.push_back(&aParser.parse("$Aircraft.Model != 'B777' && $Aircraft.Seats * 1 < 200"));
+    aRules.push_back(&aParser.parse("$Aircraft.Seats > 300"));
+    BOOST_FOREACH(Expression *aRule, aRules)
+    {
+      aDag.addRule(*aRule);
+    }
+    Expression *anUnchanged = aRules[2];
+    NodeCounter aBefore;
+    VisitDag(aRules, aBefore);
+    ASSERT_EQ(aRules[2]->getChildrenCount(), 2u);
+
+    NeutralRemover aTimesOne("*", "1");
+    NeutralRemover anAndTrue("&&", "true");
+    PassManager aManager(aDag, aGrammar);
+    aManager.addPass(aTimesOne);
+    aManager.addPass(anAndTrue);
+    // One iteration rewriting, one to check nothing changes anymore
+    ASSERT_EQ(aManager.run(aRules), 2u);
+    ASSERT_EQ(aRules[2], anUnchanged);
+    NodeCounter anAfter;
+    VisitDag(aRules, anAfter);
+    ASSERT_TRUE(anAfter._count < aBefore._count);
+
+    // The rewritten rules are shared with the equivalent parsed ones
+    ASSERT_EQ(aRules[0], &aParser.parse("$Aircraft.Seats > 100"));
+    ASSERT_EQ(aRules[1], &aParser.parse("$Aircraft.Model != 'B777' && $Aircraft.Seats < 200"));
+    ASSERT_TRUE(aRules[0]->getBool().evaluate(aContext));
+    ASSERT_TRUE(aRules[1]->getBool().evaluate(aContext));
+    // The former nodes are retired
+    ASSERT_TRUE(aDag.collectGarbage() > 0u);
+    return 0;
+  }
+
+  int RuleSetTest()
+  {
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(anAlloc, aGrammar);
+    // Never set: its resolver throws a ValueException
+    CachableFact<Aircraft>::RegisterMe(anAlloc, aGrammar, "Other");
+    CString::RegisterMe(aGrammar, anAlloc);
+    RegisterAttribute(anAlloc, aGrammar, boost::mem_fn(&Aircraft::getCode), "Code");
+    RuleSet aSet(aGrammar);
+    std::vector<std::string> aFormulas;
+    for (int i = 0; i < 300; ++i)
+    {
+      std::string aSeats = mdw::lexical_cast<std::string>(i);
+      aFormulas.push_back("$Aircraft.Seats > " + aSeats + " && $Aircraft.Model == 'A320'");
+      aFormulas.push_back("$Aircraft.Seats == " + aSeats + " || $Aircraft.Model != 'A320'");
+      aFormulas.push_back("!($Aircraft.Seats < " + aSeats + ") && $Aircraft.Seats != 180");
+    }
+    std::vector<bool> anExpected;
+    BOOST_FOREACH(const std::string& aFormula, aFormulas)
+    {
+      aSet.add(aFormula);
+      Parser aParser(anAlloc, aGrammar);
+      anExpected.push_back(aParser.parse(aFormula).getBool().evaluate(aContext));
+    }
+    // Unknown facts: the rules only match when the known atoms are enough
+    RuleSet::Rule anAbsorbed = aSet.add("$Other.Seats > 0 || $Aircraft.Seats > 100");
+    aSet.add("$Other.Seats > 0");
+    aSet.add("!($Other.Seats > 0)");
+    aSet.add("$Other.Seats > 0 && $Aircraft.Seats > 100");
+    // As the operators: || ignores an unknown left operand, && lets it through
+    RuleSet::Rule aNegatedOr = aSet.add("!($Other.Seats > 0 || $Aircraft.Seats > 200)");
+    aSet.add("!($Other.Seats > 0 && $Aircraft.Seats > 200)");
+    aSet.add("$Aircraft.Seats > 200 || $Other.Seats > 0");
+    // Indexed by their guards, the Model path having the most rules
+    RuleSet::Rule aGuarded = aSet.add("$Aircraft.Model == 'B777' && $Aircraft.Seats > 0");
+    aSet.add("$Aircraft.Seats == 180 && $Aircraft.Model == 'A320'");
+    aSet.add("$Other.Model == 'A320'");
+    // Not indexed: the C string path cannot be looked up
+    RuleSet::Rule aCString = aSet.add("$Aircraft.Code == 'A320' && $Aircraft.Seats > 0");
+    try {
+      aSet.add("$Aircraft.Seats");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ASSERT_EQ(aSet.size(), 911u);
+    // Atoms are shared between the rules
+    ASSERT_TRUE(aSet.getAtomsCount() < 911u);
+    try {
+      aSet.match(aContext, NULL, 0);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    aSet.compile();
+    ASSERT_EQ(aSet.getIndexesCount(), 2u);
+    ASSERT_EQ(aSet.getIndexedRulesCount(), 306u);
+
+    std::vector<RuleSet::Rule> aMatches(aSet.size());
+    size_t aCount = aSet.match(aContext, &aMatches[0], aMatches.size());
+    aMatches.resize(std::min(aCount, aMatches.size()));
+    std::vector<bool> aMatched(aSet.size(), false);
+    BOOST_FOREACH(RuleSet::Rule aRule, aMatches)
+    {
+      aMatched[aRule] = true;
+    }
+    for (size_t i = 0; i < anExpected.size(); ++i)
+    {
+      ASSERT_EQ(aMatched[i], anExpected[i]);
+    }
+    ASSERT_TRUE(aMatched[anAbsorbed]);
+    ASSERT_FALSE(aMatched[anAbsorbed + 1]);
+    ASSERT_FALSE(aMatched[anAbsorbed + 2]);
+    ASSERT_FALSE(aMatched[anAbsorbed + 3]);
+    Parser aParser(anAlloc, aGrammar);
+    ASSERT_TRUE(aParser.parse("!($Other.Seats > 0 || $Aircraft.Seats > 200)").getBool()
+                .evaluate(aContext));
+    ASSERT_TRUE(aMatched[aNegatedOr]);
+    try {
+      aParser.parse("!($Other.Seats > 0 && $Aircraft.Seats > 200)").getBool().evaluate(aContext);
+      ASSERT_TRUE(false);
+    } catch (const ValueException&) {
+    }
+    ASSERT_FALSE(aMatched[aNegatedOr + 1]);
+    ASSERT_FALSE(aMatched[aNegatedOr + 2]);
+    ASSERT_FALSE(aMatched[aGuarded]);
+    ASSERT_TRUE(aMatched[aGuarded + 1]);
+    ASSERT_FALSE(aMatched[aGuarded + 2]);
+    ASSERT_TRUE(aMatched[aCString]);
+
+    // Only the first ones are written, in increasing order
+    std::vector<RuleSet::Rule> aFirst(3);
+    ASSERT_EQ(aSet.match(aContext, &aFirst[0], aFirst.size()), aCount);
+    ASSERT_EQ(aFirst[0], aMatches[0]);
+    ASSERT_EQ(aFirst[2], aMatches[2]);
+    ASSERT_TRUE(aMatches[1] < aMatches[2]);
+    return 0;
+  }
+
+  int IntervalIndexTest()
+  {
+    IntervalIndex anIndex;
+    std::vector<IntervalIndex::Interval> anIntervals;
+    for (int i = 0; i < 200; ++i)
+    {
+      IntervalIndex::Interval anInterval;
+      anInterval._id = i;
+      if (i % 7)
+      {
+        anInterval.restrictLow(i % 50, i % 2);
+      }
+      if (i % 5)
+      {
+        anInterval.restrictHigh(i % 50 + i % 13, i % 3);
+      }
+      anIntervals.push_back(anInterval);
+      anIndex.add(anInterval);
+    }
+    anIndex.build();
+    for (double aValue = -2; aValue < 70; aValue += 0.5)
+    {
+      std::vector<uint32_t> aFound;
+      anIndex.find(aValue, aFound);
+      std::sort(aFound.begin(), aFound.end());
+      std::vector<uint32_t> anExpected;
+      BOOST_FOREACH(const IntervalIndex::Interval& anInterval, anIntervals)
+      {
+        if (anInterval.contains(aValue))
+        {
+          anExpected.push_back(anInterval._id);
+        }
+      }
+      ASSERT_TRUE(aFound == anExpected);
+    }
+    return 0;
+  }
+
+  int RuleSetRangeTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(anAlloc, aGrammar);
+    RuleSet aSet(aGrammar);
+    std::vector<std::string> aFormulas;
+    for (int i = 0; i < 400; i += 5)
+    {
+      std::string aLow = mdw::lexical_cast<std::string>(i);
+      std::string aHigh = mdw::lexical_cast<std::string>(i + 10);
+      aFormulas.push_back("$Aircraft.Seats >= " + aLow + " && $Aircraft.Seats < " + aHigh);
+      aFormulas.push_back(aLow + " < $Aircraft.Seats && $Aircraft.Model != 'B777'");
+      aFormulas.push_back("$Aircraft.Seats <= " + aLow + " || $Aircraft.Seats > 390");
+    }
+    BOOST_FOREACH(const std::string& aFormula, aFormulas)
+    {
+      aSet.add(aFormula);
+    }
+    aSet.compile();
+    ASSERT_EQ(aSet.getIndexesCount(), 0u);
+    ASSERT_EQ(aSet.getRangeIndexesCount(), 1u);
+    ASSERT_EQ(aSet.getIndexedRulesCount(), 2 * aFormulas.size() / 3);
+
+    int aSeats[] = {0, 5, 180, 999};
+    BOOST_FOREACH(int aSeatCount, aSeats)
+    {
+      Aircraft anAircraft(aSeatCount, "A320");
+      IContext aContext;
+      aContext.setFact(anAircraft, "Aircraft");
+      std::vector<RuleSet::Rule> aMatches(aSet.size());
+      aMatches.resize(aSet.match(aContext, &aMatches[0], aMatches.size()));
+      std::vector<bool> aMatched(aSet.size(), false);
+      BOOST_FOREACH(RuleSet::Rule aRule, aMatches)
+      {
+        aMatched[aRule] = true;
+      }
+      for (size_t i = 0; i < aFormulas.size(); ++i)
+      {
+        Parser aParser(anAlloc, aGrammar);
+        bool anExpected = aParser.parse(aFormulas[i]).getBool().evaluate(aContext);
+        ASSERT_EQ(aMatched[i], anExpected);
+      }
+    }
+    return 0;
+  }
+
+  int RuleSetDiagramTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(anAlloc, aGrammar);
+    // Never set: its resolver throws a ValueException
+    CachableFact<Aircraft>::RegisterMe(anAlloc, aGrammar, "Other");
+    RuleSet aDiagram(aGrammar);
+    aDiagram.setDiagramLimit(100000);
+    RuleSet aSmall(aGrammar);
+    aSmall.setDiagramLimit(10);
+    std::vector<std::string> aFormulas;
+    // Few groups: the atoms being independent, a leaf may hold any subset of the rules
+    for (int i = 0; i < 20; i += 10)
+    {
+      std::string aSeats = mdw::lexical_cast<std::string>(i);
+      aFormulas.push_back("$Aircraft.Seats > " + aSeats + " && $Aircraft.Model == 'A320'");
+      aFormulas.push_back("$Aircraft.Seats == " + aSeats + " || $Aircraft.Model != 'A320'");
+      aFormulas.push_back("!($Aircraft.Seats < " + aSeats + ") && $Other.Seats != " + aSeats);
+    }
+    aFormulas.push_back("$Other.Seats > 0 || $Aircraft.Seats > 100");
+    aFormulas.push_back("!($Other.Seats > 0) || $Other.Seats > 0");
+    aFormulas.push_back("$Aircraft.Model == 'B777' || $Aircraft.Model == 'A320'");
+    aFormulas.push_back("!($Other.Seats > 0 || $Aircraft.Seats > 200)");
+    aFormulas.push_back("!($Other.Seats > 0 && $Aircraft.Seats > 200)");
+    aFormulas.push_back("$Aircraft.Seats > 200 || $Other.Seats > 0");
+    BOOST_FOREACH(const std::string& aFormula, aFormulas)
+    {
+      aDiagram.add(aFormula);
+      aSmall.add(aFormula);
+    }
+    aDiagram.compile();
+    aSmall.compile();
+    ASSERT_TRUE(aDiagram.hasDiagram());
+    ASSERT_TRUE(aDiagram.getDiagramNodesCount() > 0u);
+    // Falls back on the bitmaps
+    ASSERT_FALSE(aSmall.hasDiagram());
+
+    int aSeats[] = {0, 10, 95, 180, 999};
+    const char *aModels[] = {"A320", "B777", "A380"};
+    BOOST_FOREACH(int aSeatCount, aSeats)
+    {
+      BOOST_FOREACH(const char *aModel, aModels)
+      {
+        Aircraft anAircraft(aSeatCount, aModel);
+        IContext aContext;
+        aContext.setFact(anAircraft, "Aircraft");
+        std::vector<RuleSet::Rule> aMatches(aFormulas.size());
+        aMatches.resize(aDiagram.match(aContext, &aMatches[0], aMatches.size()));
+        std::vector<RuleSet::Rule> anExpected(aFormulas.size());
+        anExpected.resize(aSmall.match(aContext, &anExpected[0], anExpected.size()));
+        ASSERT_TRUE(aMatches == anExpected);
+        std::vector<bool> aMatched(aFormulas.size(), false);
+        BOOST_FOREACH(RuleSet::Rule aRule, aMatches)
+        {
+          aMatched[aRule] = true;
+        }
+        for (size_t i = 0; i < 3 * 2; ++i)
+        {
+          if (i % 3 != 2)
+          {
+            Parser aParser(anAlloc, aGrammar);
+            bool aTrue = aParser.parse(aFormulas[i]).getBool().evaluate(aContext);
+            ASSERT_EQ(aMatched[i], aTrue);
+          } else {
+            // Unknown $Other
+            ASSERT_FALSE(aMatched[i]);
+          }
+        }
+        bool aLarge = aSeatCount > 100;
+        ASSERT_EQ(aMatched[6], aLarge);
+        ASSERT_FALSE(aMatched[7]);
+        bool aKnownModel = std::string(aModel) != "A380";
+        ASSERT_EQ(aMatched[8], aKnownModel);
+        // || ignores an unknown left operand, && does not
+        bool aSmallOne = aSeatCount <= 200;
+        ASSERT_EQ(aMatched[9], aSmallOne);
+        ASSERT_FALSE(aMatched[10]);
+        ASSERT_EQ(aMatched[11], !aSmallOne);
+      }
+    }
+
+    // Only the first ones are written
+    Aircraft anAircraft(180, "B777");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    std::vector<RuleSet::Rule> aFirst(2);
+    ASSERT_TRUE(aDiagram.match(aContext, &aFirst[0], aFirst.size()) > 2u);
+    ASSERT_EQ(aFirst[0], 1u);
+    ASSERT_EQ(aFirst[1], 4u);
+    return 0;
+  }
+
+  // The first added rule of the highest priority among all the matches, if any
+  RuleSet::Rule FirstByPriority(const RuleSet& iSet, IContext& ioContext,
+                                const std::vector<int>& iPriorities)
+  {
+    std::vector<RuleSet::Rule> aMatches(iSet.size());
+    aMatches.resize(iSet.match(ioContext, &aMatches[0], aMatches.size()));
+    RuleSet::Rule aFirst = aMatches.empty() ? 0 : aMatches[0];
+    BOOST_FOREACH(RuleSet::Rule aRule, aMatches)
+    {
+      if (iPriorities[aRule] > iPriorities[aFirst])
+      {
+        aFirst = aRule;
+      }
+    }
+    return aFirst;
+  }
+
+  int RuleSetFirstMatchTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(anAlloc, aGrammar);
+    RuleSet aList(aGrammar);
+    RuleSet aDiagram(aGrammar);
+    aDiagram.setDiagramLimit(100000);
+    const char *aModels[] = {"A320", "B777", "A380"};
+    std::vector<std::string> aFormulas;
+    std::vector<int> aPriorities;
+    for (int i = 0; i < 1000; i += 10)
+    {
+      std::string aSeats = mdw::lexical_cast<std::string>(i);
+      std::string aModel = aModels[i % 3];
+      aFormulas.push_back("$Aircraft.Model == '" + aModel + "' && $Aircraft.Seats > " + aSeats);
+      aPriorities.push_back(i % 7);
+      aFormulas.push_back("$Aircraft.Seats >= " + aSeats + " && $Aircraft.Seats < 150");
+      aPriorities.push_back((i / 10) % 5);
+      aFormulas.push_back("$Aircraft.Seats != " + aSeats + " && $Aircraft.Model != 'A380'");
+      aPriorities.push_back(-i);
+    }
+    // Default rule, with the lowest priority
+    aFormulas.push_back("true");
+    aPriorities.push_back(-1000);
+    // The diagram only gets the first three groups and the default rule: the atoms of
+    // the groups are independent, so that all of them would exceed its limit
+    std::vector<int> aDiagramPriorities;
+    for (size_t i = 0; i < aFormulas.size(); ++i)
+    {
+      aList.add(aFormulas[i], aPriorities[i]);
+      if ((i < 9) || (i + 1 == aFormulas.size()))
+      {
+        aDiagram.add(aFormulas[i], aPriorities[i]);
+        aDiagramPriorities.push_back(aPriorities[i]);
+      }
+    }
+    aList.compile();
+    aDiagram.compile();
+    ASSERT_TRUE(aDiagram.hasDiagram());
+    ASSERT_FALSE(aList.hasDiagram());
+    ASSERT_TRUE(aList.size() > 256u);
+    ASSERT_TRUE(aList.getIndexedRulesCount() > 0u);
+
+    // Rules of a higher priority than the first match, over all the aircrafts.
+    // No guard has the E190: the bands of the highest priorities have no candidate.
+    size_t aMaxSkipped = 0;
+    int aSeats[] = {0, 95, 180, 999};
+    const char *aTestedModels[] = {"A320", "B777", "A380", "E190"};
+    BOOST_FOREACH(int aSeatCount, aSeats)
+    {
+      BOOST_FOREACH(const char *aModel, aTestedModels)
+      {
+        Aircraft anAircraft(aSeatCount, aModel);
+        IContext aContext;
+        aContext.setFact(anAircraft, "Aircraft");
+        RuleSet::Rule aFirst = 0;
+        ASSERT_TRUE(aList.matchFirst(aContext, aFirst));
+        ASSERT_EQ(aFirst, FirstByPriority(aList, aContext, aPriorities));
+        size_t aSkipped = 0;
+        BOOST_FOREACH(int aPriority, aPriorities)
+        {
+          aSkipped += (aPriority > aPriorities[aFirst]) ? 1 : 0;
+        }
+        aMaxSkipped = std::max(aMaxSkipped, aSkipped);
+        ASSERT_TRUE(aDiagram.matchFirst(aContext, aFirst));
+        ASSERT_EQ(aFirst, FirstByPriority(aDiagram, aContext, aDiagramPriorities));
+      }
+    }
+    // Some matches are beyond whole bands of 64 rules which do not match
+    ASSERT_TRUE(aMaxSkipped >= 128u);
+
+    RuleSet anEmpty(aGrammar);
+    anEmpty.add("$Aircraft.Seats < 0", 1);
+    anEmpty.compile();
+    Aircraft anAircraft(180, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    RuleSet::Rule aRule = 0;
+    ASSERT_FALSE(anEmpty.matchFirst(aContext, aRule));
+    return 0;
+  }
+
+  int ScoreSetTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    RegisterAircraft(anAlloc, aGrammar);
+    // Never set: its resolver throws a ValueException
+    CachableFact<Aircraft>::RegisterMe(anAlloc, aGrammar, "Other");
+    ScoreSet aSet(aGrammar);
+    std::vector<std::string> aFormulas;
+    for (int i = 0; i < 100; ++i)
+    {
+      std::string aScore = mdw::lexical_cast<std::string>(i);
+      aFormulas.push_back("$Aircraft.Seats > " + aScore + " ? " + aScore + " : -1");
+      aFormulas.push_back("$Aircraft.Model == 'A320' ? " + aScore + ".5 : 0.25");
+    }
+    BOOST_FOREACH(const std::string& aFormula, aFormulas)
+    {
+      aSet.add(aFormula);
+    }
+    ScoreSet::Rule anUnbounded = aSet.add("$Aircraft.Seats * 2");
+    ScoreSet::Rule aCapped = aSet.add("$Aircraft.Seats - 100", 50.);
+    ScoreSet::Rule anUnknown = aSet.add("$Other.Seats + 1000");
+    try {
+      aSet.add("$Aircraft.Model");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ASSERT_EQ(aSet.getUpperBound(0), 0.);
+    ASSERT_EQ(aSet.getUpperBound(3), 1.5);
+    ASSERT_EQ(aSet.getUpperBound(anUnbounded), std::numeric_limits<double>::infinity());
+    ASSERT_EQ(aSet.getUpperBound(aCapped), 50.);
+    ScoreSet aBounds(aGrammar);
+    ASSERT_EQ(aBounds.getUpperBound(aBounds.add("-(2 * ($Aircraft.Seats > 3 ? -4 : 5))")), 8.);
+    ASSERT_EQ(aBounds.getUpperBound(aBounds.add("($Aircraft.Seats > 3 ? 1 : 2) - 3")), -1.);
+    aSet.compile();
+
+    int aSeats[] = {0, 10, 60};
+    const char *aModels[] = {"A320", "B777"};
+    BOOST_FOREACH(int aSeatCount, aSeats)
+    {
+      BOOST_FOREACH(const char *aModel, aModels)
+      {
+        Aircraft anAircraft(aSeatCount, aModel);
+        IContext aContext;
+        aContext.setFact(anAircraft, "Aircraft");
+        std::vector<std::pair<double, int> > anExpected;
+        for (size_t i = 0; i < aFormulas.size(); ++i)
+        {
+          Parser aParser(anAlloc, aGrammar);
+          Expression& aRule = aParser.parse(aFormulas[i]);
+          double aScore = (aRule.getType() == kExprInt) ?
+            double(aRule.getInt().evaluate(aContext)) : aRule.getDouble().evaluate(aContext);
+          anExpected.push_back(std::make_pair(-aScore, int(i)));
+        }
+        anExpected.push_back(std::make_pair(-2. * aSeatCount, int(anUnbounded)));
+        anExpected.push_back(std::make_pair(100. - aSeatCount, int(aCapped)));
+        std::sort(anExpected.begin(), anExpected.end());
+
+        ScoreSet::Score aScores[5];
+        size_t anEvaluated = 0;
+        ASSERT_EQ(aSet.top(aContext, aScores, 5, &anEvaluated), 5u);
+        for (size_t i = 0; i < 5; ++i)
+        {
+          ASSERT_EQ(aScores[i]._rule, ScoreSet::Rule(anExpected[i].second));
+          ASSERT_EQ(aScores[i]._score, -anExpected[i].first);
+        }
+        // The rules with a bound lower than the 5th score are skipped
+        ASSERT_TRUE(anEvaluated < aSet.size());
+      }
+    }
+
+    // Fewer rules than asked, the unknown one being ignored. aCapped scores 40, within
+    // its bound: the best scores are 280, 99.5 and 99.
+    Aircraft anAircraft(140, "A320");
+    IContext aContext;
+    aContext.setFact(anAircraft, "Aircraft");
+    std::vector<ScoreSet::Score> aScores(aSet.size());
+    ASSERT_EQ(aSet.top(aContext, &aScores[0], aScores.size()), aSet.size() - 1);
+    ASSERT_EQ(aScores[0]._rule, anUnbounded);
+    ASSERT_EQ(aScores[1]._rule, ScoreSet::Rule(aFormulas.size() - 1));
+    ASSERT_EQ(aScores[2]._rule, ScoreSet::Rule(aFormulas.size() - 2));
+    bool aCappedFound = false;
+    BOOST_FOREACH(const ScoreSet::Score& aScore, aScores)
+    {
+      ASSERT_TRUE(aScore._rule != anUnknown);
+      if (aScore._rule == aCapped)
+      {
+        ASSERT_EQ(aScore._score, 40.);
+        aCappedFound = true;
+      }
+    }
+    ASSERT_TRUE(aCappedFound);
+    ASSERT_EQ(aSet.top(aContext, NULL, 0), 0u);
+    return 0;
+  }
+
+  int AllFactorizerTests() {
+    int aResult = 0;
+    aResult += CostCalibrationTest();
+    aResult += CostModelSaveLoadTest();
+    aResult += FactorizerCostModelTest();
+    aResult += CacheStatisticsTest();
+    aResult += OptimizationProfileTest();
+    aResult += StructuralSharingTest();
+    aResult += CanonicalizationTest();
+    aResult += IncrementalFactorizerTest();
+    aResult += BulkCompilerTest();
+    aResult += RuleImageTest();
+    aResult += CompactionTest();
+    aResult += RewritePassTest();
+    aResult += RuleSetTest();
+    aResult += IntervalIndexTest();
+    aResult += RuleSetRangeTest();
+    aResult += RuleSetDiagramTest();
+    aResult += RuleSetFirstMatchTest();
+    aResult += ScoreSetTest();
+    return aResult;
+  }
+
+}}
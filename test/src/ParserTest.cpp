@@ -6,6 +6,11 @@
 
 #include <mdw/formula/Parser.hpp>
 #include <mdw/formula/Container.hpp>
+#include <mdw/formula/CompileCache.hpp>
+#include <mdw/formula/RuleStore.hpp>
+#include <mdw/formula/LazyRuleStore.hpp>
+#include <mdw/formula/TieredRuleStore.hpp>
+#include <mdw/formula/RuleSetHolder.hpp>
 #include <mdw/formula/IContext.hpp>
 #include <mdw/formula/Grammar.hpp>
 #include <mdw/formula/StandardTypes.hpp>
@@ -14,8 +19,11 @@
 #include <mdw/formula/cache/Factorizer.hpp>
 #include <mdw/formula/Facts.hpp>
 #include <mdw/Tracer.hpp>
+#include <mdw/lexical_cast.hpp>
+#include <boost/foreach.hpp>
 #include <boost/mem_fn.hpp>
 #include <iostream>
+#include <thread>
 
 #define ASSERT_TRUE(x) if (!(x)) {std::cerr << "Failed to check: " #x << std::endl; return 1;}
 #define ASSERT_FALSE(x) if (x) {std::cerr << "Failed to fail: " #x << std::endl; return 1;}
@@ -1011,6 +1019,537 @@ namespace mdw { namespace formula {
     return 0;
   }
 
+  class Itinerary
+  {
+    std::string _origin;
+    std::string _destination;
+    mutable int _destinationCalls;
+  public:
+    Itinerary(const std::string& iOrigin, const std::string& iDestination):
+      _origin(iOrigin), _destination(iDestination), _destinationCalls(0)
+    {}
+
+    const std::string& getOrigin() const {return _origin;}
+    const std::string& getDestination() const
+    {
+      ++_destinationCalls;
+      return _destination;
+    }
+    int getDestinationCalls() const {return _destinationCalls;}
+  };
+
+  int SubRuleTest(){
+    ArenaAllocator aAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(aAlloc);
+
+    Fact<Itinerary>::RegisterMe(aAlloc, aGrammar, "Itinerary");
+    RegisterAttribute(aAlloc, aGrammar, boost::mem_fn(&Itinerary::getOrigin), "Origin");
+    RegisterAttribute(aAlloc, aGrammar, boost::mem_fn(&Itinerary::getDestination), "Destination");
+
+    aGrammar.registerSubRule<bool>(aAlloc, "isDomestic",
+                                   "$Itinerary.Origin == $Itinerary.Destination");
+    aGrammar.registerSubRule<bool>(aAlloc, "isFrenchDomestic",
+                                   "@isDomestic && $Itinerary.Origin == 'FR'");
+    ASSERT_TRUE(aGrammar.hasSubRule("isDomestic"));
+    ASSERT_FALSE(aGrammar.hasSubRule("isInternational"));
+
+    try {
+      aGrammar.registerSubRule<bool>(aAlloc, "isDomestic", "true");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+
+    Itinerary anItinerary("FR", "FR");
+    IContext aContext;
+    aContext.setFact(anItinerary, "Itinerary");
+
+    std::string aTest1("@isDomestic && $Itinerary.Origin != 'US'");
+    FORMULA_DEBUG(aTest1);
+    Container aFormula1(aTest1, aGrammar);
+    ASSERT_TRUE(aFormula1.getExpression().getBool().evaluate(aContext));
+
+    std::string aTest2("!@isDomestic || @isFrenchDomestic");
+    FORMULA_DEBUG(aTest2);
+    Container aFormula2(aTest2, aGrammar);
+    ASSERT_TRUE(aFormula2.getExpression().getBool().evaluate(aContext));
+    ASSERT_EQ(anItinerary.getDestinationCalls(), 1);
+
+    Container aContainer2(aFormula2.getExpression().toString(), aGrammar);
+    ASSERT_TRUE(aContainer2.getExpression().getBool().evaluate(aContext));
+    ASSERT_EQ(anItinerary.getDestinationCalls(), 1);
+
+    Itinerary anOther("FR", "US");
+    aContext.clean();
+    aContext.setFact(anOther, "Itinerary");
+    ASSERT_FALSE(aFormula1.getExpression().getBool().evaluate(aContext));
+    ASSERT_TRUE(aFormula2.getExpression().getBool().evaluate(aContext));
+    ASSERT_EQ(anOther.getDestinationCalls(), 1);
+
+    try {
+      Container aFormula3("@isInternational", aGrammar);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    return 0;
+  }
+
+  int CompileCacheTest()
+  {
+    ASSERT_EQ(CompileCache::Normalize("  1 +   2 >=\t3 "), "1+2>=3");
+    ASSERT_EQ(CompileCache::Normalize("! ! true"), "! !true");
+    ASSERT_EQ(CompileCache::Normalize("'a  b' +  \"c \\\"  d\""), "'a  b'+\"c \\\"  d\"");
+
+    ArenaAllocator anAllocator;
+    CompileCache aCache(anAllocator);
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(anAllocator);
+    Expression& anExpression = aCache.compile(aGrammar, "1 + 2 == 3");
+    ASSERT_EQ(&aCache.compile(aGrammar, "1+2==3"), &anExpression);
+    ASSERT_EQ(&aCache.compile(aGrammar, " 1 +\n2 ==  3"), &anExpression);
+    ASSERT_FALSE(&aCache.compile(aGrammar, "1 + 2 != 3") == &anExpression);
+
+    IContext aContext;
+    ASSERT_TRUE(anExpression.getBool().evaluate(aContext));
+
+    // Blanks in literals are significant
+    Expression& aSpaced = aCache.compile(aGrammar, "'a  b'");
+    ASSERT_EQ(aCache.compile(aGrammar, "'a b'").getString().evaluate(aContext), "a b");
+    ASSERT_EQ(aSpaced.getString().evaluate(aContext), "a  b");
+
+    // Another grammar may give another meaning to the same text
+    Grammar anOtherGrammar;
+    anOtherGrammar.registerStandardOperators(anAllocator);
+    ASSERT_FALSE(&aCache.compile(anOtherGrammar, "1+2==3") == &anExpression);
+
+    CacheStatistics aStatistics = aCache.getCacheStatistics();
+    ASSERT_EQ(aStatistics._lookups, 7u);
+    ASSERT_EQ(aStatistics._hits, 2u);
+    ASSERT_EQ(aStatistics._misses, 5u);
+    ASSERT_EQ(aStatistics._entries, 5u);
+    ASSERT_TRUE(aStatistics._bytes > 0);
+
+    Container aContainer("1 +2== 3", aGrammar, aCache);
+    ASSERT_EQ(&aContainer.getExpression(), &anExpression);
+    ASSERT_EQ(aCache.getCacheStatistics()._hits, 3u);
+
+    try {
+      aCache.compile(aGrammar, "1 +");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ASSERT_EQ(aCache.size(), 5u);
+
+    aCache.clear();
+    ASSERT_EQ(aCache.size(), 0u);
+    ASSERT_FALSE(&aCache.compile(aGrammar, "1+2==3") == &anExpression);
+    return 0;
+  }
+
+  int RuleStoreTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(anAlloc);
+    RuleStore aStore(aGrammar);
+    size_t aBytes = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+      std::string aValue = mdw::lexical_cast<std::string>(i);
+      RuleStore::Rule aRule =
+        aStore.add("(" + aValue + " + 1) * 2 > 1000 || 'a' == '" + aValue + "'");
+      ASSERT_EQ(aRule, (RuleStore::Rule)i);
+      ASSERT_TRUE(aStore.getBytes(aRule) > 0);
+      aBytes += aStore.getBytes(aRule);
+    }
+    ASSERT_EQ(aStore.size(), 1000u);
+    ASSERT_EQ(aBytes, aStore.getUsedBytes());
+    // One arena per Container would leave the end of each block unused
+    ASSERT_TRUE(aStore.getAllocatedBytes() < aStore.getUsedBytes() / 4 * 5);
+    ASSERT_TRUE(aStore.getAllocatedBytes() >= aStore.getUsedBytes());
+
+    IContext aContext;
+    ASSERT_FALSE(aStore.get(0).getBool().evaluate(aContext));
+    ASSERT_TRUE(aStore.get(500).getBool().evaluate(aContext));
+
+    try {
+      aStore.add("1 +");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ASSERT_EQ(aStore.size(), 1000u);
+    ASSERT_EQ(aStore.add("true"), 1000u);
+
+    // The local of a formula failing in its arrow does not outlive it
+    Iterable<char, std::string>::RegisterMe(anAlloc, aGrammar);
+    try {
+      aStore.add("('abc' -> c ? 1 +).count");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    RuleStore::Rule anArrow = aStore.add("('abc' -> c ? true).count == 3");
+    ASSERT_TRUE(aStore.get(anArrow).getBool().evaluate(aContext));
+    return 0;
+  }
+
+  int LazyRuleStoreTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(anAlloc);
+    LazyRuleStore aStore(aGrammar);
+    for (int i = 0; i < 300; ++i)
+    {
+      std::string aValue = mdw::lexical_cast<std::string>(i);
+      aStore.add(aValue + " * 2 > 300", i % 3);
+    }
+    LazyRuleStore::Rule aBroken = aStore.add("1 +");
+    ASSERT_EQ(aStore.size(), 301u);
+    ASSERT_EQ(aStore.getCompiledCount(), 0u);
+
+    IContext aContext;
+    ASSERT_TRUE(aStore.get(200).getBool().evaluate(aContext));
+    ASSERT_EQ(&aStore.get(200), &aStore.get(200));
+    ASSERT_EQ(aStore.getCompiledCount(), 1u);
+    ASSERT_FALSE(aStore.isCompiled(100));
+    for (int i = 0; i < 2; ++i)
+    {
+      try {
+        aStore.get(aBroken);
+        ASSERT_TRUE(false);
+      } catch (const mdw::UnknownException&) {
+      }
+    }
+
+    aStore.startBackground();
+    try {
+      aStore.add("true");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    // Callers compile what they need while the background thread runs
+    for (int i = 299; i >= 0; i -= 7)
+    {
+      bool anExpected = (i > 150);
+      ASSERT_EQ(aStore.get(i).getBool().evaluate(aContext), anExpected);
+    }
+    while (!aStore.isBackgroundDone())
+    {
+      std::this_thread::yield();
+    }
+    aStore.stopBackground();
+    ASSERT_EQ(aStore.getCompiledCount(), 300u);
+    ASSERT_FALSE(aStore.isCompiled(aBroken));
+    for (int i = 0; i < 300; ++i)
+    {
+      bool anExpected = (i > 150);
+      ASSERT_EQ(aStore.get(i).getBool().evaluate(aContext), anExpected);
+    }
+    return 0;
+  }
+
+  int TieredRuleStoreTest()
+  {
+    typedef TieredRuleStore::Clock Clock;
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(anAlloc);
+    TieredRuleStore aStore(aGrammar, std::chrono::minutes(10));
+    for (int i = 0; i < 100; ++i)
+    {
+      std::string aValue = mdw::lexical_cast<std::string>(i);
+      aStore.add(aValue + " * 2 > 100");
+    }
+    TieredRuleStore::Rule aBroken = aStore.add("1 +");
+    TierStatistics aStats = aStore.getStatistics();
+    ASSERT_EQ(aStats._cold, 101u);
+    ASSERT_EQ(aStats._hot, 0u);
+    ASSERT_EQ(aStats._hotBytes, 0u);
+    ASSERT_TRUE(aStats._coldBytes > 0u);
+
+    IContext aContext;
+    Clock::time_point aStart = Clock::now();
+    for (TieredRuleStore::Rule i = 0; i < 10; ++i)
+    {
+      bool anExpected = i > 50;
+      ASSERT_EQ(aStore.get(i, aStart).getBool().evaluate(aContext), anExpected);
+    }
+    ASSERT_TRUE(aStore.get(80, aStart).getBool().evaluate(aContext));
+    // Already hot
+    ASSERT_TRUE(aStore.get(80, aStart + std::chrono::minutes(5)).getBool().evaluate(aContext));
+    ASSERT_TRUE(aStore.isHot(80));
+    try {
+      aStore.get(aBroken, aStart);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ASSERT_FALSE(aStore.isHot(aBroken));
+    aStats = aStore.getStatistics();
+    ASSERT_EQ(aStats._hot, 11u);
+    ASSERT_EQ(aStats._cold, 90u);
+    ASSERT_EQ(aStats._accesses, 13u);
+    ASSERT_EQ(aStats._promotions, 11u);
+    ASSERT_TRUE(aStats._hotBytes > 0u);
+
+    ASSERT_EQ(aStore.demoteIdle(aStart + std::chrono::minutes(5)), 0u);
+    // Only rule 80 was accessed during the idle period
+    ASSERT_EQ(aStore.demoteIdle(aStart + std::chrono::minutes(12)), 10u);
+    ASSERT_TRUE(aStore.isHot(80));
+    ASSERT_FALSE(aStore.isHot(0));
+    aStats = aStore.getStatistics();
+    ASSERT_EQ(aStats._hot, 1u);
+    ASSERT_EQ(aStats._demotions, 10u);
+
+    // Rehydrated on access
+    ASSERT_FALSE(aStore.get(0, aStart + std::chrono::minutes(20)).getBool().evaluate(aContext));
+    ASSERT_EQ(aStore.getStatistics()._promotions, 12u);
+    return 0;
+  }
+
+  // Checks that each pinned version holds its own rules until the holder says to stop
+  class EvaluatePinned {
+  public:
+    EvaluatePinned(RuleSetHolder& ioHolder, const std::atomic<bool>& iStop, int& oFailures):
+      _holder(ioHolder), _stop(iStop), _failures(oFailures)
+    {}
+
+    void operator()()
+    {
+      IContext aContext;
+      while (!_stop.load())
+      {
+        RuleSetHolder::Pin aPin(_holder);
+        std::string anExpected = mdw::lexical_cast<std::string>(aPin.getVersion());
+        if (aPin.getRules().get(0).getString().evaluate(aContext) != anExpected)
+        {
+          ++_failures;
+        }
+        aContext.clean();
+      }
+    }
+
+  private:
+    RuleSetHolder& _holder;
+    const std::atomic<bool>& _stop;
+    int& _failures;
+  };
+
+  int RuleSetHolderTest()
+  {
+    ArenaAllocator anAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(anAlloc);
+    RuleSetHolder aHolder(8);
+    ASSERT_EQ(aHolder.getVersion(), 0u);
+    try {
+      RuleSetHolder::Pin aPin(aHolder);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+
+    RuleStore *aRules = new RuleStore(aGrammar, 1024);
+    aRules->add("'1'");
+    ASSERT_EQ(aHolder.publish(aRules), 1u);
+    {
+      RuleSetHolder::Pin aPin(aHolder);
+      aRules = new RuleStore(aGrammar, 1024);
+      aRules->add("'2'");
+      ASSERT_EQ(aHolder.publish(aRules), 2u);
+      // Version 1 is still pinned
+      ASSERT_EQ(aHolder.reclaim(), 0u);
+      ASSERT_EQ(aPin.getVersion(), 1u);
+      IContext aContext;
+      ASSERT_EQ(aPin.getRules().get(0).getString().evaluate(aContext), "1");
+    }
+    ASSERT_EQ(aHolder.reclaim(), 1u);
+
+    // More readers than slots: the last one pins in added slots
+    std::vector<RuleSetHolder::Pin*> aPins;
+    for (int i = 0; i < 20; ++i)
+    {
+      aPins.push_back(new RuleSetHolder::Pin(aHolder));
+    }
+    for (int i = 0; i < 19; ++i)
+    {
+      delete aPins[i];
+    }
+    aRules = new RuleStore(aGrammar, 1024);
+    aRules->add("'3'");
+    ASSERT_EQ(aHolder.publish(aRules), 3u);
+    ASSERT_EQ(aHolder.reclaim(), 0u);
+    delete aPins[19];
+    ASSERT_EQ(aHolder.reclaim(), 1u);
+
+    std::atomic<bool> aStop(false);
+    std::vector<int> aFailures(4, 0);
+    std::vector<std::thread> aReaders;
+    for (size_t i = 0; i < aFailures.size(); ++i)
+    {
+      aReaders.push_back(std::thread(EvaluatePinned(aHolder, aStop, aFailures[i])));
+    }
+    for (int i = 4; i < 50; ++i)
+    {
+      aRules = new RuleStore(aGrammar, 1024);
+      aRules->add("'" + mdw::lexical_cast<std::string>(i) + "'");
+      aHolder.publish(aRules);
+      aHolder.reclaim();
+    }
+    aStop.store(true);
+    BOOST_FOREACH(std::thread& aReader, aReaders)
+    {
+      aReader.join();
+    }
+    BOOST_FOREACH(int aFailureCount, aFailures)
+    {
+      ASSERT_EQ(aFailureCount, 0);
+    }
+    aHolder.reclaim();
+    ASSERT_EQ(aHolder.getRetiredCount(), 0u);
+    ASSERT_EQ(aHolder.getVersion(), 49u);
+    return 0;
+  }
+
+  // Parses and evaluates the formulas again and again, counting wrong results
+  class ParseInThread {
+  public:
+    ParseInThread(const Grammar& iGrammar, const std::vector<std::string>& iFormulas,
+                  const std::vector<bool>& iResults, const Itinerary& iItinerary,
+                  int& oFailures):
+      _grammar(iGrammar), _formulas(iFormulas), _results(iResults), _itinerary(iItinerary),
+      _failures(oFailures)
+    {}
+
+    void operator()()
+    {
+      IContext aContext;
+      aContext.setFact(_itinerary, "Itinerary");
+      for (int i = 0; i < 100; ++i)
+      {
+        for (size_t j = 0; j < _formulas.size(); ++j)
+        {
+          Container aContainer(_formulas[j], _grammar);
+          if (aContainer.getExpression().getBool().evaluate(aContext) != _results[j])
+          {
+            ++_failures;
+          }
+        }
+      }
+    }
+
+  private:
+    const Grammar& _grammar;
+    const std::vector<std::string>& _formulas;
+    const std::vector<bool>& _results;
+    Itinerary _itinerary; // Each thread has its own copy
+    int& _failures;
+  };
+
+  int FrozenGrammarTest()
+  {
+    ArenaAllocator aAlloc;
+    Grammar aBase;
+    aBase.registerStandardOperators(aAlloc);
+    Fact<Itinerary>::RegisterMe(aAlloc, aBase, "Itinerary");
+    RegisterAttribute(aAlloc, aBase, boost::mem_fn(&Itinerary::getOrigin), "Origin");
+    RegisterAttribute(aAlloc, aBase, boost::mem_fn(&Itinerary::getDestination), "Destination");
+    aBase.registerSubRule<bool>(aAlloc, "isDomestic",
+                                "$Itinerary.Origin == $Itinerary.Destination");
+    Grammar aGrammar;
+    aGrammar.linkGrammar(aBase);
+
+    std::vector<std::string> aFormulas;
+    aFormulas.push_back("@isDomestic && $Itinerary.Origin != 'US'");
+    aFormulas.push_back("$Itinerary.Destination >= 'FRX' || 1 + 2 * 3 > 10");
+    aFormulas.push_back("!(2.5 * 2. >= 5.) || -(1 + 1) == -2 && $Itinerary.Origin != 'US'");
+
+    Itinerary anItinerary("FR", "FR");
+    std::vector<bool> aResults;
+    {
+      IContext aContext;
+      aContext.setFact(anItinerary, "Itinerary");
+      BOOST_FOREACH(const std::string& aFormula, aFormulas)
+      {
+        aResults.push_back(Container(aFormula, aGrammar).getExpression().getBool()
+                           .evaluate(aContext));
+      }
+    }
+
+    ASSERT_FALSE(aGrammar.isFrozen());
+    aGrammar.freeze();
+    ASSERT_TRUE(aGrammar.isFrozen());
+    ASSERT_TRUE(aGrammar.hasFact("Itinerary"));
+    ASSERT_FALSE(aGrammar.hasFact("Origin"));
+    ASSERT_TRUE(aGrammar.hasSubRule("isDomestic"));
+    try {
+      aGrammar.registerSubRule<bool>(aAlloc, "isFrench", "$Itinerary.Origin == 'FR'");
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    try {
+      aGrammar.linkGrammar(aBase);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    try {
+      Container("1 + 'a'", aGrammar);
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+
+    // Parsers of different threads share the frozen grammar
+    std::vector<int> aFailures(4, 0);
+    std::vector<std::thread> aThreads;
+    for (size_t i = 0; i < aFailures.size(); ++i)
+    {
+      aThreads.push_back(std::thread(ParseInThread(aGrammar, aFormulas, aResults, anItinerary,
+                                                   aFailures[i])));
+    }
+    BOOST_FOREACH(std::thread& aThread, aThreads)
+    {
+      aThread.join();
+    }
+    BOOST_FOREACH(int aFailure, aFailures)
+    {
+      ASSERT_EQ(aFailure, 0);
+    }
+    return 0;
+  }
+
+  int StaticTypeIdTest()
+  {
+    ASSERT_EQ(StaticTypeId<Itinerary>::Get(), StaticTypeId<Itinerary>::Get());
+    ASSERT_FALSE(StaticTypeId<Itinerary>::Get() == StaticTypeId<Customer>::Get());
+    ASSERT_FALSE(StaticTypeId<bool>::Get() == kExprVoid);
+
+    ArenaAllocator aAlloc;
+    Grammar aGrammar;
+    aGrammar.registerStandardOperators(aAlloc);
+    try {
+      aGrammar.findType<Itinerary>();
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    ExpressionType aType = aGrammar.registerType<Itinerary>();
+    ASSERT_EQ(aGrammar.findType<Itinerary>(), aType);
+    ASSERT_EQ(aGrammar.registerType<Itinerary>(), aType);
+    // Another grammar may give another id to the same C++ type
+    Grammar anOther;
+    anOther.registerType<Customer>();
+    ASSERT_FALSE(anOther.registerType<Itinerary>() == aType);
+    ASSERT_EQ(aGrammar.findType<Itinerary>(), aType);
+
+    Container aContainer("1 + 2 > 2", aGrammar);
+    const Expression& anExpression = aContainer.getExpression();
+    ASSERT_EQ(anExpression.getStaticTypeId(), StaticTypeId<bool>::Get());
+    ASSERT_EQ(&anExpression.get<bool>(), &anExpression.getBool());
+    try {
+      anExpression.get<std::string>();
+      ASSERT_TRUE(false);
+    } catch (const mdw::UnknownException&) {
+    }
+    return 0;
+  }
+
   int AllParserTests() {
     int aResult = 0;
     aResult += ConstantBool();
@@ -1045,6 +1584,14 @@ namespace mdw { namespace formula {
     aResult += FactTest();
     aResult += BaseFactTest();
     aResult += LogicalOrBoolOperatorTest();
+    aResult += SubRuleTest();
+    aResult += CompileCacheTest();
+    aResult += RuleStoreTest();
+    aResult += LazyRuleStoreTest();
+    aResult += TieredRuleStoreTest();
+    aResult += RuleSetHolderTest();
+    aResult += FrozenGrammarTest();
+    aResult += StaticTypeIdTest();
     return aResult;
   }
 
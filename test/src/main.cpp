@@ -4,6 +4,8 @@
 namespace mdw { namespace formula {
   int AllParserTests();
   int AllFormulaTests();
+  int AllFactorizerTests();
+  int AllBatchTests();
 }}
 
 int main(int argc, char **argv)
@@ -12,6 +14,8 @@ int main(int argc, char **argv)
   try {
     aResult += mdw::formula::AllParserTests();
     aResult += mdw::formula::AllFormulaTests();
+    aResult += mdw::formula::AllFactorizerTests();
+    aResult += mdw::formula::AllBatchTests();
   } catch (const mdw::UnknownException& iEx) {
     std::cerr << "Received an exception: " << iEx.message() << std::endl;
   }